@@ -2,9 +2,11 @@
 // Spring 2021
 
 #include "AllPass.h"
+#include "Kernels.h"
+#include "DelayLine.h"
 
 // AllPass Constructor
-AllPass::AllPass(double a, unsigned delay) : a(a), m(delay)
+AllPass::AllPass(double a, unsigned delay) : a(a), m(delay), delX(), delY(), len(0), pos(0)
 {
     Reset();
 }
@@ -12,13 +14,12 @@ AllPass::AllPass(double a, unsigned delay) : a(a), m(delay)
 // reset allpass filter
 void AllPass::Reset()
 {
-    delX.clear(); // clear x delays
-    delY.clear(); // clear y delays
+    // delay line needs at least one sample of delay
+    len = m > 0 ? m : 1;
+    pos = 0;
     
-    for (unsigned i = 0; i < m; ++i) {
-        delX.push_back(0.0);
-        delY.push_back(0.0);
-    }
+    delX.assign(2 * len, 0.0); // clear x delays
+    delY.assign(2 * len, 0.0); // clear y delays
 }
 
 void AllPass::SetCoefficient(double new_a)
@@ -32,29 +33,83 @@ void AllPass::SetDelay(unsigned samples)
 }
 
 
-double AllPass::GetCoefficient()
+double AllPass::GetCoefficient() const
 {
     return a;
 }
 
-unsigned AllPass::GetDelay()
+unsigned AllPass::GetDelay() const
 {
     return m;
 }
 
+unsigned AllPass::GetStateLength()
+{
+    return len;
+}
+
+// the doubled lines hold the oldest first from pos
+void AllPass::GetState(float *x, float *y)
+{
+    for (unsigned i = 0; i < len; ++i) {
+        x[i] = static_cast<float>(delX[pos + i]);
+        y[i] = static_cast<float>(delY[pos + i]);
+    }
+}
+
+void AllPass::SetState(const float *x, const float *y, unsigned n)
+{
+    RestoreLine(delX, len, x, n);
+    RestoreLine(delY, len, y, n);
+    pos = 0;
+}
+
+void AllPass::SetState(const AllPass &from)
+{
+    CopyLine(delX, len, from.delX, from.len, from.pos);
+    CopyLine(delY, len, from.delY, from.len, from.pos);
+    pos = 0;
+}
+
+// store current values, oldest delay is overwritten
+void AllPass::Push(double x, double y)
+{
+    delX[pos] = delX[pos + len] = x;
+    delY[pos] = delY[pos + len] = y;
+    
+    if (++pos == len)
+        pos = 0;
+}
+
 // returns filtered signal value
 float AllPass::operator()(float x)
 {
-    double xm = delX.front();
-    double ym = delY.front();
-    delX.pop_front();
-    delY.pop_front();
+    double xm = delX[pos];
+    double ym = delY[pos];
     
     // y[t] = x[t-m] + a * (x[t] - y[t-m])
     double y = xm + a * (x - ym);
     
-    delX.push_back(x);
-    delY.push_back(y);
-    
+    Push(x, y);
     return static_cast<float>(y);
+}
+
+// filters a block of samples
+void AllPass::Process(const double *x, double *y, unsigned n)
+{
+    const DspKernels &k = GetKernels();
+    
+    while (n > 0) {
+        // up to m outputs only depend on stored delays
+        unsigned count = n < len ? n : len;
+        
+        k.AllPass(&delX[pos], &delY[pos], x, a, y, count);
+        
+        for (unsigned i = 0; i < count; ++i)
+            Push(x[i], y[i]);
+        
+        x += count;
+        y += count;
+        n -= count;
     }
+}
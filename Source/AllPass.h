@@ -2,7 +2,7 @@
 // Spring 2021
 
 #pragma once
-#include <deque> // std::deque
+#include <vector> // std::vector
 
 // all-pass filter
 class AllPass
@@ -14,13 +14,25 @@ public:
     
     void SetCoefficient(double new_a); // set allpass coefficient a
     void SetDelay(unsigned samples);  // set allpass delay
-    double GetCoefficient();
-    unsigned GetDelay();
+    double GetCoefficient() const;
+    unsigned GetDelay() const;
+    
+    // state: delay lines oldest first, x[t-m] .. x[t-1] and the same for y
+    unsigned GetStateLength();                        // values per line
+    void GetState(float *x, float *y);                // GetStateLength() values each
+    void SetState(const float *x, const float *y, unsigned n); // newest n values, older cleared
+    void SetState(const AllPass &from); // newest values of from's lines, no allocation
     
     float operator()(float x);
+    void Process(const double *x, double *y, unsigned n); // filter block x into y (no overlap)
 private:
+    void Push(double x, double y); // store current values
+    
     double a; // all-pass coefficient
     unsigned m; // delay in samples
     
-    std::deque<double> delX, delY; // delays x[t-m], y[t-m]
+    // delays x[t-m], y[t-m] up to t-1, stored twice for unwrapped block reads
+    std::vector<double> delX, delY;
+    unsigned len; // delay line length (m at last reset)
+    unsigned pos; // position of oldest delay t-m
 };
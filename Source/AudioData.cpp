@@ -2,6 +2,8 @@
 // Spring 2021
 
 #include "AudioData.h"
+#include "Kernels.h"
+#include "Trace.h"
 #include <cmath>
 #include <stdexcept>
 #include <fstream>
@@ -9,32 +11,174 @@
 
 using namespace std;
 
-const float max16 = static_cast<float>((1 << 15) - 1);
 const float max8 = static_cast<float>((1 << 7) - 1);
+const unsigned riffMax = 0xFFFFFFFF; // largest 32 bit chunk size, RF64 placeholder
 
 // audio data constructor
-AudioData::AudioData(unsigned nframes, unsigned R, unsigned nchannels) :
+AudioData::AudioData(size_t nframes, unsigned R, unsigned nchannels) :
 frame_count(nframes),
 sampling_rate(R),
 channel_count(nchannels)
 {
     fdata.resize(nframes * nchannels);
-    unsigned size = nframes * nchannels;
-    for (unsigned i = 0; i < size; ++i) {
+    size_t size = nframes * nchannels;
+    for (size_t i = 0; i < size; ++i) {
         fdata[i] = 0.0;
     }
 }
 
 // contructs an audio data object from existing wave file
-AudioData::AudioData(const char *fname)
+// data is read in chunks, progress (if set) gets the fraction read after each
+// chunk and returns false to cancel the load
+AudioData::AudioData(const char *fname, std::function<bool(double)> progress)
 {
+    MR_TRACE_SCOPE("load");
+    
     // input file stream
     fstream in(fname, ios_base::binary | ios_base::in);
     
     if (!in)
         throw runtime_error("unable to open file");
     
+    WaveFormat format = waveReadHeader(in);
+    
+    channel_count = format.channels;
+    sampling_rate = format.rate;
+    
+    // checks the data fits in memory on this platform
+    if (format.frames > static_cast<size_t>(-1) / sizeof(float) / channel_count)
+        throw runtime_error("WAVE file too large");
+    
+    frame_count = static_cast<size_t>(format.frames);
+    
+    // resizes fdata vector
+    size_t size = frame_count * channel_count;
+    fdata.resize(size);
+    
+    unsigned bytes = format.bits / 8;
+    
+    // reads in data a chunk at a time
+    const size_t chunk = (1 << 19) - (1 << 19) % channel_count; // samples per read
+    vector<short> data(chunk);
+    
+    for (size_t done = 0; done < size; )
+    {
+        size_t n = (size - done < chunk) ? size - done : chunk;
+        in.read(reinterpret_cast<char*>(&data[0]), bytes * n);
+        
+        if (!in)
+            throw runtime_error("WAVE file missing data");
+        
+        pcmToFloat(&data[0], &fdata[done], n, format.bits);
+        done += n;
+        
+        if (progress && !progress(static_cast<double>(done) / size))
+            throw runtime_error("loading cancelled");
+    }
+}
+
+// returns sample value (retrieves)
+float AudioData::sample(size_t frame, unsigned channel) const
+{
+    size_t index = frame * channel_count + channel;
+    return fdata[index];
+}
+
+// returns reference to sample value (sets)
+float& AudioData::sample(size_t frame, unsigned channel)
+{
+    size_t index = frame * channel_count + channel;
+    return fdata[index];
+}
+
+// normalizes audio data
+void normalize(AudioData &ad, float dB)
+{
+    MR_TRACE_SCOPE("normalize");
+    size_t frames = ad.frames();
+    unsigned channels = ad.channels();
+    float targetmax = std::abs(pow(10, static_cast<float>(dB/20.0f)));
+    float currentmax = 0.0f;
+    
+    const DspKernels &k = GetKernels();
+    
+    // removes dc offset for each channel
+    for (unsigned i = 0; i < channels; i++)
+    {
+        double offset = 0.0;
+        
+        // adds all frame values in channel
+        for (size_t j = 0; j < frames; j++)
+            offset += ad.sample(j,i);
+        
+        // divides by num frames to get dc offset for channel
+        offset = offset / frames;
+        
+        // removes dc offset from data
+        for (size_t j = 0; j < frames; j++)
+            ad.sample(j,i) -= static_cast<float>(offset);
+    }
+    
+    currentmax = k.PeakAbs(ad.data(), ad.size());
+    
+    // silent data can't be normalized
+    if (currentmax == 0.0f)
+        return;
+    
+    // calculates gain factor
+    float m = targetmax / currentmax;
+    
+    // scales each data value
+    k.Scale(ad.data(), ad.size(), m);
+}
+
+bool waveWrite(const char *fname, const AudioData &ad, unsigned bits)
+{
+    MR_TRACE_SCOPE("waveWrite");
+    
+    if (!fname || ad.data() == nullptr)
+        return false;
+    
+    if (bits != 8 && bits != 16)
+        return false;
+    
+    WaveFormat format = { ad.channels(), ad.rate(), bits, ad.frames() };
     
+    // output file stream
+    fstream out(fname, ios_base::binary | ios_base::out | ios_base::trunc);
+    
+    // file failed to open
+    if (!out.is_open())
+        return false;
+    
+    // writes wave header to file
+    waveWriteHeader(out, format);
+    
+    // writes data a chunk at a time
+    const size_t chunk = 1 << 19; // samples per write
+    vector<short> data(chunk);
+    size_t size = ad.size();
+    
+    for (size_t done = 0; done < size; done += chunk)
+    {
+        size_t n = (size - done < chunk) ? size - done : chunk;
+        floatToPcm(ad.data() + done, &data[0], n, bits);
+        out.write(reinterpret_cast<char*>(&data[0]), n * (bits / 8));
+    }
+    
+    // chunks are padded to an even size
+    if ((size * (bits / 8)) % 2)
+        out.put(0);
+    
+    return static_cast<bool>(out); // wave write successful
+}
+
+//==============================================================================
+// Wave Header
+
+// reads wave header up to the sample data
+WaveFormat waveReadHeader(std::istream &in)
+{
     struct { char label[4]; unsigned size; } chunk_head;
     char wave_tag[4];
     
@@ -42,20 +186,35 @@ AudioData::AudioData(const char *fname)
     in.read(reinterpret_cast<char*>(&chunk_head), 8);
     in.read(wave_tag, 4);
     
+    bool rf64 = strncmp(chunk_head.label, "RF64", 4) == 0 || strncmp(chunk_head.label, "BW64", 4) == 0;
+    
     // checks for valid wave file label and tag
-    if (!in || strncmp(chunk_head.label, "RIFF", 4) != 0 || strncmp(wave_tag, "WAVE", 4) != 0)
+    if (!in || (!rf64 && strncmp(chunk_head.label, "RIFF", 4) != 0) || strncmp(wave_tag, "WAVE", 4) != 0)
         throw runtime_error("not a valid WAVE file");
     
+    // RF64 keeps 64 bit sizes in a ds64 chunk that comes first
+    unsigned long long data_size64 = 0;
+    if (rf64)
+    {
+        in.read(reinterpret_cast<char*>(&chunk_head), 8);
+        if (!in || strncmp(chunk_head.label, "ds64", 4) != 0 || chunk_head.size < 24)
+            throw runtime_error("invalid RF64 file: missing ds64 chunk");
+        
+        unsigned long long sizes[3]; // riff size, data size, sample count
+        in.read(reinterpret_cast<char*>(sizes), 24);
+        data_size64 = sizes[1];
+        in.seekg(chunk_head.size - 24 + (chunk_head.size % 2), ios_base::cur);
+    }
     
     // looks for format chunk
     in.read(reinterpret_cast<char*>(&chunk_head), 8);
     while (in && strncmp(chunk_head.label, "fmt ", 4) != 0)
     {
-        in.seekg(chunk_head.size, ios_base::cur);
+        in.seekg(chunk_head.size + (chunk_head.size % 2), ios_base::cur);
         in.read(reinterpret_cast<char*>(&chunk_head), 8);
     }
     
-    if (!in)
+    if (!in || chunk_head.size < 16)
         throw runtime_error("WAVE file missing format chunk");
     
     // gets format chunk info
@@ -65,206 +224,134 @@ AudioData::AudioData(const char *fname)
     if (*reinterpret_cast<unsigned short*>(format) != 1)
         throw runtime_error("invalid WAVE file: compressed audio data");
     
-    channel_count = static_cast<unsigned>(*reinterpret_cast<unsigned short*>(format + 2));
-    sampling_rate = *reinterpret_cast<unsigned*>(format + 4);
+    WaveFormat wf;
+    wf.channels = static_cast<unsigned>(*reinterpret_cast<unsigned short*>(format + 2));
+    wf.rate = *reinterpret_cast<unsigned*>(format + 4);
     unsigned int bytes_per_second = *reinterpret_cast<unsigned*>(format + 8);
     unsigned short bytes_per_sample = *reinterpret_cast<unsigned short*>(format + 12);
-    unsigned short bits = *reinterpret_cast<unsigned short*>(format + 14);
+    wf.bits = *reinterpret_cast<unsigned short*>(format + 14);
+    
+    // checks for channels
+    if (wf.channels == 0)
+        throw runtime_error("invalid WAVE file: no channels");
     
     // checks for valid bit resolution
-    if (bits != 8 && bits != 16)
+    if (wf.bits != 8 && wf.bits != 16)
         throw runtime_error("invalid WAVE file: invalid bit resolution");
     
     // checks for consistent bytes-per-sample
-    if (bytes_per_sample != channel_count * (bits / 8))
+    if (bytes_per_sample != wf.channels * (wf.bits / 8))
         throw runtime_error("invalid WAVE file: bytes-per-sample not consistent");
     
     // checks for consistent bytes-per-second
-    if (bytes_per_second != sampling_rate * bytes_per_sample)
+    if (bytes_per_second != wf.rate * bytes_per_sample)
         throw runtime_error("invalid WAVE file: bytes-per-second not consistent");
     
-    in.seekg(chunk_head.size - 16, ios_base::cur);
+    in.seekg(chunk_head.size - 16 + (chunk_head.size % 2), ios_base::cur);
     
     // looks for data chunk
     in.read(reinterpret_cast<char*>(&chunk_head), 8);
     while (in && strncmp(chunk_head.label, "data", 4) != 0)
     {
-        in.seekg(chunk_head.size, ios_base::cur);
+        in.seekg(chunk_head.size + (chunk_head.size % 2), ios_base::cur);
         in.read(reinterpret_cast<char*>(&chunk_head), 8);
     }
     
     if (!in)
         throw runtime_error("WAVE file missing data chunk");
     
-    // calculates frame count
-    frame_count = static_cast<unsigned>((8 * chunk_head.size) / (channel_count * bits));
+    // calculates frame count, RF64 data size is in ds64
+    unsigned long long data_size = chunk_head.size;
+    if (rf64 && chunk_head.size == riffMax)
+        data_size = data_size64;
     
-    // resizes fdata vector
-    unsigned size = frame_count * channel_count;
-    fdata.resize(size);
-    
-    unsigned bytes = bits / 8;
+    wf.frames = data_size / bytes_per_sample;
+    return wf;
+}
+
+// writes wave header, the sample data follows
+void waveWriteHeader(std::ostream &out, const WaveFormat &format, bool rf64)
+{
+    unsigned bytes = format.bits / 8;
+    unsigned long long size = format.frames * format.channels * bytes;
+    unsigned long long pad = size % 2;
     
-    // reads in data
-    short *data = new short[size];
-    in.read(reinterpret_cast<char*>(data), bytes * size);
+    // RIFF sizes are 32 bit
+    if (36 + size + pad > riffMax)
+        rf64 = true;
     
-    if (!in)
-        throw runtime_error("WAVE file missing data");
+    char header[80];
+    char *fmt = header + 12;
     
-    // if 16 bit
-    if (bits == 16)
+    if (rf64)
     {
-        for (unsigned i = 0; i < size; i++)
-            fdata[i] = static_cast<float>(data[i] / float(1<<15));
+        // ds64 chunk holds the real sizes
+        strncpy(header + 0, "RF64", 4);
+        *reinterpret_cast<unsigned*>(header + 4) = riffMax;
+        strncpy(header + 12, "ds64", 4);
+        *reinterpret_cast<unsigned*>(header + 16) = 28;
+        *reinterpret_cast<unsigned long long*>(header + 20) = 72 + size + pad; // riff size
+        *reinterpret_cast<unsigned long long*>(header + 28) = size;            // data size
+        *reinterpret_cast<unsigned long long*>(header + 36) = format.frames;   // sample count
+        *reinterpret_cast<unsigned*>(header + 44) = 0;                         // table length
+        fmt = header + 48;
     }
-    
-    // if 8 bit
-    else if (bits == 8)
+    else
     {
-        unsigned char *data8 = reinterpret_cast<unsigned char*>(data);
-        for (unsigned i = 0; i < size; i++)
-            fdata[i] = (static_cast<float>(data8[i] - 128)) / 128;
+        strncpy(header + 0, "RIFF", 4);
+        *reinterpret_cast<unsigned*>(header + 4) = static_cast<unsigned>(36 + size + pad);
     }
+    strncpy(header + 8, "WAVE", 4);
     
-    delete[] data;
+    strncpy(fmt + 0, "fmt ", 4);
+    *reinterpret_cast<unsigned*>(fmt + 4) = 16;
+    *reinterpret_cast<unsigned short*>(fmt + 8) = 1;
+    *reinterpret_cast<unsigned short*>(fmt + 10) = format.channels;
+    *reinterpret_cast<unsigned*>(fmt + 12) = format.rate;
+    *reinterpret_cast<unsigned*>(fmt + 16) = format.rate * format.channels * bytes;
+    *reinterpret_cast<unsigned short*>(fmt + 20) = format.channels * bytes;
+    *reinterpret_cast<unsigned short*>(fmt + 22) = format.bits;
+    strncpy(fmt + 24, "data", 4);
+    *reinterpret_cast<unsigned*>(fmt + 28) = rf64 ? riffMax : static_cast<unsigned>(size);
+    
+    out.write(header, fmt + 32 - header);
 }
 
-// returns sample value (retrieves)
-float AudioData::sample(unsigned frame, unsigned channel) const
-{
-    unsigned index = frame * channel_count + channel;
-    return fdata[index];
-}
+//==============================================================================
+// Sample Conversion
 
-// returns reference to sample value (sets)
-float& AudioData::sample(unsigned frame, unsigned channel)
+void pcmToFloat(const void *pcm, float *out, size_t n, unsigned bits)
 {
-    unsigned index = frame * channel_count + channel;
-    return fdata[index];
-}
-
-AudioData& AudioData::operator=(AudioData & d)
-{
-    fdata = d.fdata;
-    frame_count = d.frame_count;
-    sampling_rate = d.sampling_rate;
-    channel_count = d.channel_count;
-    
-    
-    return *this;
-}
-
-// normalizes audio data
-void normalize(AudioData &ad, float dB)
-{
-    unsigned frames = ad.frames();
-    unsigned channels = ad.channels();
-    float targetmax = std::abs(pow(10, static_cast<float>(dB/20.0f)));
-    float currentmax = 0.0f;
-    
-    // removes dc offset for each channel
-    for (unsigned i = 0; i < channels; i++)
+    // if 16 bit
+    if (bits == 16)
     {
-        float offset = 0.0f;
-        
-        // adds all frame values in channel
-        for (unsigned j = 0; j < frames; j++)
-            offset += ad.sample(j,i);
-        
-        // divides by num frames to get dc offset for channel
-        offset = offset / frames;
-        
-        // removes dc offset from data
-        for (unsigned j = 0; j < frames; j++)
-        {
-            ad.sample(j,i) -= offset;
-            
-            float value = std::abs(ad.sample(j,i));
-            
-            if (value >= currentmax)
-                currentmax = value;
-        }
+        GetKernels().ShortToFloat(static_cast<const short*>(pcm), out, n);
     }
     
-    // calculates gain factor
-    float m = targetmax / currentmax;
-    
-    // scales each data value
-    for (unsigned i = 0; i < channels; i++)
-        for (unsigned j = 0; j < frames; j++)
-            ad.sample(j,i) *= m;
+    // if 8 bit
+    else if (bits == 8)
+    {
+        const unsigned char *data8 = static_cast<const unsigned char*>(pcm);
+        for (size_t i = 0; i < n; i++)
+            out[i] = (static_cast<float>(data8[i] - 128)) / 128;
+    }
 }
 
-bool waveWrite(const char *fname, const AudioData &ad, unsigned bits)
+void floatToPcm(const float *in, void *pcm, size_t n, unsigned bits)
 {
-    if (!fname || ad.data() == nullptr)
-        return false;
-    
-    if (bits != 8 && bits != 16)
-        return false;
-    
-    unsigned frames = ad.frames(), channels = ad.channels(), rate = ad.rate();
-    unsigned bytes = bits / 8;
-    unsigned size = frames * channels * bytes;
-    
-    // header for wave file
-    char header[44];
-    strncpy(header + 0, "RIFF", 4);
-    *reinterpret_cast<unsigned*>(header + 4) = 36 + size;
-    strncpy(header + 8, "WAVE", 4);
-    strncpy(header + 12, "fmt ", 4);
-    *reinterpret_cast<unsigned*>(header + 16) = 16;
-    *reinterpret_cast<unsigned short*>(header + 20) = 1;
-    *reinterpret_cast<unsigned short*>(header + 22) = channels;
-    *reinterpret_cast<unsigned*>(header + 24) = rate;
-    *reinterpret_cast<unsigned*>(header + 28) = rate * channels * bytes;
-    *reinterpret_cast<unsigned short*>(header + 32) = channels * bytes;
-    *reinterpret_cast<unsigned short*>(header + 34) = bits;
-    strncpy(header + 36, "data", 4);
-    *reinterpret_cast<unsigned*>(header + 40) = size;
-    
-    // output file stream
-    fstream out(fname, ios_base::binary | ios_base::out);
-    
-    // file failed to open
-    if (!out.is_open())
-        return false;
-    
-    // writes wave header to file
-    out.write(reinterpret_cast<char*>(&header), sizeof(header));
-    
-    char *data = new char[size]; // data to be written to file
-    unsigned framecount = frames * channels; // frame count
-    
     // if 16 bit
     if (bits == 16)
     {
         // writes data as short
-        short *data16 = reinterpret_cast<short*>(data);
-        for (unsigned i = 0; i < framecount; i++)
-            data16[i] = static_cast<short>(max16 * ad.data()[i]);
+        GetKernels().FloatToShort(in, static_cast<short*>(pcm), n);
     }
     
     // if 8 bit
     else if (bits == 8)
     {
         // writes data as unsigned char
-        unsigned char *data8 = reinterpret_cast<unsigned char*>(data);
-        for (unsigned i = 0; i < framecount; i++)
-            data8[i] = static_cast<unsigned char>(max8 * ad.data()[i] + 128);
+        unsigned char *data8 = static_cast<unsigned char*>(pcm);
+        for (size_t i = 0; i < n; i++)
+            data8[i] = static_cast<unsigned char>(max8 * in[i] + 128);
     }
-    
-    // writes data to file, destroys data
-    out.write(reinterpret_cast<char*>(data), size);
-    delete[] data;
-    
-    return true; // wave write successful
 }
-
-
-
-
-
-
-
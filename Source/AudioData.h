@@ -4,36 +4,55 @@
 #ifndef AUDIODATA_H
 #define AUDIODATA_H
 #include <vector>
+#include <cstddef> // size_t
+#include <functional> // std::function
+#include <iosfwd>  // std::istream, std::ostream
 
 class AudioData {
 public:
-    AudioData(unsigned nframes, unsigned R=44100, unsigned nchannels=1);
-    float sample(unsigned frame, unsigned channel=0) const;
-    float& sample(unsigned frame, unsigned channel=0);
+    AudioData(size_t nframes, unsigned R=44100, unsigned nchannels=1);
+    float sample(size_t frame, unsigned channel=0) const;
+    float& sample(size_t frame, unsigned channel=0);
     
     float* data(void)             { return &fdata[0]; }
     const float* data(void) const { return &fdata[0]; }
-    unsigned frames(void) const   { return frame_count; }
+    size_t frames(void) const     { return frame_count; }
     unsigned rate(void) const     { return sampling_rate; }
     unsigned channels(void) const { return channel_count; }
     
-    AudioData(const char *fname);
+    AudioData(const char *fname, std::function<bool(double)> progress = nullptr);
     
-    // assignment
-    AudioData& operator=(AudioData & d);
+    // copies and moves are member-wise
     
     size_t size() const { return fdata.size(); }
     
 private:
     std::vector<float> fdata;
-    unsigned frame_count,
-    sampling_rate,
+    size_t frame_count;
+    unsigned sampling_rate,
     channel_count;
 };
 
 void normalize(AudioData &ad, float dB=0);
 bool waveWrite(const char *fname, const AudioData &ad, unsigned bits=16);
 
+// wave file format (RIFF, or RF64/BW64 for data over 4 GB)
+struct WaveFormat
+{
+    unsigned channels;
+    unsigned rate;
+    unsigned bits;             // 8 or 16
+    unsigned long long frames;
+};
+
+// reads header up to the start of the sample data, throws on invalid files
+WaveFormat waveReadHeader(std::istream &in);
+// writes header for format, RF64 if the data needs 64 bit sizes (or rf64 is set)
+void waveWriteHeader(std::ostream &out, const WaveFormat &format, bool rf64=false);
+// converts n pcm samples of bits resolution to and from float
+void pcmToFloat(const void *pcm, float *out, size_t n, unsigned bits);
+void floatToPcm(const float *in, void *pcm, size_t n, unsigned bits);
+
 
 #endif
 
@@ -0,0 +1,380 @@
+// Automation.cpp
+// Spring 2021
+
+#include "Automation.h"
+#include "Bench.h"   // noise
+#include <algorithm> // std::upper_bound, std::min
+#include <chrono>    // timing for check
+#include <cmath>     // std::llround, std::round
+#include <fstream>
+#include <sstream>   // line parsing, check report
+#include <stdexcept>
+
+const unsigned AutomatedReverb::StepFrames;
+const unsigned AutomatedReverb::RampSteps;
+const unsigned AutomatedReverb::FadeFrames;
+
+//==============================================================================
+// Automation lanes
+
+void Automation::Add(const Breakpoint &point)
+{
+    auto at = std::upper_bound(points.begin(), points.end(), point,
+                               [](const Breakpoint &a, const Breakpoint &b) { return a.time < b.time; });
+    points.insert(at, point);
+}
+
+Hash64 Automation::GetHash(Hash64 seed) const
+{
+    Hash64 h = HashValue(points.size(), seed);
+    for (const Breakpoint &p : points) {
+        h = HashValue(p.time, h);
+        h = HashValue(static_cast<int>(p.parameter), h);
+        h = HashValue(p.comb, h);
+        h = HashValue(p.value, h);
+    }
+    return h;
+}
+
+Automation Automation::Load(const std::string &fname)
+{
+    std::ifstream file(fname);
+    if (!file)
+        throw std::runtime_error("unable to read automation " + fname);
+
+    Automation automation;
+    std::string line;
+    for (unsigned number = 1; std::getline(file, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string id;
+        Breakpoint p;
+        if (!(fields >> p.time))
+            continue; // blank or comment
+
+        if (!(fields >> id >> p.value) || p.time < 0.0 || !ParseId(id, p.parameter, p.comb))
+            throw std::runtime_error(fname + ":" + std::to_string(number) + ": expected seconds, parameter id, value");
+        automation.Add(p);
+    }
+    return automation;
+}
+
+bool Automation::Save(const std::string &fname) const
+{
+    std::ofstream file(fname);
+    file.precision(17);
+    file << "# seconds parameter value\n";
+    for (const Breakpoint &p : points)
+        file << p.time << ' ' << Id(p.parameter, p.comb) << ' ' << p.value << '\n';
+    return static_cast<bool>(file);
+}
+
+// comb ids are combN_name with N from 1, as in the plugin
+bool Automation::ParseId(const std::string &id, Parameter &parameter, unsigned &comb)
+{
+    comb = 0;
+    if (id == "dry")     { parameter = Dry; return true; }
+    if (id == "apCoeff") { parameter = AllPassCoeff; return true; }
+    if (id == "apDelay") { parameter = AllPassDelay; return true; }
+    if (id == "early")   { parameter = Early; return true; }
+
+    size_t split = id.find('_');
+    if (id.compare(0, 4, "comb") != 0 || split == std::string::npos || split == 4)
+        return false;
+    for (size_t i = 4; i < split; ++i)
+        if (id[i] < '0' || id[i] > '9')
+            return false;
+    unsigned n = static_cast<unsigned>(std::stoul(id.substr(4, split - 4)));
+    if (n == 0)
+        return false;
+    comb = n - 1;
+
+    std::string name = id.substr(split + 1);
+    if (name == "delay")   parameter = CombDelay;
+    else if (name == "g")  parameter = CombG;
+    else if (name == "R")  parameter = CombR;
+    else if (name == "zf") parameter = CombZF;
+    else return false;
+    return true;
+}
+
+std::string Automation::Id(Parameter parameter, unsigned comb)
+{
+    std::string prefix = "comb" + std::to_string(comb + 1) + "_";
+    switch (parameter) {
+        case Dry:          return "dry";
+        case AllPassCoeff: return "apCoeff";
+        case AllPassDelay: return "apDelay";
+        case CombDelay:    return prefix + "delay";
+        case CombG:        return prefix + "g";
+        case CombR:        return prefix + "R";
+        case CombZF:       return prefix + "zf";
+        case Early:        return "early";
+    }
+    return "";
+}
+
+//==============================================================================
+// Automated reverb
+
+// delays and early reflections change the filter's structure, the rest ramp
+static bool Structural(Automation::Parameter parameter)
+{
+    return parameter == Automation::AllPassDelay || parameter == Automation::CombDelay ||
+           parameter == Automation::Early;
+}
+
+AutomatedReverb::AutomatedReverb(const Reverb &reverb, const Automation &automation) :
+initial(reverb), current(reverb), fading(reverb), fadeOn(false), fadeStart(0), events(), next(0), changes(),
+nextChange(0), ramps(), frame(0)
+{
+    for (const Automation::Breakpoint &p : automation.GetBreakpoints()) {
+        if (p.comb >= initial.GetNumCombs())
+            continue;
+        Event e;
+        e.frame = static_cast<unsigned long long>(std::llround(p.time * initial.GetSamplingRate()));
+        e.parameter = p.parameter;
+        e.comb = p.comb;
+        e.value = p.value;
+        (Structural(p.parameter) ? changes : events).push_back(e);
+    }
+    Reset();
+}
+
+void AutomatedReverb::Reset()
+{
+    current = initial;
+    current.Reset();
+    fadeOn = false;
+    next = 0;
+    nextChange = 0;
+    ramps.clear();
+    frame = 0;
+}
+
+// delays needn't be whole ms, they are rounded to samples
+void AutomatedReverb::Apply(Reverb &reverb, Automation::Parameter parameter, unsigned comb, double value)
+{
+    if (comb >= reverb.GetNumCombs())
+        return;
+    switch (parameter) {
+        case Automation::Dry:          reverb.SetDry(value / 100.0); break;
+        case Automation::AllPassCoeff: reverb.SetAllPassCoeff(value); break;
+        case Automation::AllPassDelay: reverb.SetAllPassDelayMs(value); break;
+        case Automation::CombDelay:    reverb.SetCombDelayMs(value, comb); break;
+        case Automation::CombG:        reverb.SetCombLowPassCoeff(value, comb); break;
+        case Automation::CombR:        reverb.SetCombGainConstant(value, comb); break;
+        case Automation::CombZF:       reverb.SetCombZeroFreqGain(value, comb); break;
+        case Automation::Early:        reverb.SetEarlyReflections(value >= 0.5); break;
+    }
+}
+
+double AutomatedReverb::Value(Reverb &reverb, Automation::Parameter parameter, unsigned comb)
+{
+    switch (parameter) {
+        case Automation::Dry:          return reverb.GetDry() * 100.0;
+        case Automation::AllPassCoeff: return reverb.GetAllPass().GetCoefficient();
+        case Automation::CombG:        return reverb.GetCombLowPassCoeff(comb);
+        case Automation::CombR:        return reverb.GetCombGainConstant(comb);
+        case Automation::CombZF:       return reverb.GetCombZeroFreqGain(comb);
+        default:                       return 0.0;
+    }
+}
+
+// coefficients start a ramp from where they are, replacing one in progress;
+// structural changes start a crossfade from a copy of the filter
+void AutomatedReverb::Start(const Event &event)
+{
+    if (!Structural(event.parameter)) {
+        for (size_t i = 0; i < ramps.size(); ++i)
+            if (ramps[i].parameter == event.parameter && ramps[i].comb == event.comb) {
+                ramps.erase(ramps.begin() + i);
+                break;
+            }
+        Ramp r;
+        r.parameter = event.parameter;
+        r.comb = event.comb;
+        r.start = Value(current, event.parameter, event.comb);
+        r.target = event.value;
+        r.step = 0;
+        r.frame = frame;
+        ramps.push_back(r);
+        return;
+    }
+
+    fading = current;
+    Apply(current, event.parameter, event.comb, event.value);
+    current.SetState(fading.GetState()); // resets, so the new delays take effect
+    fadeOn = true;
+    fadeStart = frame;
+}
+
+// the run is split wherever an event, ramp step or fade end falls, so the
+// same frames get the same parameters whatever blocks the caller uses; ramps
+// start on their frame and step both filters of a crossfade, structural
+// changes landing during one wait for it to end
+void AutomatedReverb::Process(const float *in, float *out, unsigned n)
+{
+    float old[Reverb::BlockSize];
+
+    while (n > 0) {
+        if (fadeOn && frame >= fadeStart + FadeFrames)
+            fadeOn = false;
+        while (next < events.size() && events[next].frame <= frame)
+            Start(events[next++]);
+        while (!fadeOn && nextChange < changes.size() && changes[nextChange].frame <= frame)
+            Start(changes[nextChange++]);
+
+        for (size_t i = 0; i < ramps.size();) {
+            Ramp &r = ramps[i];
+            if (r.frame <= frame) {
+                ++r.step;
+                double v = r.start + (r.target - r.start) * r.step / RampSteps;
+                Apply(current, r.parameter, r.comb, v);
+                if (fadeOn)
+                    Apply(fading, r.parameter, r.comb, v);
+                r.frame += StepFrames;
+            }
+            if (r.step == RampSteps)
+                ramps.erase(ramps.begin() + i);
+            else
+                ++i;
+        }
+
+        // frames to the next boundary
+        unsigned long long end = frame + n;
+        if (next < events.size())
+            end = std::min(end, events[next].frame);
+        if (!fadeOn && nextChange < changes.size())
+            end = std::min(end, changes[nextChange].frame);
+        for (const Ramp &r : ramps)
+            end = std::min(end, r.frame);
+        if (fadeOn)
+            end = std::min(end, std::min(fadeStart + FadeFrames, frame + Reverb::BlockSize));
+        unsigned count = static_cast<unsigned>(end - frame);
+
+        if (fadeOn) {
+            fading.Process(in, old, count); // before out, which may be in
+            current.Process(in, out, count);
+            for (unsigned i = 0; i < count; ++i) {
+                double t = static_cast<double>(frame + i - fadeStart) / FadeFrames;
+                out[i] = static_cast<float>(old[i] * (1.0 - t) + out[i] * t);
+            }
+        }
+        else {
+            current.Process(in, out, count);
+        }
+
+        frame += count;
+        in += count;
+        out += count;
+        n -= count;
+    }
+}
+
+//==============================================================================
+// Check
+
+// runs the whole signal through process in blocks of random size up to max
+template <typename F>
+static void RunBlocks(F process, std::vector<float> &x, unsigned max, unsigned seed)
+{
+    Lcg lcg(seed);
+    for (size_t i = 0; i < x.size();) {
+        unsigned n = 1 + (lcg.Next() >> 8) % max;
+        n = static_cast<unsigned>(std::min<size_t>(n, x.size() - i));
+        process(&x[i], &x[i], n);
+        i += n;
+    }
+}
+
+std::string CheckAutomation(bool &passed)
+{
+    std::ostringstream report;
+    const unsigned rate = 48000;
+
+    Reverb reverb;
+    reverb.SetSamplingRate(rate);
+    reverb.SetEarlyReflections(true);
+    reverb.Reset();
+
+    // sweeps every kind of parameter, including changes during a crossfade
+    Automation automation;
+    automation.Add({ 0.5, Automation::CombG, 0, 0.1 });
+    automation.Add({ 0.5, Automation::Dry, 0, 40.0 });
+    automation.Add({ 0.75, Automation::CombDelay, 2, 43.3 });
+    automation.Add({ 0.76, Automation::CombZF, 3, 0.6 });
+    automation.Add({ 1.0, Automation::AllPassDelay, 0, 9.0 });
+    automation.Add({ 1.0, Automation::AllPassCoeff, 0, 0.5 });
+    automation.Add({ 1.25, Automation::Early, 0, 0.0 });
+    automation.Add({ 1.5, Automation::CombR, 5, 0.2 });
+    automation.Add({ 1.5001, Automation::CombR, 5, 0.5 });
+    const size_t firstEvent = rate / 2;
+
+    std::vector<float> signal = Noise(2 * rate);
+
+    // reference in internal sized blocks, then odd sizes from 1 sample up
+    AutomatedReverb automated(reverb, automation);
+    std::vector<float> ref = signal;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ref.size(); i += Reverb::BlockSize) {
+        unsigned n = static_cast<unsigned>(std::min<size_t>(Reverb::BlockSize, ref.size() - i));
+        automated.Process(&ref[i], &ref[i], n);
+    }
+    std::chrono::duration<double, std::nano> tAuto = std::chrono::steady_clock::now() - start;
+
+    bool same = true;
+    for (unsigned max : { 1u, 7u, 100u, 1000u, 5000u }) {
+        automated.Reset();
+        std::vector<float> y = signal;
+        RunBlocks([&](const float *in, float *out, unsigned n) { automated.Process(in, out, n); }, y, max, max);
+        size_t diff = 0;
+        for (size_t i = 0; i < y.size(); ++i)
+            diff += y[i] != ref[i];
+        report << "blocks up to " << max << ": " << diff << " samples differ\n";
+        same = same && diff == 0;
+    }
+
+    // untouched before the first event, and with no events at all
+    Reverb plain = reverb;
+    std::vector<float> p = signal;
+    start = std::chrono::steady_clock::now();
+    plain.Process(p.data(), p.data(), static_cast<unsigned>(p.size()));
+    std::chrono::duration<double, std::nano> tPlain = std::chrono::steady_clock::now() - start;
+
+    size_t before = 0;
+    for (size_t i = 0; i < firstEvent; ++i)
+        before += p[i] != ref[i];
+
+    AutomatedReverb empty(reverb, Automation());
+    std::vector<float> e = signal;
+    RunBlocks([&](const float *in, float *out, unsigned n) { empty.Process(in, out, n); }, e, 777, 3);
+    size_t unchanged = 0;
+    for (size_t i = 0; i < e.size(); ++i)
+        unchanged += e[i] != p[i];
+
+    // a ramp landing during the comb delay's crossfade starts on its own frame
+    Automation withoutRamp;
+    for (const Automation::Breakpoint &b : automation.GetBreakpoints())
+        if (!(b.parameter == Automation::CombZF && b.comb == 3))
+            withoutRamp.Add(b);
+    AutomatedReverb other(reverb, withoutRamp);
+    std::vector<float> w = signal;
+    RunBlocks([&](const float *in, float *out, unsigned n) { other.Process(in, out, n); }, w, 500, 5);
+    const size_t rampFrame = static_cast<size_t>(std::llround(0.76 * rate));
+    size_t firstDiff = 0;
+    while (firstDiff < w.size() && w[firstDiff] == ref[firstDiff])
+        ++firstDiff;
+    bool onTime = firstDiff >= rampFrame && firstDiff < rampFrame + AutomatedReverb::StepFrames;
+
+    report << "ramp during a crossfade: due at " << rampFrame << ", output changes at " << firstDiff
+           << (onTime ? " (ok)\n" : " (late)\n");
+    report << "before the first event: " << before << " samples differ from the plain reverb\n";
+    report << "no automation: " << unchanged << " samples differ from the plain reverb\n";
+    report << "ns/sample: automated " << tAuto.count() / signal.size()
+           << ", plain " << tPlain.count() / signal.size() << "\n";
+
+    passed = same && onTime && before == 0 && unchanged == 0;
+    report << (passed ? "passed\n" : "FAILED\n");
+    return report.str();
+}
@@ -0,0 +1,100 @@
+// Automation.h
+// Spring 2021
+
+#pragma once
+#include <string>   // std::string
+#include <vector>   // std::vector
+#include "Reverb.h" // moorer reverb filter
+#include "Hash.h"   // Hash64
+
+// automation lanes: time-stamped breakpoints for the reverb's parameters
+// text format, one breakpoint per line: seconds parameter value, '#' comments
+// parameters use the plugin ids: dry (%), apCoeff, apDelay (ms), combN_delay (ms),
+// combN_g, combN_R, combN_zf (N = 1..6), early (0/1)
+class Automation
+{
+public:
+    enum Parameter { Dry, AllPassCoeff, AllPassDelay, CombDelay, CombG, CombR, CombZF, Early };
+
+    struct Breakpoint
+    {
+        double time; // seconds
+        Parameter parameter;
+        unsigned comb; // comb parameters, from 0
+        double value;
+    };
+
+    void Add(const Breakpoint &point); // time order, equal times in the order added
+    const std::vector<Breakpoint> & GetBreakpoints() const { return points; }
+    Hash64 GetHash(Hash64 seed = HashSeed) const;
+
+    static Automation Load(const std::string &fname); // throws on unreadable lines or unknown ids
+    bool Save(const std::string &fname) const;
+
+    static bool ParseId(const std::string &id, Parameter &parameter, unsigned &comb);
+    static std::string Id(Parameter parameter, unsigned comb = 0);
+private:
+    std::vector<Breakpoint> points;
+};
+
+// reverb following automation lanes, sample accurate and independent of the
+// caller's block sizes: blocks are split exactly at events and ramp steps, and
+// run on the normal block path in between
+// coefficients (g, R, zf, a, dry) ramp to a new value in RampSteps steps of
+// StepFrames; delay and early reflection changes crossfade over FadeFrames from
+// the old filter to one with the new delays that starts from the old history
+class AutomatedReverb
+{
+public:
+    AutomatedReverb(const Reverb &reverb, const Automation &automation); // reverb at the render rate
+
+    void Reset(); // back to the start of the lanes
+
+    void Process(const float *in, float *out, unsigned n); // filter block (in may equal out)
+
+    unsigned long long GetFrame() const { return frame; }
+
+    // sets a parameter as a breakpoint does, without a ramp
+    static void Apply(Reverb &reverb, Automation::Parameter parameter, unsigned comb, double value);
+
+    static const unsigned StepFrames = 32;
+    static const unsigned RampSteps = 16;
+    static const unsigned FadeFrames = 1024;
+private:
+    struct Event
+    {
+        unsigned long long frame;
+        Automation::Parameter parameter;
+        unsigned comb;
+        double value;
+    };
+
+    struct Ramp
+    {
+        Automation::Parameter parameter;
+        unsigned comb;
+        double start, target;
+        unsigned step;            // steps applied
+        unsigned long long frame; // next step
+    };
+
+    void Start(const Event &event);
+    static double Value(Reverb &reverb, Automation::Parameter parameter, unsigned comb);
+
+    Reverb initial; // state at frame 0
+    Reverb current;
+    Reverb fading;  // old filter during a crossfade
+    bool fadeOn;
+    unsigned long long fadeStart;
+
+    std::vector<Event> events;  // coefficient ramps by frame, start on their frame
+    size_t next;                // next event
+    std::vector<Event> changes; // structural changes by frame, wait for a crossfade to end
+    size_t nextChange;          // next change
+    std::vector<Ramp> ramps;   // coefficient ramps in progress
+    unsigned long long frame;  // frames processed
+};
+
+// checks that automated renders don't depend on block sizes, match the plain
+// reverb before the first event, and times the block splitting
+std::string CheckAutomation(bool &passed);
@@ -0,0 +1,71 @@
+// Bench.h
+// Spring 2021
+
+#pragma once
+#include <chrono>  // std::chrono::steady_clock
+#include <cmath>   // std::sqrt, std::abs
+#include <cstddef> // size_t
+#include <vector>  // std::vector
+
+// reproducible noise, block timing and impulse response measures shared by
+// the benchmarks, checks and the parameter fit
+
+// linear congruential generator, the same sequence on every platform
+class Lcg
+{
+public:
+    explicit Lcg(unsigned seed = 1) : seed(seed) {}
+
+    unsigned Next() { return seed = seed * 1664525u + 1013904223u; }
+    double Uniform() { return (Next() >> 8) / double(1 << 24); }    // [0, 1)
+    float Noise() { return (Next() >> 8) / float(1 << 24) - 0.5f; } // [-0.5, 0.5)
+private:
+    unsigned seed;
+};
+
+// n samples of uniform noise in [-0.5, 0.5)
+inline std::vector<float> Noise(size_t n, unsigned seed = 1)
+{
+    std::vector<float> x(n);
+    Lcg lcg(seed);
+    for (float &v : x)
+        v = lcg.Noise();
+    return x;
+}
+
+// ns per frame of step(first, block) over frames, whole blocks only
+template <typename F>
+double TimeBlocks(F step, size_t frames, unsigned block)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i + block <= frames; i += block)
+        step(i, block);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / frames;
+}
+
+// ns per sample of process(in, out, n) from signal into out
+template <typename F>
+double TimeProcess(F process, const std::vector<float> &signal, std::vector<float> &out, unsigned block)
+{
+    return TimeBlocks([&](size_t i, unsigned n) { process(&signal[i], &out[i], n); }, signal.size(), block);
+}
+
+// normalized echo density of n samples: the share further than one deviation
+// from zero, relative to gaussian noise (1 once echoes are dense)
+inline double EchoDensity(const float *h, size_t n)
+{
+    const double gaussian = 0.3173; // erfc(1 / sqrt(2))
+    if (n == 0)
+        return 0.0;
+
+    double energy = 0.0;
+    for (size_t i = 0; i < n; ++i)
+        energy += static_cast<double>(h[i]) * h[i];
+    double sigma = std::sqrt(energy / n);
+
+    size_t outside = 0;
+    for (size_t i = 0; i < n; ++i)
+        outside += std::abs(h[i]) > sigma;
+    return static_cast<double>(outside) / n / gaussian;
+}
@@ -0,0 +1,176 @@
+// Capacity.cpp
+// Spring 2021
+
+#include "Capacity.h"
+#include "Bench.h"
+#include "Reverb.h"
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // one callback's work, instances split evenly over the callback thread and workers
+    class CallbackPool
+    {
+    public:
+        CallbackPool(unsigned instances, unsigned threads, double rate, unsigned block) :
+        revs(instances), outputs(instances, vector<float>(block)), input(block),
+        block(block), threads(threads ? threads : 1), generation(0), pending(0), stop(false), workers()
+        {
+            for (Reverb &r : revs) {
+                r.SetSamplingRate(static_cast<unsigned>(rate));
+                r.Reset();
+            }
+            
+            // low level noise, so the filters never run denormal
+            Lcg lcg;
+            for (float &x : input)
+                x = lcg.Noise() * 0.1f;
+            
+            for (unsigned t = 1; t < this->threads; ++t)
+                workers.push_back(thread(&CallbackPool::Work, this, t));
+        }
+        
+        ~CallbackPool()
+        {
+            stop = true;
+            for (thread &t : workers)
+                t.join();
+        }
+        
+        // one device callback, returns when every instance has run
+        void Callback()
+        {
+            pending.store(threads - 1, memory_order_relaxed);
+            generation.fetch_add(1, memory_order_release);
+            Process(0);
+            
+            // audio threads can't block, wait by spinning
+            while (pending.load(memory_order_acquire) != 0)
+                this_thread::yield();
+        }
+    private:
+        void Process(unsigned part)
+        {
+            for (size_t i = part; i < revs.size(); i += threads)
+                revs[i].Process(&input[0], &outputs[i][0], block);
+        }
+        
+        void Work(unsigned part)
+        {
+            unsigned seen = 0;
+            while (!stop) {
+                unsigned now = generation.load(memory_order_acquire);
+                if (now == seen) {
+                    this_thread::yield();
+                    continue;
+                }
+                seen = now;
+                Process(part);
+                pending.fetch_sub(1, memory_order_acq_rel);
+            }
+        }
+        
+        vector<Reverb> revs;
+        vector<vector<float>> outputs;
+        vector<float> input;
+        unsigned block;
+        unsigned threads;
+        
+        atomic<unsigned> generation; // callbacks started
+        atomic<unsigned> pending;    // workers still busy with this callback
+        atomic<bool> stop;
+        vector<thread> workers;
+    };
+}
+
+DspStats::Snapshot RunCapacity(unsigned instances, unsigned threads, double rate, unsigned block, double seconds)
+{
+    CallbackPool pool(instances, threads, rate, block);
+    DspStats stats;
+    
+    // warm up caches and the pool before measuring
+    for (int i = 0; i < 64; ++i)
+        pool.Callback();
+    stats.Prepare(rate, block);
+    
+    // callbacks arrive once a period, like a device clock
+    chrono::duration<double> period(block / rate);
+    unsigned long long callbacks = static_cast<unsigned long long>(seconds * rate / block);
+    auto due = chrono::steady_clock::now();
+    
+    for (unsigned long long i = 0; i < callbacks; ++i) {
+        {
+            DspStats::Scope timing(stats, block);
+            pool.Callback();
+        }
+        due += chrono::duration_cast<chrono::steady_clock::duration>(period);
+        this_thread::sleep_until(due);
+    }
+    
+    return stats.GetSnapshot();
+}
+
+unsigned FindCapacity(unsigned threads, double rate, unsigned block, double target, double seconds)
+{
+    auto holds = [&](unsigned n) {
+        DspStats::Snapshot s = RunCapacity(n, threads, rate, block, seconds);
+        return s.overruns == 0 && s.load <= target;
+    };
+    
+    if (!holds(1))
+        return 0;
+    
+    // double until it fails, then bisect
+    unsigned good = 1, bad = 2;
+    while (holds(bad)) {
+        good = bad;
+        bad *= 2;
+    }
+    
+    while (bad - good > 1) {
+        unsigned mid = good + (bad - good) / 2;
+        if (holds(mid))
+            good = mid;
+        else
+            bad = mid;
+    }
+    
+    return good;
+}
+
+std::string BenchmarkCapacity(double rate, unsigned block, double target)
+{
+    unsigned cores = thread::hardware_concurrency();
+    cores = cores ? cores : 1;
+    
+    ostringstream report;
+    report.setf(ios::fixed);
+    report.precision(1);
+    report << "rate " << rate << " Hz, block " << block << " (" << block * 1000.0 / rate
+           << " ms), target load " << target * 100.0 << "%, no missed deadlines\n";
+    report << "threads  max instances  load%  max load%\n";
+    
+    vector<unsigned> counts(1, 1);
+    if (cores > 1)
+        counts.push_back(cores);
+    
+    for (unsigned threads : counts) {
+        unsigned n = FindCapacity(threads, rate, block, target);
+        DspStats::Snapshot s = RunCapacity(n ? n : 1, threads, rate, block);
+        report.width(9);
+        report << left << threads;
+        report.width(15);
+        report << n;
+        report.width(7);
+        report << s.load * 100.0;
+        report << s.maxLoad * 100.0 << "\n";
+    }
+    
+    return report.str();
+}
@@ -0,0 +1,22 @@
+// Capacity.h
+// Spring 2021
+
+#pragma once
+#include <string>  // std::string
+#include "Stats.h" // DspStats
+
+// headless real-time capacity test: simulated device callbacks at a given
+// rate and block size drive a number of mono Reverb instances, each
+// callback timed against its deadline, no audio hardware needed
+
+// runs instances for seconds of paced callbacks, spread over threads
+// (1 = all on the callback thread, more = callback thread plus a spinning worker pool)
+DspStats::Snapshot RunCapacity(unsigned instances, unsigned threads, double rate, unsigned block,
+                               double seconds = 1.0);
+
+// largest instance count with no missed deadline and average load within target (0-1)
+unsigned FindCapacity(unsigned threads, double rate, unsigned block, double target = 0.7,
+                      double seconds = 1.0);
+
+// single threaded and pool capacity report
+std::string BenchmarkCapacity(double rate = 48000, unsigned block = 64, double target = 0.7);
@@ -2,25 +2,24 @@
 // Spring 2021
 
 #include "Comb.h"
+#include "Kernels.h"
+#include "DelayLine.h"
 
 const double zf_def = 0.83;
 
-Comb::Comb(unsigned delay, double g) : delX(), delY(), zfGain(zf_def), g(g), R(zf_def*(1 - g)), L(delay)
+Comb::Comb(unsigned delay, double g) : delX(), delY(), len(0), pos(0), zfGain(zf_def), g(g), R(zf_def*(1 - g)), L(delay)
 {
     Reset();
 }
 
 void Comb::Reset()
 {
-    delX.clear(); // clear x delays
-    delY.clear(); // clear y delays
+    // delay line needs at least one sample of delay
+    len = (L > 0 ? L : 1) + 1;
+    pos = 0;
     
-    for (unsigned i = 0; i < L; ++i) {
-        delX.push_back(0.0);
-        delY.push_back(0.0);
-    }
-    
-    delX.push_back(0.0);
+    delX.assign(2 * len, 0.0); // clear x delays
+    delY.assign(2 * len, 0.0); // clear y delays
 }
 
 void Comb::SetLowPassG(double new_g)
@@ -43,42 +42,102 @@ void Comb::SetZeroFreqGain(double gain)
     zfGain = gain;
 }
 
-double Comb::GetLowPassG()
+double Comb::GetLowPassG() const
 {
     return g;
 }
 
-double Comb::GetGainConstant()
+double Comb::GetGainConstant() const
 {
     return R;
 }
 
-unsigned Comb::GetDelay()
+unsigned Comb::GetDelay() const
 {
     return L;
 }
 
-double Comb::GetZeroFreqGain()
+double Comb::GetZeroFreqGain() const
 {
     return zfGain;
 }
 
+unsigned Comb::GetStateLength() const
+{
+    return len;
+}
+
+// the doubled lines hold the oldest first from pos
+void Comb::GetState(float *x, float *y)
+{
+    for (unsigned i = 0; i < len; ++i) {
+        x[i] = static_cast<float>(delX[pos + i]);
+        y[i] = static_cast<float>(delY[pos + i]);
+    }
+}
+
+void Comb::SetState(const float *x, const float *y, unsigned n)
+{
+    RestoreLine(delX, len, x, n);
+    RestoreLine(delY, len, y, n);
+    pos = 0;
+}
+
+// x may be another comb fed the same input
+void Comb::SetState(const Comb &x, const Comb &y)
+{
+    CopyLine(delX, len, x.delX, x.len, x.pos);
+    CopyLine(delY, len, y.delY, y.len, y.pos);
+    pos = 0;
+}
+
+// store current values, oldest delay is overwritten
+void Comb::Push(double x, double y)
+{
+    delX[pos] = delX[pos + len] = x;
+    delY[pos] = delY[pos + len] = y;
+    
+    if (++pos == len)
+        pos = 0;
+}
+
 // returns filtered signal value
 float Comb::operator()(float x)
 {
-    double xl1 = delX.front(); // x[t-(L+1)]
-    delX.pop_front();
-    
-    double xl = delX.front();  // x[t-L]
-    double yl = delY.front();  // y[t-L]
-    double y1 = delY.back();   // y[t-1]
-    delY.pop_front();
+    double xl1 = delX[pos];           // x[t-(L+1)]
+    double xl = delX[pos + 1];        // x[t-L]
+    double yl = delY[pos + 1];        // y[t-L]
+    double y1 = delY[pos + len - 1];  // y[t-1]
     
     // y[t] = x[t-L] + g * (y[t-1] - x[t-(L+1)]) + R * y[t-L]
     double y = xl + g * (y1 - xl1) + R * yl;
     
-    // store current values
-    delY.push_back(y);
-    delX.push_back(x);
+    Push(x, y);
     return y;
+}
+
+// filters a block of samples
+void Comb::Process(const double *x, double *y, unsigned n)
+{
+    const DspKernels &k = GetKernels();
+    const unsigned delay = len - 1;
+    
+    while (n > 0) {
+        // up to L outputs only depend on stored delays
+        unsigned count = n < delay ? n : delay;
+        
+        // x[t-L] - g * x[t-(L+1)] + R * y[t-L]
+        k.CombFeed(&delX[pos + 1], &delX[pos], &delY[pos + 1], g, R, y, count);
+        
+        // + g * y[t-1]
+        double y1 = delY[pos + len - 1];
+        for (unsigned i = 0; i < count; ++i) {
+            y1 = y[i] += g * y1;
+            Push(x[i], y1);
+        }
+        
+        x += count;
+        y += count;
+        n -= count;
     }
+}
@@ -2,7 +2,7 @@
 // Spring 2021
 
 #pragma once
-#include <deque> // std::deque
+#include <vector> // std::vector
 
 // low-pass comb filter
 class Comb
@@ -16,15 +16,28 @@ public:
     void SetLowPassG(double new_g);     // set lowpass parameter g
     void SetGainConstant(double new_R); // set comb gain constant
     void SetZeroFreqGain(double gain);  // set zero-frequency loop gain
-    unsigned GetDelay();
-    double GetLowPassG();
-    double GetGainConstant();
-    double GetZeroFreqGain();
+    unsigned GetDelay() const;
+    double GetLowPassG() const;
+    double GetGainConstant() const;
+    double GetZeroFreqGain() const;
+    
+    // state: delay lines oldest first, x[t-(L+1)] .. x[t-1] and the same for y
+    unsigned GetStateLength() const;                  // values per line
+    void GetState(float *x, float *y);                // GetStateLength() values each
+    void SetState(const float *x, const float *y, unsigned n); // newest n values, older cleared
+    void SetState(const Comb &x, const Comb &y); // newest input of x, output of y, no allocation
     
     float operator()(float x); // filter signal value x
+    void Process(const double *x, double *y, unsigned n); // filter block x into y (no overlap)
 private:
-    std::deque<double> delX; // x delays [t-(L+1), t-1]
-    std::deque<double> delY; // y delays [t-L, t-1]
+    void Push(double x, double y); // store current values
+    
+    // delay lines hold [t-(L+1), t-1] and are stored twice,
+    // so any run of up to L delays can be read without wrapping
+    std::vector<double> delX; // x delays
+    std::vector<double> delY; // y delays
+    unsigned len; // delay line length (L + 1 at last reset)
+    unsigned pos; // position of oldest delay t-(L+1)
     
     double zfGain; // zero-frequency loop gain
     double g;      // lowpass coefficient
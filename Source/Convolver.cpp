@@ -0,0 +1,247 @@
+// Convolver.cpp
+// Spring 2021
+
+#include "Convolver.h"
+#include "Bench.h" // noise, timing for benchmark
+#include <cmath>   // std::pow, std::abs
+#include <sstream> // schedule and benchmark report
+
+using namespace std;
+
+typedef complex<double> Complex;
+
+//==============================================================================
+// Impulse Response
+
+vector<float> CaptureImpulse(Reverb reverb, float floor, float maxSeconds)
+{
+    const unsigned block = Reverb::BlockSize;
+    const unsigned maxLength = static_cast<unsigned>(maxSeconds * reverb.GetSamplingRate());
+    const unsigned quiet = reverb.GetSamplingRate() / 10; // samples below floor before stopping
+    const float level = pow(10.0f, floor / 20.0f);
+    
+    vector<float> ir;
+    float in[block] = { 1.0f }; // impulse then silence
+    float out[block];
+    float peak = 0.0f;
+    unsigned below = 0;
+    
+    reverb.Reset();
+    while (ir.size() < maxLength && below < quiet) {
+        reverb.Process(in, out, block);
+        in[0] = 0.0f;
+        
+        for (float y : out) {
+            float value = std::abs(y);
+            peak = value > peak ? value : peak;
+            below = (value < level * peak) ? below + 1 : 0;
+            ir.push_back(y);
+        }
+    }
+    
+    // trim samples below the floor from the end
+    size_t end = ir.size();
+    while (end > 1 && std::abs(ir[end - 1]) < level * peak)
+        --end;
+    ir.resize(end);
+    
+    return ir;
+}
+
+//==============================================================================
+// Convolver
+
+Convolver::Stage::Stage(const vector<float> &ir, unsigned size, unsigned offset, unsigned count) :
+size(size), offset(offset), fft(2 * size), H(count), X(count), head(0), input(size, 0.0), fill(0)
+{
+    vector<double> part(2 * size);
+    for (unsigned p = 0; p < count; ++p) {
+        // partition p covers ir [offset + p * size, offset + (p + 1) * size)
+        for (unsigned i = 0; i < 2 * size; ++i) {
+            size_t index = offset + p * size + i;
+            part[i] = (i < size && index < ir.size()) ? ir[index] : 0.0;
+        }
+        
+        H[p].resize(size + 1);
+        fft.Forward(&part[0], &H[p][0]);
+        X[p].assign(size + 1, Complex());
+    }
+}
+
+Convolver::Convolver(const vector<float> &ir, unsigned block, unsigned maxBlock) :
+block(block), stages(), acc(), mask(0), time(0), temp(), spec(), fifoIn(block), fifoOut(block), fifoFill(0)
+{
+    unsigned length = ir.size() > 0 ? static_cast<unsigned>(ir.size()) : 1;
+    unsigned offset = 0;
+    unsigned size = block;
+    
+    while (offset < length) {
+        unsigned count;
+        
+        // a stage of twice the size can start once offset >= 2 * size - block
+        if (size < maxBlock) {
+            unsigned need = 2 * size - block;
+            count = (need > offset) ? (need - offset + size - 1) / size : 1;
+        }
+        else {
+            count = (length - offset + size - 1) / size;
+        }
+        
+        // don't run past the end of the ir
+        unsigned left = (length - offset + size - 1) / size;
+        count = count < left ? count : left;
+        
+        stages.push_back(Stage(ir, size, offset, count));
+        offset += count * size;
+        
+        if (size < maxBlock)
+            size *= 2;
+    }
+    
+    // accumulator spans the furthest a stage writes ahead of the current block
+    unsigned reach = 0;
+    for (const Stage &s : stages) {
+        unsigned r = block - s.size + s.offset + 2 * s.size;
+        reach = r > reach ? r : reach;
+    }
+    
+    unsigned n = 1;
+    while (n < reach + block)
+        n <<= 1;
+    
+    acc.assign(n, 0.0);
+    mask = n - 1;
+    temp.resize(2 * size);
+    spec.resize(size + 1);
+}
+
+void Convolver::Reset()
+{
+    for (Stage &s : stages) {
+        for (auto &x : s.X)
+            x.assign(x.size(), Complex());
+        s.input.assign(s.size, 0.0);
+        s.head = 0;
+        s.fill = 0;
+    }
+    
+    acc.assign(acc.size(), 0.0);
+    time = 0;
+    fifoIn.assign(block, 0.0f);
+    fifoOut.assign(block, 0.0f);
+    fifoFill = 0;
+}
+
+void Convolver::ProcessBlock(const float *in, float *out)
+{
+    for (Stage &s : stages) {
+        for (unsigned i = 0; i < block; ++i)
+            s.input[s.fill + i] = in[i];
+        s.fill += block;
+        
+        if (s.fill < s.size)
+            continue;
+        s.fill = 0;
+        
+        const unsigned bins = s.size + 1;
+        const unsigned count = static_cast<unsigned>(s.H.size());
+        
+        // newest input spectrum
+        s.head = (s.head + 1) % count;
+        for (unsigned i = 0; i < s.size; ++i) {
+            temp[i] = s.input[i];
+            temp[i + s.size] = 0.0;
+        }
+        s.fft.Forward(&temp[0], &s.X[s.head][0]);
+        
+        // Y = sum of X[now - p] * H[p]
+        double *y = reinterpret_cast<double*>(&spec[0]);
+        for (unsigned k = 0; k < 2 * bins; ++k)
+            y[k] = 0.0;
+        
+        for (unsigned p = 0; p < count; ++p) {
+            const double *x = reinterpret_cast<const double*>(&s.X[(s.head + count - p) % count][0]);
+            const double *h = reinterpret_cast<const double*>(&s.H[p][0]);
+            for (unsigned k = 0; k < 2 * bins; k += 2) {
+                y[k] += x[k] * h[k] - x[k + 1] * h[k + 1];
+                y[k + 1] += x[k] * h[k + 1] + x[k + 1] * h[k];
+            }
+        }
+        
+        s.fft.Inverse(&spec[0], &temp[0]);
+        
+        // the block just completed started size - block samples ago,
+        // its output lands offset samples later (overlap-add)
+        unsigned long long start = time + block - s.size + s.offset;
+        for (unsigned i = 0; i < 2 * s.size; ++i)
+            acc[(start + i) & mask] += temp[i];
+    }
+    
+    for (unsigned i = 0; i < block; ++i) {
+        double &a = acc[(time + i) & mask];
+        out[i] = static_cast<float>(a);
+        a = 0.0;
+    }
+    
+    time += block;
+}
+
+void Convolver::Process(const float *in, float *out, unsigned n)
+{
+    for (unsigned i = 0; i < n; ++i) {
+        fifoIn[fifoFill] = in[i];
+        out[i] = fifoOut[fifoFill];
+        
+        if (++fifoFill == block) {
+            ProcessBlock(&fifoIn[0], &fifoOut[0]);
+            fifoFill = 0;
+        }
+    }
+}
+
+std::string Convolver::GetSchedule() const
+{
+    ostringstream schedule;
+    for (size_t i = 0; i < stages.size(); ++i)
+        schedule << (i ? " " : "") << stages[i].size << "x" << stages[i].H.size();
+    return schedule.str();
+}
+
+//==============================================================================
+// Benchmark
+
+std::string BenchmarkConvolution()
+{
+    Reverb reverb;
+    vector<float> ir = CaptureImpulse(reverb);
+    
+    // 10 s of noise
+    vector<float> signal = Noise(10 * reverb.GetSamplingRate()), out(signal.size());
+    
+    ostringstream report;
+    report << "ir length: " << ir.size() << " samples ("
+           << double(ir.size()) / reverb.GetSamplingRate() << " s)\n";
+    report << "mode                     ns/sample  schedule\n";
+    
+    Reverb rev = reverb;
+    double recursive = TimeProcess([&](const float *in, float *o, unsigned n) { rev.Process(in, o, n); }, signal, out, 256);
+    report << "recursive                " << recursive << "\n";
+    
+    const unsigned uniform[] = { 256, 1024, 4096 };
+    for (unsigned block : uniform) {
+        Convolver conv(ir, block);
+        double t = TimeProcess([&](const float *in, float *o, unsigned) { conv.ProcessBlock(in, o); }, signal, out, block);
+        report << "uniform " << block << (block < 1000 ? "              " : "             ")
+               << t << "  " << conv.GetSchedule() << "\n";
+    }
+    
+    const unsigned lowLatency[] = { 64, 128 };
+    for (unsigned block : lowLatency) {
+        Convolver conv(ir, block, 8192);
+        double t = TimeProcess([&](const float *in, float *o, unsigned) { conv.ProcessBlock(in, o); }, signal, out, block);
+        report << "non-uniform " << block << "-8192" << (block < 100 ? "      " : "     ")
+               << t << "  " << conv.GetSchedule() << "\n";
+    }
+    
+    return report.str();
+}
@@ -0,0 +1,62 @@
+// Convolver.h
+// Spring 2021
+
+#pragma once
+#include <complex> // std::complex
+#include <string>  // std::string
+#include <vector>  // std::vector
+#include "FFT.h"    // real fft
+#include "Reverb.h" // moorer reverb filter
+
+// renders the reverb's impulse response, truncated where it decays below
+// floor (dB relative to its peak) or at maxSeconds
+std::vector<float> CaptureImpulse(Reverb reverb, float floor = -90.0f, float maxSeconds = 30.0f);
+
+// partitioned fft convolution
+// uniform: every partition is one block long
+// non-uniform: partitions double in size up to maxBlock once the ir offset
+// allows it, keeping the latency of the first block at a fraction of the cost
+class Convolver
+{
+public:
+    Convolver(const std::vector<float> &ir, unsigned block, unsigned maxBlock = 0); // maxBlock <= block -> uniform
+    
+    void Reset(); // clear input history
+    
+    void ProcessBlock(const float *in, float *out); // exactly one block, no added latency
+    void Process(const float *in, float *out, unsigned n); // any size, latency of one block
+    
+    unsigned GetBlockSize() const { return block; }
+    unsigned GetLatency() const   { return block; } // for Process()
+    std::string GetSchedule() const; // partition sizes, e.g. "64x1 128x1 256x2"
+private:
+    // uniform partitioned convolution of one ir segment
+    struct Stage
+    {
+        unsigned size;   // block size
+        unsigned offset; // ir offset of first partition
+        FFT fft;         // size * 2
+        std::vector<std::vector<std::complex<double>>> H; // partition spectra
+        std::vector<std::vector<std::complex<double>>> X; // input spectra (ring)
+        unsigned head;   // newest input spectrum
+        std::vector<double> input; // input collected for the next block
+        unsigned fill;
+        
+        Stage(const std::vector<float> &ir, unsigned size, unsigned offset, unsigned count);
+    };
+    
+    unsigned block;  // base block size
+    std::vector<Stage> stages;
+    
+    std::vector<double> acc; // output accumulator (ring, indexed by time)
+    unsigned mask;
+    unsigned long long time; // samples processed
+    
+    std::vector<double> temp; // stage time domain scratch
+    std::vector<std::complex<double>> spec; // stage spectrum scratch
+    std::vector<float> fifoIn, fifoOut; // Process() buffering
+    unsigned fifoFill;
+};
+
+// times recursive and convolution renders of the default reverb
+std::string BenchmarkConvolution();
@@ -0,0 +1,343 @@
+// Daemon.cpp
+// Spring 2021
+
+#include "Daemon.h"
+#include "FileRender.h" // constant memory file render
+#include "Preset.h"     // job presets
+#include "WaveStream.h" // output length
+#include <cstdio>       // std::remove, std::rename
+#include <fstream>
+#include <iterator>     // std::next
+#include <set>          // names listed by a scan
+#include <sstream>      // status text
+#include <stdexcept>
+#include <thread>       // workers
+#include <vector>
+#include <sys/stat.h>   // stat
+
+#if defined(_WIN32)
+#include <windows.h>    // FindFirstFileA, MoveFileExA
+#else
+#include <dirent.h>     // opendir
+#endif
+
+#if defined(__linux__)
+#include <poll.h>        // poll
+#include <sys/inotify.h> // inotify
+#include <unistd.h>      // read, close
+#endif
+
+const size_t RenderDaemon::RecentJobs;
+
+namespace
+{
+    bool IsWave(const std::string &name)
+    {
+        if (name.size() < 5 || name[0] == '.')
+            return false;
+        std::string ext = name.substr(name.size() - 4);
+        for (char &c : ext)
+            c = static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+        return ext == ".wav";
+    }
+
+    // size and modification time, false if the file is gone
+    bool FileInfo(const std::string &path, long long &size, long long &modified)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return false;
+        size = static_cast<long long>(info.st_size);
+        modified = static_cast<long long>(info.st_mtime);
+        return true;
+    }
+
+    // replaces to with from in one step, so to is never missing
+    bool MoveOver(const std::string &from, const std::string &to)
+    {
+#if defined(_WIN32)
+        return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+    }
+
+    std::vector<std::string> ListWaves(const std::string &dir)
+    {
+        std::vector<std::string> names;
+#if defined(_WIN32)
+        WIN32_FIND_DATAA found;
+        HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &found);
+        if (h == INVALID_HANDLE_VALUE)
+            return names;
+        do {
+            if (IsWave(found.cFileName))
+                names.push_back(found.cFileName);
+        } while (FindNextFileA(h, &found));
+        FindClose(h);
+#else
+        if (DIR *d = opendir(dir.c_str())) {
+            while (dirent *entry = readdir(d))
+                if (IsWave(entry->d_name))
+                    names.push_back(entry->d_name);
+            closedir(d);
+        }
+#endif
+        return names;
+    }
+
+    std::string Stem(const std::string &name)
+    {
+        return name.substr(0, name.size() - 4);
+    }
+}
+
+RenderDaemon::RenderDaemon(const Options &options) :
+options(options), lock(), changed(), queue(), queued(), growing(), running(0), done(0), failed(0), deepest(0),
+recent(), closing(false), statusLock()
+{
+    if (this->options.status.empty())
+        this->options.status = this->options.output + "/status.txt";
+    if (this->options.workers == 0)
+        this->options.workers = std::thread::hardware_concurrency();
+    if (this->options.workers == 0)
+        this->options.workers = 1;
+    if (this->options.capacity == 0)
+        this->options.capacity = 1;
+
+    // outputs keep their input's name
+    if (this->options.input == this->options.output)
+        throw std::runtime_error("input and output directories must differ");
+    long long size, modified;
+    if (!FileInfo(this->options.input, size, modified))
+        throw std::runtime_error("unable to read " + this->options.input);
+    if (!FileInfo(this->options.output, size, modified))
+        throw std::runtime_error("unable to read " + this->options.output);
+}
+
+// a file is queued again only when it has been modified since; its entry in
+// queued goes once the job succeeds, a failed file waits for a change
+bool RenderDaemon::Offer(const std::string &name, const std::atomic<bool> &stop)
+{
+    long long size, modified, outSize, outModified;
+    if (!FileInfo(options.input + "/" + name, size, modified))
+        return false;
+    if (FileInfo(options.output + "/" + name, outSize, outModified) && outModified >= modified)
+        return false; // rendered since its last change
+
+    std::unique_lock<std::mutex> hold(lock);
+    auto seen = queued.find(name);
+    if (seen != queued.end() && seen->second >= modified)
+        return false;
+
+    // back-pressure: wait for a worker to take a job, new events queue up in the kernel meanwhile
+    while (queue.size() >= options.capacity && !stop)
+        changed.wait_for(hold, std::chrono::milliseconds(100));
+    if (stop)
+        return false;
+
+    queued[name] = modified;
+    growing.erase(name);
+    queue.push_back({ name, modified, std::chrono::steady_clock::now() });
+    deepest = queue.size() > deepest ? queue.size() : deepest;
+    changed.notify_all();
+    return true;
+}
+
+// skips outputs at least as new as their input, so a restart doesn't render again;
+// names no longer in the directory are forgotten
+void RenderDaemon::Scan(const std::atomic<bool> &stop, bool settled)
+{
+    const std::vector<std::string> names = ListWaves(options.input);
+    {
+        const std::set<std::string> listed(names.begin(), names.end());
+        std::lock_guard<std::mutex> hold(lock);
+        for (std::map<std::string, long long> *seen : { &queued, &growing })
+            for (auto it = seen->begin(); it != seen->end();)
+                it = listed.count(it->first) ? std::next(it) : seen->erase(it);
+    }
+
+    for (const std::string &name : names) {
+        if (stop)
+            return;
+        long long size = 0, modified = 0, outSize = 0, outModified = 0;
+        if (!FileInfo(options.input + "/" + name, size, modified)) {
+            Forget(name);
+            continue;
+        }
+        if (FileInfo(options.output + "/" + name, outSize, outModified) && outModified >= modified)
+            continue;
+
+        // polling can't tell when a writer is done, wait for the size to settle
+        if (settled) {
+            std::lock_guard<std::mutex> hold(lock);
+            auto last = growing.find(name);
+            bool same = last != growing.end() && last->second == size;
+            growing[name] = size;
+            if (!same)
+                continue;
+        }
+
+        if (Offer(name, stop))
+            WriteStatus();
+    }
+}
+
+void RenderDaemon::Forget(const std::string &name)
+{
+    std::lock_guard<std::mutex> hold(lock);
+    queued.erase(name);
+    growing.erase(name);
+}
+
+void RenderDaemon::Watch(const std::atomic<bool> &stop)
+{
+#if defined(__linux__)
+    int fd = inotify_init1(IN_NONBLOCK);
+    if (fd >= 0 && inotify_add_watch(fd, options.input.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) >= 0) {
+        Scan(stop, false); // files already there are complete
+
+        alignas(inotify_event) char buffer[16384];
+        pollfd p = { fd, POLLIN, 0 };
+        while (!stop) {
+            if (poll(&p, 1, 200) <= 0)
+                continue;
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            for (ssize_t i = 0; i < n;) {
+                const inotify_event *e = reinterpret_cast<const inotify_event*>(buffer + i);
+                if (e->mask & IN_Q_OVERFLOW)
+                    Scan(stop, false); // events were lost while we waited
+                else if (e->len > 0 && (e->mask & (IN_DELETE | IN_MOVED_FROM)))
+                    Forget(e->name);
+                else if (e->len > 0 && IsWave(e->name) && Offer(e->name, stop))
+                    WriteStatus();
+                i += sizeof(inotify_event) + e->len;
+            }
+        }
+        close(fd);
+        return;
+    }
+    if (fd >= 0)
+        close(fd);
+#endif
+
+    while (!stop) {
+        Scan(stop, true);
+        for (int i = 0; i < 10 && !stop; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+void RenderDaemon::Work()
+{
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> hold(lock);
+            changed.wait(hold, [this] { return closing || !queue.empty(); });
+            if (closing)
+                return;
+            job = queue.front();
+            queue.pop_front();
+            ++running;
+            changed.notify_all(); // a place for the watcher
+        }
+        WriteStatus();
+        Render(job);
+        WriteStatus();
+    }
+}
+
+void RenderDaemon::Render(const Job &job)
+{
+    Record record = { job.name, 0.0, 0.0, 0.0, "" };
+    auto start = std::chrono::steady_clock::now();
+    record.wait = std::chrono::duration<double>(start - job.queued).count();
+
+    const std::string in = options.input + "/" + job.name;
+    const std::string out = options.output + "/" + job.name;
+    const std::string temp = options.output + "/." + job.name + ".part";
+    try {
+        Reverb reverb;
+        std::ifstream sidecar(options.input + "/" + Stem(job.name) + ".txt");
+        std::ifstream fallback(options.input + "/default.txt");
+        if (sidecar)
+            LoadPreset(options.input + "/" + Stem(job.name) + ".txt", reverb);
+        else if (fallback)
+            LoadPreset(options.input + "/default.txt", reverb);
+
+        RenderFile(in, temp, reverb, options.tail, options.dB);
+        if (!MoveOver(temp, out))
+            throw std::runtime_error("unable to rename output");
+
+        WaveReader written(out.c_str());
+        if (written.GetFormat().rate)
+            record.audio = static_cast<double>(written.GetFormat().frames) / written.GetFormat().rate;
+    }
+    catch (std::exception &e) {
+        std::remove(temp.c_str());
+        record.error = e.what();
+    }
+    record.render = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> hold(lock);
+    --running;
+    ++(record.error.empty() ? done : failed);
+    auto seen = queued.find(job.name);
+    if (record.error.empty() && seen != queued.end() && seen->second == job.modified)
+        queued.erase(seen); // the output now stands for it
+    recent.push_back(record);
+    if (recent.size() > RecentJobs)
+        recent.pop_front();
+}
+
+std::string RenderDaemon::Status() const
+{
+    std::lock_guard<std::mutex> hold(lock);
+    std::ostringstream status;
+    status << "queued " << queue.size() << " of " << options.capacity << " (deepest " << deepest << ")\n";
+    status << "running " << running << " on " << options.workers << " workers\n";
+    status << "done " << done << "\nfailed " << failed << "\n";
+    status << "\n[recent jobs] name, wait (s), render (s), x real time, error\n";
+    for (auto r = recent.rbegin(); r != recent.rend(); ++r)
+        status << r->name << "  " << r->wait << "  " << r->render << "  "
+               << (r->render > 0.0 ? r->audio / r->render : 0.0) << "  " << r->error << "\n";
+    return status.str();
+}
+
+// temp file and rename, so readers never see a partial status
+void RenderDaemon::WriteStatus()
+{
+    std::string text = Status();
+    std::lock_guard<std::mutex> hold(statusLock);
+    std::string temp = options.status + ".tmp";
+    {
+        std::ofstream file(temp);
+        file << text;
+        if (!file)
+            return;
+    }
+    MoveOver(temp, options.status);
+}
+
+void RenderDaemon::Run(const std::atomic<bool> &stop)
+{
+    closing = false;
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < options.workers; ++i)
+        workers.push_back(std::thread(&RenderDaemon::Work, this));
+    WriteStatus();
+
+    Watch(stop);
+
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        closing = true;
+        queue.clear();
+        queued.clear();
+        changed.notify_all();
+    }
+    for (std::thread &t : workers)
+        t.join();
+    WriteStatus();
+}
@@ -0,0 +1,81 @@
+// Daemon.h
+// Spring 2021
+
+#pragma once
+#include <atomic>             // std::atomic
+#include <chrono>             // job timing
+#include <condition_variable> // std::condition_variable
+#include <deque>              // std::deque
+#include <map>                // std::map
+#include <mutex>              // std::mutex
+#include <string>             // std::string
+
+// watch-folder render daemon: wave files that appear in the input directory
+// are queued and rendered into the output directory by a bounded pool of
+// workers. Linux is told of new files by inotify, other systems rescan the
+// directory every second and take files once their size stops changing.
+//
+// a job's preset is <name>.txt next to the file, else default.txt there, else
+// the default reverb; presets have to be in place before the wave file.
+// outputs are written under a temporary name and renamed when complete.
+// when the queue is full the watcher stops taking files until a worker
+// frees a place, and files already in the output are skipped
+class RenderDaemon
+{
+public:
+    struct Options
+    {
+        std::string input, output;
+        std::string status; // status file, "" = <output>/status.txt
+        unsigned workers;   // 0 = one per core
+        size_t capacity;    // queued jobs before the watcher waits
+        unsigned tail;      // ms of reverb after each file
+        float dB;           // normalization target
+    };
+
+    explicit RenderDaemon(const Options &options); // throws if the directories can't be read
+
+    // watches and renders until stop is set, then waits for running jobs;
+    // queued jobs are dropped, they are found again on the next run
+    void Run(const std::atomic<bool> &stop);
+
+    // queue depth, counts and per job timings, as written to the status file
+    std::string Status() const;
+
+    static const size_t RecentJobs = 32; // finished jobs listed in the status
+private:
+    struct Job
+    {
+        std::string name;
+        long long modified; // input modification time when queued
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    struct Record
+    {
+        std::string name;
+        double wait, render, audio; // seconds queued, rendering, of output audio
+        std::string error;          // "" when done
+    };
+
+    bool Offer(const std::string &name, const std::atomic<bool> &stop); // waits while full
+    void Scan(const std::atomic<bool> &stop, bool settled); // queue new files, settled = skip growing ones
+    void Forget(const std::string &name); // input file gone
+    void Watch(const std::atomic<bool> &stop);
+    void Work();
+    void Render(const Job &job);
+    void WriteStatus();
+
+    Options options;
+
+    mutable std::mutex lock;
+    std::condition_variable changed; // queue or closing
+    std::deque<Job> queue;
+    std::map<std::string, long long> queued;    // queued, running or failed: name, modification time when queued
+    std::map<std::string, long long> growing;   // polling, not offered yet: name, size seen on the last scan
+    size_t running, done, failed, deepest;
+    std::deque<Record> recent;
+    bool closing;
+
+    std::mutex statusLock; // one status writer at a time
+};
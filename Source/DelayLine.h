@@ -0,0 +1,27 @@
+// DelayLine.h
+// Spring 2021
+
+#pragma once
+#include <vector> // std::vector
+
+// state helpers for delay lines of len values stored twice, oldest first from a
+// position, so any run of up to len values is read without wrapping; both restore
+// the newest values into a line that starts at 0 and clear the older ones
+
+// newest n of values into a doubled line of len
+inline void RestoreLine(std::vector<double> &line, unsigned len, const float *values, unsigned n)
+{
+    for (unsigned i = 0; i < len; ++i) {
+        double v = (i + n >= len) ? values[i + n - len] : 0.0;
+        line[i] = line[i + len] = v;
+    }
+}
+
+// the same from another doubled line of n, oldest first from pos
+inline void CopyLine(std::vector<double> &line, unsigned len, const std::vector<double> &from, unsigned n, unsigned pos)
+{
+    for (unsigned i = 0; i < len; ++i) {
+        double v = (i + n >= len) ? from[pos + i + n - len] : 0.0;
+        line[i] = line[i + len] = v;
+    }
+}
@@ -0,0 +1,201 @@
+// EarlyReflections.cpp
+// Spring 2021
+
+#include "EarlyReflections.h"
+#include "Bench.h"   // lcg, timing for benchmark
+#include "Comb.h"    // comb filter, benchmark reference
+#include "DelayLine.h" // doubled line state
+#include "Kernels.h" // vectorized block kernels
+#include <algorithm> // std::copy
+#include <cmath>     // std::abs, std::pow
+#include <sstream>   // benchmark report
+
+const unsigned EarlyReflections::BlockSize;
+
+EarlyReflections::EarlyReflections(unsigned rate, const std::vector<Tap> &taps) :
+rate(rate), taps(taps), delays(), starts(), gains(), ring(), len(0), pos(0)
+{
+    Prepare();
+}
+
+void EarlyReflections::Reset()
+{
+    ring.assign(2 * len, 0.0);
+    pos = 0;
+}
+
+void EarlyReflections::SetSamplingRate(unsigned new_rate)
+{
+    rate = new_rate;
+    Prepare();
+}
+
+void EarlyReflections::SetTaps(const std::vector<Tap> &new_taps)
+{
+    taps = new_taps;
+    Prepare();
+}
+
+double EarlyReflections::GetLength() const
+{
+    double ms = 0.0;
+    for (const Tap &tap : taps)
+        ms = tap.ms > ms ? tap.ms : ms;
+    return ms / 1000.0;
+}
+
+double EarlyReflections::GetGainSum() const
+{
+    double sum = 0.0;
+    for (const Tap &tap : taps)
+        sum += std::abs(tap.gain);
+    return sum;
+}
+
+Hash64 EarlyReflections::GetParameterHash(Hash64 seed) const
+{
+    Hash64 h = seed;
+    for (size_t k = 0; k < taps.size(); ++k) {
+        h = HashValue(delays[k], h);
+        h = HashValue(taps[k].gain, h);
+    }
+    return h;
+}
+
+unsigned EarlyReflections::GetStateLength() const
+{
+    return len;
+}
+
+// the next write is the oldest value
+void EarlyReflections::GetState(float *x) const
+{
+    for (unsigned i = 0; i < len; ++i)
+        x[i] = static_cast<float>(ring[pos + i]);
+}
+
+void EarlyReflections::SetState(const float *x, unsigned n)
+{
+    RestoreLine(ring, len, x, n);
+    pos = 0;
+}
+
+void EarlyReflections::SetState(const EarlyReflections &from)
+{
+    CopyLine(ring, len, from.ring, from.len, from.pos);
+    pos = 0;
+}
+
+// delays in samples at the current rate, ring long enough for the longest and a block
+void EarlyReflections::Prepare()
+{
+    delays.clear();
+    gains.clear();
+    unsigned longest = 0;
+
+    for (const Tap &tap : taps) {
+        unsigned delay = static_cast<unsigned>(tap.ms * rate / 1000.0 + 0.5);
+        delays.push_back(delay);
+        gains.push_back(tap.gain);
+        longest = delay > longest ? delay : longest;
+    }
+
+    starts.assign(taps.size(), 0);
+    len = longest + BlockSize;
+    Reset();
+}
+
+// writes the block into the ring, then reads each tap as one run behind it
+void EarlyReflections::Process(const double *x, double *y, unsigned n)
+{
+    const DspKernels &k = GetKernels();
+    const unsigned count = static_cast<unsigned>(taps.size());
+
+    while (n > 0) {
+        unsigned block = n < BlockSize ? n : BlockSize;
+
+        // both copies, up to the end of the line and then wrapped
+        const unsigned head = block < len - pos ? block : len - pos;
+        std::copy(x, x + head, &ring[pos]);
+        std::copy(x, x + head, &ring[pos + len]);
+        std::copy(x + head, x + block, &ring[0]);
+        std::copy(x + head, x + block, &ring[len]);
+
+        for (unsigned t = 0; t < count; ++t)
+            starts[t] = (pos + len - delays[t]) % len;
+
+        if (count)
+            k.TapSum(ring.data(), starts.data(), gains.data(), count, y, block);
+        else
+            for (unsigned i = 0; i < block; ++i)
+                y[i] = 0.0;
+
+        pos = (pos + block) % len;
+        x += block;
+        y += block;
+        n -= block;
+    }
+}
+
+// J. A. Moorer, "About this reverberation business", 1979
+std::vector<EarlyReflections::Tap> EarlyReflections::MoorerTaps()
+{
+    const double ms[18] = {  4.3, 21.5, 22.5, 26.8, 27.0, 29.8, 45.8, 48.5, 57.2,
+                            58.7, 59.5, 61.2, 70.7, 70.8, 72.6, 74.1, 75.3, 79.7 };
+    const double gain[18] = { 0.841, 0.504, 0.491, 0.379, 0.380, 0.346, 0.289, 0.272, 0.192,
+                              0.193, 0.217, 0.181, 0.180, 0.181, 0.176, 0.142, 0.167, 0.134 };
+
+    std::vector<Tap> taps;
+    for (unsigned i = 0; i < 18; ++i)
+        taps.push_back({ ms[i], gain[i] });
+    return taps;
+}
+
+// uniformly spread random delays, random signs, gains falling 60 dB over ms
+std::vector<EarlyReflections::Tap> EarlyReflections::RoomTaps(unsigned count, double ms, unsigned seed)
+{
+    std::vector<Tap> taps;
+    Lcg lcg(seed);
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned r = lcg.Next();
+        double delay = ms * (r >> 8) / double(1 << 24);
+        double gain = std::pow(10.0, -3.0 * delay / ms);
+        taps.push_back({ delay, (r & 1) ? -gain : gain });
+    }
+    return taps;
+}
+
+//==============================================================================
+// Benchmark
+
+std::string BenchmarkEarlyReflections()
+{
+    const unsigned rate = 44100;
+    const unsigned block = EarlyReflections::BlockSize;
+    const unsigned passes = 2000;
+
+    std::vector<double> x(block), y(block);
+    for (unsigned i = 0; i < block; ++i)
+        x[i] = (i % 97) / 97.0 - 0.5;
+
+    std::ostringstream report;
+    report << "stage                ns/sample\n";
+
+    Comb comb(rate * 50 / 1000, 0.4);
+    comb.SetGainConstant(0.4);
+    double t = TimeBlocks([&](size_t, unsigned n) { comb.Process(x.data(), y.data(), n); }, size_t(block) * passes, block);
+    report << "one comb             " << t << "\n";
+
+    for (unsigned count : { 18u, 32u, 64u, 128u }) {
+        EarlyReflections er(rate, count == 18 ? EarlyReflections::MoorerTaps() : EarlyReflections::RoomTaps(count, 80.0));
+        t = TimeBlocks([&](size_t, unsigned n) { er.Process(x.data(), y.data(), n); }, size_t(block) * passes, block);
+
+        std::ostringstream name;
+        name << count << " taps" << (count == 18 ? " (moorer)" : "");
+        report << name.str() << std::string(21 - name.str().size(), ' ')
+               << t << "\n";
+    }
+
+    report << "kernel: " << GetKernels().name << "\n";
+    return report.str();
+}
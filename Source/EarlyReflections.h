@@ -0,0 +1,59 @@
+// EarlyReflections.h
+// Spring 2021
+
+#pragma once
+#include <string> // std::string
+#include <vector> // std::vector
+#include "Hash.h" // parameter hash
+
+// early reflections: sparse multi-tap delay read from one shared ring buffer
+// every tap of a block is a contiguous run of the ring, so the taps are summed
+// with vector loads, a fixed cost per sample whatever the room
+class EarlyReflections
+{
+public:
+    struct Tap
+    {
+        double ms;   // delay (ms)
+        double gain;
+    };
+
+    EarlyReflections(unsigned rate = 44100, const std::vector<Tap> &taps = MoorerTaps());
+
+    void Reset();
+
+    void SetSamplingRate(unsigned rate);
+    void SetTaps(const std::vector<Tap> &taps);
+    const std::vector<Tap> & GetTaps() const { return taps; }
+    double GetLength() const;  // seconds to the last tap
+    double GetGainSum() const; // sum of |gain|, upper bound on gain
+    Hash64 GetParameterHash(Hash64 seed = HashSeed) const;
+
+    // state: input history oldest first
+    unsigned GetStateLength() const;          // values
+    void GetState(float *x) const;            // GetStateLength() values
+    void SetState(const float *x, unsigned n); // newest n values, older cleared
+    void SetState(const EarlyReflections &from); // newest values of from's history, no allocation
+
+    void Process(const double *x, double *y, unsigned n); // filter block x into y (no overlap)
+
+    static std::vector<Tap> MoorerTaps(); // Moorer's 18 tap table (1979)
+    static std::vector<Tap> RoomTaps(unsigned count, double ms, unsigned seed = 1); // random taps decaying 60 dB over ms
+    static const unsigned BlockSize = 256; // internal block size (samples)
+private:
+    void Prepare(); // tap delays in samples, ring size
+
+    unsigned rate;
+    std::vector<Tap> taps;
+    std::vector<unsigned> delays; // per tap (samples)
+    std::vector<unsigned> starts; // per tap ring index of this block's first read
+    std::vector<double> gains;
+
+    // input history stored twice, so any run of up to len samples is read without wrapping
+    std::vector<double> ring;
+    unsigned len;  // longest delay + BlockSize
+    unsigned pos;  // next write
+};
+
+// times tap tables of increasing size against one comb filter
+std::string BenchmarkEarlyReflections();
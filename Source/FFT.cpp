@@ -0,0 +1,93 @@
+// FFT.cpp
+// Spring 2021
+
+#include "FFT.h"
+#include <cmath> // std::cos, std::sin
+
+using namespace std;
+
+typedef complex<double> Complex;
+
+const double Pi = 3.14159265358979323846;
+
+FFT::FFT(unsigned size) : n(size), half(size / 2), twiddle(half / 2), post(half + 1), reversed(half), work(half + 1)
+{
+    for (unsigned k = 0; k < half / 2; ++k)
+        twiddle[k] = polar(1.0, -2.0 * Pi * k / half);
+    
+    for (unsigned k = 0; k <= half; ++k)
+        post[k] = polar(1.0, -2.0 * Pi * k / n);
+    
+    unsigned bits = 0;
+    while ((1u << bits) < half)
+        ++bits;
+    
+    for (unsigned i = 0; i < half; ++i) {
+        unsigned r = 0;
+        for (unsigned b = 0; b < bits; ++b)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        reversed[i] = r;
+    }
+}
+
+// iterative radix-2 decimation in time, unscaled
+void FFT::Transform(Complex *x, bool inverse)
+{
+    for (unsigned i = 0; i < half; ++i)
+        if (i < reversed[i])
+            swap(x[i], x[reversed[i]]);
+    
+    for (unsigned len = 2; len <= half; len <<= 1) {
+        unsigned step = half / len;
+        for (unsigned i = 0; i < half; i += len) {
+            for (unsigned k = 0; k < len / 2; ++k) {
+                Complex w = inverse ? conj(twiddle[k * step]) : twiddle[k * step];
+                Complex a = x[i + k];
+                Complex b = x[i + k + len / 2];
+                double br = b.real() * w.real() - b.imag() * w.imag();
+                double bi = b.real() * w.imag() + b.imag() * w.real();
+                x[i + k] = Complex(a.real() + br, a.imag() + bi);
+                x[i + k + len / 2] = Complex(a.real() - br, a.imag() - bi);
+            }
+        }
+    }
+}
+
+// packs even/odd samples into one half size complex transform
+void FFT::Forward(const double *in, Complex *out)
+{
+    for (unsigned k = 0; k < half; ++k)
+        work[k] = Complex(in[2 * k], in[2 * k + 1]);
+    
+    Transform(&work[0], false);
+    work[half] = work[0];
+    
+    // X[k] = E[k] + W^k O[k]
+    for (unsigned k = 0; k <= half; ++k) {
+        Complex z = work[k];
+        Complex zc = conj(work[half - k]);
+        Complex even = 0.5 * (z + zc);
+        Complex odd = Complex(0.0, -0.5) * (z - zc);
+        out[k] = even + post[k] * odd;
+    }
+}
+
+void FFT::Inverse(const Complex *in, double *out)
+{
+    // Z[k] = E[k] + i O[k]
+    for (unsigned k = 0; k < half; ++k) {
+        Complex x = in[k];
+        Complex xc = conj(in[half - k]);
+        Complex even = 0.5 * (x + xc);
+        Complex odd = 0.5 * (x - xc) * conj(post[k]);
+        work[k] = even + Complex(0.0, 1.0) * odd;
+    }
+    
+    Transform(&work[0], true);
+    
+    double scale = 1.0 / half;
+    for (unsigned k = 0; k < half; ++k) {
+        out[2 * k] = work[k].real() * scale;
+        out[2 * k + 1] = work[k].imag() * scale;
+    }
+}
@@ -0,0 +1,28 @@
+// FFT.h
+// Spring 2021
+
+#pragma once
+#include <complex> // std::complex
+#include <vector>  // std::vector
+
+// real fft of a power of two size
+// spectra hold bins [0, size/2]
+class FFT
+{
+public:
+    FFT(unsigned size); // size >= 4, power of two
+    
+    void Forward(const double *in, std::complex<double> *out); // size samples -> size/2+1 bins
+    void Inverse(const std::complex<double> *in, double *out); // size/2+1 bins -> size samples
+    
+    unsigned GetSize() const { return n; }
+private:
+    void Transform(std::complex<double> *x, bool inverse); // complex fft of size n/2
+    
+    unsigned n;    // real size
+    unsigned half; // complex size
+    std::vector<std::complex<double>> twiddle; // exp(-2 pi i k / half)
+    std::vector<std::complex<double>> post;    // exp(-2 pi i k / n)
+    std::vector<unsigned> reversed;            // bit reversed index
+    std::vector<std::complex<double>> work;
+};
@@ -0,0 +1,238 @@
+// FdnReverb.cpp
+// Spring 2021
+
+#include "FdnReverb.h"
+#include "Bench.h"   // noise, timing, echo density for benchmark
+#include "Kernels.h" // vectorized block kernels
+#include <algorithm> // std::min, std::max
+#include <cmath>     // std::pow, std::log10, std::sqrt
+#include <sstream>   // benchmark report
+
+const unsigned FdnReverb::BlockSize;
+
+// smallest prime >= n
+static unsigned NextPrime(unsigned n)
+{
+    for (n = std::max(n, 2u); ; ++n) {
+        bool prime = true;
+        for (unsigned d = 2; d * d <= n && prime; ++d)
+            prime = (n % d != 0);
+        if (prime)
+            return n;
+    }
+}
+
+FdnReverb::FdnReverb(const Reverb &reverb, unsigned lines, Mixing mixing) :
+lines(lines > 8 ? 16 : 8), mixing(mixing), delays(), b(), state(), frame(), g(0.0),
+dry(reverb.GetDry()), wet(reverb.GetWet()), shortest(0), ap(reverb.GetAllPass()), early(reverb.GetEarly()),
+earlyOn(reverb.GetEarlyReflections())
+{
+    const double fs = reverb.GetSamplingRate();
+    const unsigned combs = reverb.GetNumCombs();
+
+    // comb delay range, mean decay time and mean damping
+    double lo = 0.0, hi = 0.0, decay = 0.0;
+    for (unsigned i = 0; i < combs; ++i) {
+        const Comb &c = reverb.GetComb(i);
+        double L = c.GetDelay(), zf = c.GetZeroFreqGain();
+        lo = (lo == 0.0 || L < lo) ? L : lo;
+        hi = L > hi ? L : hi;
+        decay += (zf > 0.0 && zf < 1.0) ? L / fs * 3.0 / -std::log10(zf) : 0.0;
+        g += c.GetLowPassG();
+    }
+    decay /= combs;
+    g /= combs;
+    lo = std::max(lo, 2.0);
+    hi = std::max(hi, lo);
+
+    // geometric spread, each delay a prime past the last so no two lines share echoes,
+    // loop gain for a 60 dB decay in the mean comb decay time
+    unsigned last = 1;
+    for (unsigned i = 0; i < this->lines; ++i) {
+        double target = lo * std::pow(hi / lo, i / (this->lines - 1.0));
+        unsigned len = NextPrime(std::max(static_cast<unsigned>(target + 0.5), last + 1));
+        last = len;
+
+        Line line = { std::vector<double>(), len, 0 };
+        delays.push_back(line);
+
+        double loop = decay > 0.0 ? std::pow(10.0, -3.0 * len / (fs * decay)) : 0.0;
+        b.push_back((1.0 - g) * loop);
+    }
+
+    shortest = delays[0].len;
+    state.assign(this->lines, 0.0);
+    frame.assign(this->lines * BlockSize, 0.0);
+    Reset();
+}
+
+void FdnReverb::Reset()
+{
+    for (Line &line : delays) {
+        line.del.assign(2 * line.len, 0.0);
+        line.pos = 0;
+    }
+
+    state.assign(lines, 0.0);
+    ap.Reset();
+    early.Reset();
+}
+
+// input to every line, output taps alternate in sign, both unit norm
+double FdnReverb::GetMaxGain() const
+{
+    double loop = 0.0;
+    for (double gain : b)
+        loop = std::max(loop, gain / (1.0 - g));
+
+    double late = std::sqrt(static_cast<double>(lines)) / (1.0 - loop) * Reverb::AllPassGain(ap.GetCoefficient());
+    if (earlyOn)
+        return dry + wet * early.GetGainSum() * (1.0 + late);
+    return dry + wet * late;
+}
+
+// one run of frames no longer than the shortest line, so every read is in the past
+void FdnReverb::ProcessBlock(const double *x, double *sum, unsigned n)
+{
+    const unsigned N = lines;
+    const double tap = 1.0 / std::sqrt(static_cast<double>(N));
+    double *v = frame.data();
+
+    // line outputs x[t-len], frame major
+    for (unsigned i = 0; i < N; ++i) {
+        const double *d = &delays[i].del[delays[i].pos];
+        for (unsigned t = 0; t < n; ++t)
+            v[t * N + i] = d[t];
+    }
+
+    // damping lowpass, output taps
+    double *s = state.data();
+    const double *gain = b.data();
+    for (unsigned t = 0; t < n; ++t) {
+        double *row = v + t * N;
+        double out = 0.0;
+        for (unsigned i = 0; i < N; i += 2) {
+            row[i] = s[i] = g * s[i] + gain[i] * row[i];
+            row[i + 1] = s[i + 1] = g * s[i + 1] + gain[i + 1] * row[i + 1];
+            out += row[i] - row[i + 1];
+        }
+        sum[t] = out * tap;
+    }
+
+    // feedback matrix
+    if (mixing == Hadamard) {
+        GetKernels().Hadamard(v, N, n);
+    }
+    else {
+        const double scale = 2.0 / N;
+        for (unsigned t = 0; t < n; ++t) {
+            double *row = v + t * N;
+            double s = 0.0;
+            for (unsigned i = 0; i < N; ++i)
+                s += row[i];
+            for (unsigned i = 0; i < N; ++i)
+                row[i] -= scale * s;
+        }
+    }
+
+    // feedback plus input back into the lines, in up to two runs around the ring
+    for (unsigned i = 0; i < N; ++i) {
+        Line &line = delays[i];
+        double *d = line.del.data();
+        unsigned first = std::min(n, line.len - line.pos);
+        
+        for (unsigned t = 0; t < first; ++t)
+            d[line.pos + t] = d[line.pos + line.len + t] = v[t * N + i] + x[t];
+        for (unsigned t = first; t < n; ++t)
+            d[t - first] = d[t - first + line.len] = v[t * N + i] + x[t];
+        
+        line.pos = (line.pos + n) % line.len;
+    }
+}
+
+// filters a block of signal values
+void FdnReverb::Process(const float *in, float *out, unsigned n)
+{
+    const DspKernels &k = GetKernels();
+    const unsigned block = std::min(BlockSize, shortest);
+    double x[BlockSize], sum[BlockSize], y[BlockSize], reflections[BlockSize];
+
+    while (n > 0) {
+        unsigned count = n < block ? n : block;
+
+        for (unsigned i = 0; i < count; ++i)
+            x[i] = in[i];
+
+        if (earlyOn)
+            early.Process(x, reflections, count);
+        ProcessBlock(earlyOn ? reflections : x, sum, count);
+
+        // network output through the allpass, as the comb sum in Reverb
+        ap.Process(sum, y, count);
+        if (earlyOn)
+            k.Accumulate(reflections, y, count);
+        k.Mix(y, in, wet, dry, out, count);
+
+        in += count;
+        out += count;
+        n -= count;
+    }
+}
+
+//==============================================================================
+// Benchmark
+
+// mean normalized echo density of 20 ms windows centered every 10 ms in [from, to)
+static double MeanEchoDensity(const std::vector<float> &h, unsigned rate, size_t from, size_t to)
+{
+    const size_t half = rate / 100;
+    double total = 0.0;
+    size_t count = 0;
+
+    for (size_t t = from; t < to && t + half < h.size(); t += half) {
+        total += EchoDensity(&h[t - half], 2 * half);
+        ++count;
+    }
+
+    return count ? total / count : 0.0;
+}
+
+std::string BenchmarkFdn()
+{
+    Reverb reverb;
+    reverb.SetDryPercetage(0); // wet only
+    const unsigned rate = reverb.GetSamplingRate();
+
+    // 10 s of noise
+    std::vector<float> signal = Noise(10 * rate), out(signal.size());
+
+    // impulse response, echo density measured 50 to 300 ms in
+    std::vector<float> impulse(rate / 2, 0.0f), h(impulse.size());
+    impulse[0] = 1.0f;
+
+    std::ostringstream report;
+    report << "engine                ns/sample  echo density\n";
+
+    Reverb moorer = reverb;
+    double t = TimeProcess([&](const float *in, float *o, unsigned n) { moorer.Process(in, o, n); }, signal, out, Reverb::BlockSize);
+    moorer.Reset();
+    moorer.Process(impulse.data(), h.data(), static_cast<unsigned>(h.size()));
+    report << "moorer (6 combs)      " << t << "  " << MeanEchoDensity(h, rate, rate / 20, rate * 3 / 10) << "\n";
+
+    const char *names[2] = { "hadamard", "householder" };
+    for (unsigned lines : { 8u, 16u }) {
+        for (FdnReverb::Mixing mixing : { FdnReverb::Hadamard, FdnReverb::Householder }) {
+            FdnReverb fdn(reverb, lines, mixing);
+            t = TimeProcess([&](const float *in, float *o, unsigned n) { fdn.Process(in, o, n); }, signal, out, Reverb::BlockSize);
+            fdn.Reset();
+            fdn.Process(impulse.data(), h.data(), static_cast<unsigned>(h.size()));
+
+            std::ostringstream name;
+            name << "fdn " << lines << " " << names[mixing];
+            report << name.str() << std::string(22 - name.str().size(), ' ')
+                   << t << "  " << MeanEchoDensity(h, rate, rate / 20, rate * 3 / 10) << "\n";
+        }
+    }
+
+    return report.str();
+}
@@ -0,0 +1,62 @@
+// FdnReverb.h
+// Spring 2021
+
+#pragma once
+#include <string>    // std::string
+#include <vector>    // std::vector
+#include "Reverb.h"  // moorer reverb filter
+#include "AllPass.h" // allpass filter
+#include "EarlyReflections.h" // early reflection taps
+
+// feedback delay network alternative to the moorer comb bank
+// 8 or 16 delay lines are mixed by an orthogonal matrix every sample, each line
+// damped by a one-pole lowpass like a comb's g, then summed into the same
+// allpass and dry/wet mix as Reverb; parameters come from a Reverb:
+// line delays spread over the comb delay range, decay matches the combs' mean
+// decay time, damping is the combs' mean g
+class FdnReverb
+{
+public:
+    enum Mixing
+    {
+        Hadamard,   // walsh-hadamard, every line feeds every line with equal weight
+        Householder // I - 2/N, cheaper, weaker mixing
+    };
+
+    FdnReverb(const Reverb &reverb, unsigned lines = 16, Mixing mixing = Hadamard); // lines 8 or 16
+
+    void Reset();
+
+    void Process(const float *in, float *out, unsigned n); // filter block (in may equal out)
+
+    double GetMaxGain() const;   // upper bound on steady-state gain
+    unsigned GetLines() const { return lines; }
+
+    static const unsigned BlockSize = Reverb::BlockSize; // internal block size (samples)
+private:
+    // delay line stored twice, so a run of up to its length is read without wrapping
+    struct Line
+    {
+        std::vector<double> del;
+        unsigned len; // delay (samples)
+        unsigned pos; // oldest sample x[t-len]
+    };
+
+    void ProcessBlock(const double *x, double *sum, unsigned n); // n <= shortest delay
+
+    unsigned lines;
+    Mixing mixing;
+    std::vector<Line> delays;
+    std::vector<double> b;     // per line lowpass gain (1 - g) * loop gain
+    std::vector<double> state; // per line lowpass state
+    std::vector<double> frame; // line outputs, frame major [n][lines]
+    double g;                  // damping lowpass coefficient
+    double dry, wet;
+    unsigned shortest;         // shortest line delay
+    AllPass ap;
+    EarlyReflections early; // ahead of the network when on, as in Reverb
+    bool earlyOn;
+};
+
+// times the comb bank against 8 and 16 line networks and compares their echo density
+std::string BenchmarkFdn();
@@ -0,0 +1,244 @@
+// FileRender.cpp
+// Spring 2021
+
+#include "FileRender.h"
+#include "WaveStream.h"
+#include "Kernels.h"
+#include "Trace.h"
+#include <cmath>     // std::pow
+#include <cstdio>    // std::snprintf
+#include <cstring>   // std::memset
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h> // stat
+
+using namespace std;
+
+static const size_t blockFrames = 1 << 16; // frames per block
+
+// reads, reverbs and hands blocks of the render to a callback
+class BlockRenderer
+{
+public:
+    BlockRenderer(const string &in, const Reverb &reverb, unsigned tail, const Automation *automation) :
+    reader(in.c_str()),
+    revs(reader.GetFormat().channels, reverb),
+    automated(),
+    tailFrames(static_cast<unsigned long long>(reader.GetFormat().rate) * tail / 1000),
+    block(blockFrames * reader.GetFormat().channels),
+    plane(blockFrames)
+    {
+        for (Reverb &r : revs) {
+            r.SetSamplingRate(reader.GetFormat().rate);
+            r.Reset();
+        }
+        
+        // event times are converted to frames at the file's rate
+        if (automation)
+            for (const Reverb &r : revs)
+                automated.push_back(AutomatedReverb(r, *automation));
+    }
+    
+    const WaveFormat & GetFormat() const { return reader.GetFormat(); }
+    unsigned long long GetFrames() const { return reader.GetFormat().frames + tailFrames; }
+    
+    // calls use(block, frames) for each interleaved block in order
+    template <typename Use>
+    void Run(Use use, const RenderProgress &progress)
+    {
+        unsigned nch = GetFormat().channels;
+        unsigned long long total = GetFrames();
+        unsigned long long done = 0;
+        
+        while (done < total) {
+            size_t n;
+            {
+                MR_TRACE_SCOPE("read");
+                n = reader.Read(&block[0], blockFrames);
+            }
+            bool tail = n < blockFrames;
+            
+            // silence after the file lets the reverb ring out
+            if (tail) {
+                unsigned long long left = total - done - n;
+                size_t pad = (left < blockFrames - n) ? static_cast<size_t>(left) : blockFrames - n;
+                memset(&block[n * nch], 0, pad * nch * sizeof(float));
+                n += pad;
+            }
+            
+            for (unsigned c = 0; c < nch; ++c) {
+                MR_TRACE_SCOPE_ARG(tail ? "tail" : "reverb", "channel", c);
+                for (size_t i = 0; i < n; ++i)
+                    plane[i] = block[i * nch + c];
+                if (automated.empty())
+                    revs[c].Process(&plane[0], &plane[0], static_cast<unsigned>(n));
+                else
+                    automated[c].Process(&plane[0], &plane[0], static_cast<unsigned>(n));
+                for (size_t i = 0; i < n; ++i)
+                    block[i * nch + c] = plane[i];
+            }
+            
+            use(&block[0], n);
+            done += n;
+            
+            if (progress && !progress(static_cast<double>(done) / total))
+                throw runtime_error("render cancelled");
+        }
+    }
+private:
+    WaveReader reader;
+    vector<Reverb> revs;          // reverb state per channel
+    vector<AutomatedReverb> automated; // per channel, when following automation
+    unsigned long long tailFrames;
+    vector<float> block;          // interleaved
+    vector<float> plane;          // one channel
+};
+
+RenderLevels AnalyzeFileRender(const string &in, const Reverb &reverb, unsigned tail, RenderProgress progress,
+                               const Automation *automation)
+{
+    BlockRenderer renderer(in, reverb, tail, automation);
+    unsigned nch = renderer.GetFormat().channels;
+    
+    // sum for the dc offset, extremes for the peak around it
+    vector<double> sums(nch, 0.0);
+    vector<float> lo(nch, 0.0f), hi(nch, 0.0f);
+    
+    renderer.Run([&](const float *x, size_t n) {
+        MR_TRACE_SCOPE("analyze");
+        for (size_t i = 0; i < n; ++i) {
+            for (unsigned c = 0; c < nch; ++c) {
+                float v = x[i * nch + c];
+                sums[c] += v;
+                lo[c] = v < lo[c] ? v : lo[c];
+                hi[c] = v > hi[c] ? v : hi[c];
+            }
+        }
+    }, progress);
+    
+    RenderLevels levels;
+    levels.peak = 0.0f;
+    unsigned long long frames = renderer.GetFrames();
+    
+    for (unsigned c = 0; c < nch; ++c) {
+        double offset = frames ? sums[c] / frames : 0.0;
+        float off = static_cast<float>(offset);
+        float peak = (hi[c] - off > off - lo[c]) ? hi[c] - off : off - lo[c];
+        levels.offsets.push_back(offset);
+        levels.peak = peak > levels.peak ? peak : levels.peak;
+    }
+    
+    return levels;
+}
+
+void FileRender(const string &in, const string &out, const Reverb &reverb, unsigned tail,
+                const RenderLevels &levels, float dB, RenderProgress progress, const Automation *automation)
+{
+    BlockRenderer renderer(in, reverb, tail, automation);
+    WaveFormat format = renderer.GetFormat();
+    format.frames = renderer.GetFrames();
+    unsigned nch = format.channels;
+    
+    if (levels.offsets.size() != nch)
+        throw runtime_error("levels don't match the input's channels");
+    
+    // silent renders can't be normalized
+    float gain = (levels.peak > 0.0f) ? pow(10.0f, dB / 20.0f) / levels.peak : 1.0f;
+    
+    WaveWriter writer(out.c_str(), format);
+    
+    renderer.Run([&](float *x, size_t n) {
+        MR_TRACE_SCOPE("write");
+        for (unsigned c = 0; c < nch; ++c) {
+            float off = static_cast<float>(levels.offsets[c]);
+            for (size_t i = 0; i < n; ++i)
+                x[i * nch + c] -= off;
+        }
+        GetKernels().Scale(x, n * nch, gain);
+        writer.Write(x, n);
+    }, progress);
+    
+    if (!writer.Close())
+        throw runtime_error("unable to write output file");
+}
+
+Hash64 FileRenderKey(const string &in, Reverb &reverb, unsigned tail, const Automation *automation)
+{
+    struct stat info;
+    if (stat(in.c_str(), &info) != 0)
+        return 0;
+    
+    Hash64 h = reverb.GetParameterHash();
+    h = HashValue(tail, h);
+    h = HashValue(static_cast<unsigned long long>(info.st_size), h);
+    h = HashValue(static_cast<long long>(info.st_mtime), h);
+    if (automation)
+        h = automation->GetHash(h);
+    return h;
+}
+
+bool LoadLevels(const string &fname, RenderLevels &levels)
+{
+    ifstream file(fname);
+    size_t channels = 0;
+    
+    if (!(file >> levels.peak >> channels) || channels == 0)
+        return false;
+    
+    levels.offsets.resize(channels);
+    for (double &offset : levels.offsets)
+        file >> offset;
+    
+    return static_cast<bool>(file);
+}
+
+bool SaveLevels(const string &fname, const RenderLevels &levels)
+{
+    // temp file and rename, so a partly written file is never read
+    string temp = fname + ".tmp";
+    {
+        ofstream file(temp);
+        file.precision(17);
+        file << levels.peak << ' ' << levels.offsets.size() << '\n';
+        for (double offset : levels.offsets)
+            file << offset << '\n';
+        
+        if (!file)
+            return false;
+    }
+    
+    remove(fname.c_str());
+    return rename(temp.c_str(), fname.c_str()) == 0;
+}
+
+void RenderFile(const string &in, const string &out, const Reverb &reverb, unsigned tail,
+                float dB, const string &cacheDir, RenderProgress progress, const Automation *automation)
+{
+    Reverb r = reverb;
+    {
+        // levels are measured at the file's rate
+        WaveReader reader(in.c_str());
+        r.SetSamplingRate(reader.GetFormat().rate);
+    }
+    
+    string levelsFile;
+    if (!cacheDir.empty()) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.mrl", FileRenderKey(in, r, tail, automation));
+        levelsFile = cacheDir + "/" + name;
+    }
+    
+    // each pass is half of the progress unless the analysis is cached
+    RenderLevels levels;
+    bool cached = !levelsFile.empty() && LoadLevels(levelsFile, levels);
+    
+    if (!cached) {
+        levels = AnalyzeFileRender(in, r, tail, [&](double p) { return !progress || progress(p * 0.5); }, automation);
+        if (!levelsFile.empty())
+            SaveLevels(levelsFile, levels);
+    }
+    
+    FileRender(in, out, r, tail, levels, dB, [&](double p) {
+        return !progress || progress(cached ? p : 0.5 + p * 0.5);
+    }, automation);
+}
@@ -0,0 +1,52 @@
+// FileRender.h
+// Spring 2021
+
+#pragma once
+#include <functional> // std::function
+#include <string>     // std::string
+#include <vector>     // std::vector
+#include "Reverb.h"   // moorer reverb filter
+#include "Automation.h" // parameter automation lanes
+#include "Hash.h"     // Hash64
+
+// wave file to wave file reverb render in fixed size blocks, so memory
+// use doesn't depend on file length
+//
+// normalization needs the output's dc offsets and peak before the first
+// sample is written, so the render runs twice: an analysis pass that only
+// measures levels, then the pass that writes. Levels can be saved and
+// reused to skip the analysis when the same file is rendered again.
+
+// dc offset per channel and peak of a render, enough to normalize it
+struct RenderLevels
+{
+    std::vector<double> offsets; // dc offset per channel
+    float peak;                  // max |sample - offset| over all channels
+};
+
+// progress callback gets the fraction done [0,1], returns false to cancel
+typedef std::function<bool(double)> RenderProgress;
+
+// pass 1: renders in (tail ms of reverb after the end) and measures levels
+// automation, when given, is followed from the file's first frame
+// throws on invalid files or cancel
+RenderLevels AnalyzeFileRender(const std::string &in, const Reverb &reverb, unsigned tail,
+                               RenderProgress progress = nullptr, const Automation *automation = nullptr);
+
+// pass 2: renders in to out normalized to dB, same channels, rate and bits as in
+// throws on invalid files, write errors or cancel
+void FileRender(const std::string &in, const std::string &out, const Reverb &reverb, unsigned tail,
+                const RenderLevels &levels, float dB = -1.5f, RenderProgress progress = nullptr,
+                const Automation *automation = nullptr);
+
+// identifies a render of in: file size and modification time, reverb parameters, tail and automation
+Hash64 FileRenderKey(const std::string &in, Reverb &reverb, unsigned tail, const Automation *automation = nullptr);
+
+// levels files (<dir>/<key>.mrl) cache the analysis pass between runs
+bool LoadLevels(const std::string &fname, RenderLevels &levels);
+bool SaveLevels(const std::string &fname, const RenderLevels &levels);
+
+// both passes, analysis is skipped when cacheDir has levels for this render
+void RenderFile(const std::string &in, const std::string &out, const Reverb &reverb, unsigned tail,
+                float dB = -1.5f, const std::string &cacheDir = "", RenderProgress progress = nullptr,
+                const Automation *automation = nullptr);
@@ -0,0 +1,409 @@
+// Fit.cpp
+// Spring 2021
+
+#include "Fit.h"
+#include "Automation.h" // AutomatedReverb::Apply
+#include "Bench.h"      // lcg, echo density
+#include "WorkPool.h"   // work-stealing pool
+#include <algorithm>    // std::sort, std::min, std::max
+#include <atomic>       // evaluation count
+#include <chrono>       // timing
+#include <cmath>        // std::log10, std::log, std::cos, std::sin
+#include <numeric>      // std::iota
+#include <sstream>      // report
+#include <stdexcept>
+
+//==============================================================================
+// Features
+
+std::vector<double> FitBands(unsigned rate)
+{
+    std::vector<double> bands;
+    for (double f = 250.0; f <= 8000.0 && f * 1.5 < 0.45 * rate; f *= 2.0)
+        bands.push_back(f);
+    return bands;
+}
+
+// octave band pass, 0 dB at the center
+static void BandPass(const float *x, double *y, size_t n, double f, unsigned rate)
+{
+    const double pi = 3.14159265358979323846;
+    const double w = 2.0 * pi * f / rate;
+    const double alpha = std::sin(w) / (2.0 * 1.41421356237);
+    const double a0 = 1.0 + alpha;
+    const double b0 = alpha / a0, b2 = -alpha / a0;
+    const double a1 = -2.0 * std::cos(w) / a0, a2 = (1.0 - alpha) / a0;
+
+    double x1 = 0.0, x2 = 0.0, y1 = 0.0, y2 = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double v = b0 * x[i] + b2 * x2 - a1 * y1 - a2 * y2;
+        x2 = x1;
+        x1 = x[i];
+        y2 = y1;
+        y1 = v;
+        y[i] = v;
+    }
+}
+
+// slope of the decay between from and to dB, as seconds to fall 60 dB
+static double DecayTime(const std::vector<double> &edc, double window, double from, double to)
+{
+    double n = 0.0, st = 0.0, sd = 0.0, stt = 0.0, sdt = 0.0;
+    for (size_t w = 0; w < edc.size(); ++w)
+        if (edc[w] <= from && edc[w] >= to) {
+            double t = w * window;
+            n += 1.0;
+            st += t;
+            sd += edc[w];
+            stt += t * t;
+            sdt += t * edc[w];
+        }
+    double denominator = n * stt - st * st;
+    if (n < 2.0 || denominator <= 0.0)
+        return -1.0;
+    double slope = (n * sdt - st * sd) / denominator; // dB per second
+    return slope < 0.0 ? -60.0 / slope : -1.0;
+}
+
+IrFeatures AnalyzeIr(const float *h, size_t n, unsigned rate)
+{
+    IrFeatures f;
+    const size_t window = rate / 100;
+    const size_t windows = n / window;
+    std::vector<double> y(n);
+
+    for (double band : FitBands(rate)) {
+        BandPass(h, y.data(), n, band, rate);
+
+        // energy left after each window
+        std::vector<double> edc(windows + 1, 0.0);
+        for (size_t w = windows; w-- > 0;) {
+            edc[w] = edc[w + 1];
+            for (size_t i = w * window; i < (w + 1) * window; ++i)
+                edc[w] += y[i] * y[i];
+        }
+        edc.pop_back();
+        const double whole = edc.empty() ? 0.0 : edc[0];
+        for (double &e : edc) {
+            double dB = whole > 0.0 && e > 0.0 ? 10.0 * std::log10(e / whole) : -60.0;
+            e = dB > -60.0 ? dB : -60.0;
+        }
+
+        // short decays don't reach -35 dB in the window, fit what there is
+        double rt = DecayTime(edc, 0.01, -5.0, -35.0);
+        if (rt < 0.0)
+            rt = DecayTime(edc, 0.01, 0.0, -59.9);
+        f.rt60.push_back(rt < 0.0 ? 100.0 : std::min(rt, 100.0));
+        f.edc.push_back(edc);
+    }
+
+    const size_t span = rate / 50;
+    for (size_t t = 0; t + span <= n && t < rate * 3 / 10; t += span)
+        f.density.push_back(EchoDensity(h + t, span));
+
+    // direct sound is the first 2.5 ms
+    const size_t direct = std::min<size_t>(n, rate / 400);
+    double near = 0.0, far = 1e-30;
+    for (size_t i = 0; i < n; ++i)
+        (i < direct ? near : far) += static_cast<double>(h[i]) * h[i];
+    f.drr = 10.0 * std::log10(near / far + 1e-30);
+    return f;
+}
+
+double IrDistance(const IrFeatures &a, const IrFeatures &b)
+{
+    double decay = 0.0, rt = 0.0, density = 0.0;
+    const size_t bands = std::min(a.edc.size(), b.edc.size());
+    for (size_t k = 0; k < bands; ++k) {
+        const size_t windows = std::min(a.edc[k].size(), b.edc[k].size());
+        double sum = 0.0;
+        for (size_t w = 0; w < windows; ++w)
+            sum += std::abs(a.edc[k][w] - b.edc[k][w]);
+        decay += windows ? sum / windows : 0.0;
+        rt += 10.0 * std::abs(std::log(a.rt60[k] / b.rt60[k]));
+    }
+
+    const size_t spans = std::min(a.density.size(), b.density.size());
+    for (size_t s = 0; s < spans; ++s)
+        density += std::abs(a.density[s] - b.density[s]);
+
+    return (bands ? (decay + rt) / bands : 0.0) + (spans ? 10.0 * density / spans : 0.0) + std::abs(a.drr - b.drr);
+}
+
+//==============================================================================
+// Search
+
+namespace
+{
+    const unsigned Dimensions = 21; // 6 comb delays, gs and zfs, allpass a and delay, dry
+    typedef std::vector<double> Point; // each parameter scaled to [0, 1]
+
+    // one candidate's impulse response scored against the target
+    class Scorer
+    {
+    public:
+        Scorer(const Reverb &base, const IrFeatures &target, size_t length, unsigned rate) :
+        base(base), target(target), length(length), rate(rate), count(0) {}
+
+        Reverb Candidate(const Point &x) const
+        {
+            Reverb r = base;
+            for (unsigned i = 0; i < 6; ++i) {
+                AutomatedReverb::Apply(r, Automation::CombDelay, i, 20.0 + std::round(80.0 * x[i]));
+                AutomatedReverb::Apply(r, Automation::CombG, i, 0.95 * x[6 + i]);
+                AutomatedReverb::Apply(r, Automation::CombZF, i, 0.98 * x[12 + i]);
+            }
+            AutomatedReverb::Apply(r, Automation::AllPassCoeff, 0, 0.95 * x[18]);
+            AutomatedReverb::Apply(r, Automation::AllPassDelay, 0, 1.0 + std::round(19.0 * x[19]));
+            AutomatedReverb::Apply(r, Automation::Dry, 0, std::round(100.0 * x[20]));
+            r.Reset();
+            return r;
+        }
+
+        IrFeatures Response(Reverb r) const
+        {
+            std::vector<float> h(length, 0.0f);
+            h[0] = 1.0f;
+            r.Process(h.data(), h.data(), static_cast<unsigned>(length));
+            return AnalyzeIr(h.data(), length, rate);
+        }
+
+        double operator()(const Point &x)
+        {
+            ++count;
+            return IrDistance(target, Response(Candidate(x)));
+        }
+
+        size_t Count() const { return count; }
+    private:
+        const Reverb &base;
+        const IrFeatures &target;
+        size_t length;
+        unsigned rate;
+        std::atomic<size_t> count;
+    };
+
+    Point Clamp(Point x)
+    {
+        for (double &v : x)
+            v = v < 0.0 ? 0.0 : (v > 1.0 ? 1.0 : v);
+        return x;
+    }
+
+    // nelder-mead in the unit cube, stops after budget scores
+    double NelderMead(Scorer &score, Point &best, size_t budget)
+    {
+        const unsigned d = Dimensions;
+        std::vector<Point> p(d + 1, best);
+        std::vector<double> f(d + 1);
+        for (unsigned i = 0; i < d; ++i)
+            p[i + 1][i] += best[i] < 0.85 ? 0.15 : -0.15;
+        for (unsigned i = 0; i <= d; ++i)
+            f[i] = score(p[i]);
+        size_t used = d + 1;
+
+        std::vector<unsigned> order(d + 1);
+        while (used + 2 <= budget) {
+            std::iota(order.begin(), order.end(), 0u);
+            std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return f[a] < f[b]; });
+            const unsigned lo = order[0], hi = order[d], next = order[d - 1];
+            if (f[hi] - f[lo] < 1e-9)
+                break;
+
+            Point centroid(d, 0.0);
+            for (unsigned i = 0; i <= d; ++i)
+                if (i != hi)
+                    for (unsigned j = 0; j < d; ++j)
+                        centroid[j] += p[i][j] / d;
+            auto along = [&](double t) {
+                Point x(d);
+                for (unsigned j = 0; j < d; ++j)
+                    x[j] = centroid[j] + t * (p[hi][j] - centroid[j]);
+                return Clamp(x);
+            };
+
+            Point r = along(-1.0);
+            double fr = score(r);
+            ++used;
+            if (fr < f[lo]) {
+                Point e = along(-2.0);
+                double fe = score(e);
+                ++used;
+                p[hi] = fe < fr ? e : r;
+                f[hi] = fe < fr ? fe : fr;
+            }
+            else if (fr < f[next]) {
+                p[hi] = r;
+                f[hi] = fr;
+            }
+            else {
+                Point c = along(fr < f[hi] ? -0.5 : 0.5);
+                double fc = score(c);
+                ++used;
+                if (fc < std::min(fr, f[hi])) {
+                    p[hi] = c;
+                    f[hi] = fc;
+                }
+                else {
+                    // shrink toward the best
+                    for (unsigned i = 0; i <= d && used < budget; ++i)
+                        if (i != lo) {
+                            for (unsigned j = 0; j < d; ++j)
+                                p[i][j] = p[lo][j] + 0.5 * (p[i][j] - p[lo][j]);
+                            f[i] = score(p[i]);
+                            ++used;
+                        }
+                }
+            }
+        }
+
+        unsigned lo = static_cast<unsigned>(std::min_element(f.begin(), f.end()) - f.begin());
+        best = p[lo];
+        return f[lo];
+    }
+}
+
+std::string FitResult::Report() const
+{
+    std::ostringstream report;
+    report << "distance " << distance << " after " << evaluations << " evaluations in " << seconds << " s ("
+           << (seconds > 0.0 ? evaluations / seconds : 0.0) << "/s)\n";
+    report << "band (Hz)  target rt60 (s)  fit rt60 (s)\n";
+    for (size_t k = 0; k < bands.size(); ++k)
+        report << bands[k] << "  " << targetRt60[k] << "  " << fitRt60[k] << "\n";
+    return report.str();
+}
+
+FitResult FitReverb(const AudioData &target, size_t evaluations, unsigned threads)
+{
+    const unsigned rate = target.rate();
+    const unsigned nch = target.channels();
+    if (target.frames() == 0 || nch == 0 || rate == 0)
+        throw std::runtime_error("empty impulse response");
+
+    // mono, from the onset of the direct sound
+    std::vector<float> h(target.frames());
+    float peak = 0.0f;
+    for (size_t i = 0; i < h.size(); ++i) {
+        double sum = 0.0;
+        for (unsigned c = 0; c < nch; ++c)
+            sum += target.sample(i, c);
+        h[i] = static_cast<float>(sum / nch);
+        peak = std::max(peak, std::abs(h[i]));
+    }
+    if (peak == 0.0f)
+        throw std::runtime_error("silent impulse response");
+    size_t onset = 0;
+    while (std::abs(h[onset]) < 0.5f * peak)
+        ++onset;
+    h.erase(h.begin(), h.begin() + onset);
+
+    // scored over the target's fall to -50 dB and a little more, 0.2 to 2 s
+    double total = 0.0, left = 0.0;
+    for (float v : h)
+        total += static_cast<double>(v) * v;
+    size_t length = h.size();
+    left = total;
+    for (size_t i = 0; i < h.size(); ++i) {
+        left -= static_cast<double>(h[i]) * h[i];
+        if (left < total * 1e-5) {
+            length = i + i / 10;
+            break;
+        }
+    }
+    length = std::max<size_t>(length, rate / 5);
+    length = std::min<size_t>(length, 2 * rate);
+    h.resize(length, 0.0f);
+
+    FitResult result;
+    const IrFeatures goal = AnalyzeIr(h.data(), length, rate);
+    result.reverb.SetSamplingRate(rate);
+    Scorer score(result.reverb, goal, length, rate);
+    WorkPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+
+    // random stage, a quarter of the budget, seeded per candidate
+    const size_t samples = std::max<size_t>(evaluations / 4, 64);
+    const size_t batch = 64;
+    std::vector<Point> points(samples, Point(Dimensions));
+    std::vector<double> scores(samples);
+    std::vector<WorkPool::Task> tasks;
+    for (size_t first = 0; first < samples; first += batch)
+        tasks.push_back([&, first](unsigned) {
+            for (size_t i = first; i < std::min(first + batch, samples); ++i) {
+                Lcg lcg(static_cast<unsigned>(i) * 2654435761u + 1u);
+                for (double &v : points[i])
+                    v = lcg.Uniform();
+                scores[i] = score(points[i]);
+            }
+        });
+    pool.Run(std::move(tasks));
+
+    // refine the best starts, each on its own thread
+    const size_t starts = std::min<size_t>(16, samples);
+    std::vector<size_t> order(samples);
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::partial_sort(order.begin(), order.begin() + starts, order.end(),
+                      [&](size_t a, size_t b) { return scores[a] < scores[b] || (scores[a] == scores[b] && a < b); });
+
+    const size_t budget = evaluations > samples ? (evaluations - samples) / starts : 0;
+    std::vector<Point> refined(starts);
+    std::vector<double> refinedScores(starts);
+    tasks.clear();
+    for (size_t s = 0; s < starts; ++s)
+        tasks.push_back([&, s](unsigned) {
+            refined[s] = points[order[s]];
+            refinedScores[s] = budget > Dimensions + 2 ? NelderMead(score, refined[s], budget) : scores[order[s]];
+        });
+    pool.Run(std::move(tasks));
+
+    size_t best = static_cast<size_t>(std::min_element(refinedScores.begin(), refinedScores.end()) - refinedScores.begin());
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    result.reverb = score.Candidate(refined[best]);
+    result.distance = refinedScores[best];
+    result.evaluations = score.Count();
+    result.seconds = elapsed.count();
+    result.bands = FitBands(rate);
+    result.targetRt60 = goal.rt60;
+    result.fitRt60 = score.Response(result.reverb).rt60;
+    return result;
+}
+
+//==============================================================================
+// Check
+
+std::string CheckFit(bool &passed)
+{
+    const unsigned rate = 44100;
+    const unsigned delays[6] = { 37, 43, 51, 58, 66, 79 };
+    const double gs[6] = { 0.2, 0.25, 0.3, 0.35, 0.4, 0.45 };
+
+    Reverb known;
+    known.SetDryPercetage(30);
+    known.SetAllPassCoeff(0.6);
+    known.SetAllPassDelay(9);
+    for (unsigned i = 0; i < 6; ++i) {
+        known.SetCombDelay(delays[i], i);
+        known.SetCombLowPassCoeff(gs[i], i);
+        known.SetCombZeroFreqGain(0.72, i);
+    }
+    known.Reset();
+
+    AudioData ir(rate * 3 / 2, rate, 1);
+    ir.sample(0) = 1.0f;
+    known.Process(ir.data(), ir.data(), static_cast<unsigned>(ir.frames()));
+
+    FitResult fit = FitReverb(ir, 6000);
+    std::ostringstream report;
+    report << fit.Report();
+
+    double worst = 0.0;
+    for (size_t k = 0; k < fit.bands.size(); ++k)
+        worst = std::max(worst, std::abs(fit.fitRt60[k] / fit.targetRt60[k] - 1.0));
+    report << "largest rt60 error " << 100.0 * worst << "%\n";
+
+    passed = worst < 0.15;
+    report << (passed ? "passed\n" : "FAILED\n");
+    return report.str();
+}
@@ -0,0 +1,50 @@
+// Fit.h
+// Spring 2021
+
+#pragma once
+#include <string>      // std::string
+#include <vector>      // std::vector
+#include "AudioData.h" // audio buffer
+#include "Reverb.h"    // moorer reverb filter
+
+// fits moorer reverb parameters to a measured impulse response: candidates'
+// short responses are rendered in parallel and scored on decay per octave
+// band, echo density and direct to reverberant ratio
+
+// what an impulse response is scored on
+struct IrFeatures
+{
+    std::vector<std::vector<double>> edc; // per band, schroeder decay (dB) every 10 ms, floored at -60
+    std::vector<double> rt60;             // per band (s), fit to the decay from -5 to -35 dB
+    std::vector<double> density;          // normalized echo density every 20 ms of the first 300 ms
+    double drr;                           // direct to reverberant energy (dB)
+};
+
+// analysis bands, octaves from 250 Hz up to below nyquist
+std::vector<double> FitBands(unsigned rate);
+
+IrFeatures AnalyzeIr(const float *h, size_t n, unsigned rate);
+
+// weighted so a 1 dB decay miss, a 10% rt60 miss, a 0.1 density miss
+// and a 1 dB ratio miss count about the same
+double IrDistance(const IrFeatures &a, const IrFeatures &b);
+
+struct FitResult
+{
+    Reverb reverb; // at the target's rate
+    double distance;
+    size_t evaluations;
+    double seconds;
+    std::vector<double> bands, targetRt60, fitRt60;
+
+    std::string Report() const;
+};
+
+// random search over the parameter space, then nelder-mead from the best
+// starts, all on a work-stealing pool of threads (0 = one per core); the
+// result doesn't depend on the thread count. Comb and allpass delays are
+// whole ms, as on the sliders. throws on an empty or silent target
+FitResult FitReverb(const AudioData &target, size_t evaluations = 20000, unsigned threads = 0);
+
+// fits the response of known settings and checks the decay times come back
+std::string CheckFit(bool &passed);
@@ -0,0 +1,35 @@
+// Hash.h
+// Spring 2021
+
+#pragma once
+#include <cstddef> // size_t
+#include <cstring> // std::memcpy
+
+typedef unsigned long long Hash64;
+
+const Hash64 HashSeed = 14695981039346656037ull; // fnv offset basis
+
+// fnv-1a style hash taking 8 bytes per step
+inline Hash64 HashBytes(const void *bytes, size_t n, Hash64 h = HashSeed)
+{
+    const unsigned char *p = static_cast<const unsigned char*>(bytes);
+    const Hash64 prime = 1099511628211ull;
+    
+    for (; n >= 8; n -= 8, p += 8) {
+        Hash64 word;
+        std::memcpy(&word, p, 8);
+        h = (h ^ word) * prime;
+        h ^= h >> 32; // fold high bits back down
+    }
+    for (; n > 0; --n, ++p)
+        h = (h ^ *p) * prime;
+    
+    return h;
+}
+
+// hash of a plain value
+template <typename T>
+inline Hash64 HashValue(const T &value, Hash64 h = HashSeed)
+{
+    return HashBytes(&value, sizeof(value), h);
+}
@@ -0,0 +1,902 @@
+// Kernels.cpp
+// Spring 2021
+
+#include "Kernels.h"
+#include <cmath>   // std::abs, std::sqrt
+#include <cstdlib> // std::getenv
+#include <cstring> // std::strcmp
+#include <chrono>  // timing for benchmark
+#include <sstream> // benchmark report
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MR_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define MR_TARGET(isa)
+#else
+#include <cpuid.h>
+#define MR_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// no fused multiply-add in scalar tails inlined into avx-512 kernels, so an
+// element's result doesn't depend on where a block split puts it
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+
+using namespace std;
+
+const float toFloat16 = 1.0f / (1 << 15);              // pcm16 -> float
+const float toShort16 = static_cast<float>((1 << 15) - 1); // float -> pcm16
+
+//==============================================================================
+// Scalar
+
+static void CombFeedScalar(const double *xl, const double *xl1, const double *yl,
+                           double g, double R, double *v, unsigned n)
+{
+    for (unsigned i = 0; i < n; ++i)
+        v[i] = xl[i] - g * xl1[i] + R * yl[i];
+}
+
+static void AllPassScalar(const double *xm, const double *ym, const double *x,
+                          double a, double *y, unsigned n)
+{
+    for (unsigned i = 0; i < n; ++i)
+        y[i] = xm[i] + a * (x[i] - ym[i]);
+}
+
+static void AccumulateScalar(const double *in, double *acc, unsigned n)
+{
+    for (unsigned i = 0; i < n; ++i)
+        acc[i] += in[i];
+}
+
+static void MixScalar(const double *wetSig, const float *drySig, double wet, double dry,
+                      float *out, unsigned n)
+{
+    for (unsigned i = 0; i < n; ++i)
+        out[i] = static_cast<float>(wetSig[i] * wet + drySig[i] * dry);
+}
+
+static void ShortToFloatScalar(const short *in, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = in[i] * toFloat16;
+}
+
+// clips to [-1, 1] first, as every kernel set does, so out of range samples
+// convert the same everywhere and never overflow the conversion
+static void FloatToShortScalar(const float *in, short *out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        float x = in[i] < -1.0f ? -1.0f : (in[i] > 1.0f ? 1.0f : in[i]);
+        out[i] = static_cast<short>(toShort16 * x);
+    }
+}
+
+static float PeakAbsScalar(const float *x, size_t n)
+{
+    float peak = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float value = std::abs(x[i]);
+        if (value > peak)
+            peak = value;
+    }
+    return peak;
+}
+
+static void ScaleScalar(float *x, size_t n, float gain)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] *= gain;
+}
+
+static void DeinterleaveScalar(const float *in, unsigned channels, unsigned channel, float offset,
+                               float gain, float step, float *out, size_t n)
+{
+    in += channel;
+    for (size_t i = 0; i < n; ++i)
+        out[i] = (in[i * channels] - offset) * (gain + static_cast<float>(i) * step);
+}
+
+static float DotScalar(const float *a, const float *b, size_t n)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void HadamardScalar(double *x, unsigned lines, unsigned frames)
+{
+    const double scale = 1.0 / std::sqrt(static_cast<double>(lines));
+    for (unsigned f = 0; f < frames; ++f, x += lines) {
+        for (unsigned h = 1; h < lines; h *= 2) {
+            for (unsigned i = 0; i < lines; i += 2 * h) {
+                for (unsigned j = i; j < i + h; ++j) {
+                    double a = x[j], b = x[j + h];
+                    x[j] = a + b;
+                    x[j + h] = a - b;
+                }
+            }
+        }
+        
+        for (unsigned i = 0; i < lines; ++i)
+            x[i] *= scale;
+    }
+}
+
+static void TapSumScalar(const double *ring, const unsigned *starts, const double *gains,
+                         unsigned taps, double *out, unsigned n)
+{
+    for (unsigned i = 0; i < n; ++i) {
+        double sum = 0.0;
+        for (unsigned k = 0; k < taps; ++k)
+            sum += gains[k] * ring[starts[k] + i];
+        out[i] = sum;
+    }
+}
+
+static const DspKernels scalarKernels = {
+    "scalar",
+    CombFeedScalar, AllPassScalar, AccumulateScalar, MixScalar,
+    ShortToFloatScalar, FloatToShortScalar, PeakAbsScalar, ScaleScalar,
+    DeinterleaveScalar, DotScalar, HadamardScalar, TapSumScalar
+};
+
+#ifdef MR_X86
+//==============================================================================
+// SSE4.2 (2 doubles / 4 floats)
+
+MR_TARGET("sse4.2")
+static void CombFeedSSE(const double *xl, const double *xl1, const double *yl,
+                        double g, double R, double *v, unsigned n)
+{
+    __m128d vg = _mm_set1_pd(g), vR = _mm_set1_pd(R);
+    unsigned i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d t = _mm_sub_pd(_mm_loadu_pd(xl + i), _mm_mul_pd(vg, _mm_loadu_pd(xl1 + i)));
+        _mm_storeu_pd(v + i, _mm_add_pd(t, _mm_mul_pd(vR, _mm_loadu_pd(yl + i))));
+    }
+    CombFeedScalar(xl + i, xl1 + i, yl + i, g, R, v + i, n - i);
+}
+
+MR_TARGET("sse4.2")
+static void AllPassSSE(const double *xm, const double *ym, const double *x,
+                       double a, double *y, unsigned n)
+{
+    __m128d va = _mm_set1_pd(a);
+    unsigned i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d d = _mm_sub_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(ym + i));
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(xm + i), _mm_mul_pd(va, d)));
+    }
+    AllPassScalar(xm + i, ym + i, x + i, a, y + i, n - i);
+}
+
+MR_TARGET("sse4.2")
+static void AccumulateSSE(const double *in, double *acc, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(acc + i, _mm_add_pd(_mm_loadu_pd(acc + i), _mm_loadu_pd(in + i)));
+    AccumulateScalar(in + i, acc + i, n - i);
+}
+
+MR_TARGET("sse4.2")
+static void MixSSE(const double *wetSig, const float *drySig, double wet, double dry,
+                   float *out, unsigned n)
+{
+    __m128d vw = _mm_set1_pd(wet), vd = _mm_set1_pd(dry);
+    unsigned i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128 d2 = _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(drySig + i)));
+        __m128d r = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(wetSig + i), vw), _mm_mul_pd(_mm_cvtps_pd(d2), vd));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_castps_si128(_mm_cvtpd_ps(r)));
+    }
+    MixScalar(wetSig + i, drySig + i, wet, dry, out + i, n - i);
+}
+
+MR_TARGET("sse4.2")
+static void ShortToFloatSSE(const short *in, float *out, size_t n)
+{
+    __m128 scale = _mm_set1_ps(toFloat16);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(s), scale));
+    }
+    ShortToFloatScalar(in + i, out + i, n - i);
+}
+
+MR_TARGET("sse4.2")
+static void FloatToShortSSE(const float *in, short *out, size_t n)
+{
+    __m128 scale = _mm_set1_ps(toShort16);
+    __m128 lower = _mm_set1_ps(-1.0f), upper = _mm_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), lower), upper);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), lower), upper);
+        __m128i lo = _mm_cvttps_epi32(_mm_mul_ps(a, scale));
+        __m128i hi = _mm_cvttps_epi32(_mm_mul_ps(b, scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+    }
+    FloatToShortScalar(in + i, out + i, n - i);
+}
+
+MR_TARGET("sse4.2")
+static float PeakAbsSSE(const float *x, size_t n)
+{
+    __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 peak = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        peak = _mm_max_ps(peak, _mm_and_ps(_mm_loadu_ps(x + i), mask));
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, peak);
+    float result = PeakAbsScalar(x + i, n - i);
+    for (float f : lanes)
+        if (f > result)
+            result = f;
+    return result;
+}
+
+MR_TARGET("sse4.2")
+static void ScaleSSE(float *x, size_t n, float gain)
+{
+    __m128 vg = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(x + i, _mm_mul_ps(_mm_loadu_ps(x + i), vg));
+    ScaleScalar(x + i, n - i, gain);
+}
+
+// mono and stereo are vectorized, other layouts fall back to scalar
+MR_TARGET("sse4.2")
+static void DeinterleaveSSE(const float *in, unsigned channels, unsigned channel, float offset,
+                            float gain, float step, float *out, size_t n)
+{
+    if (channels > 2) {
+        DeinterleaveScalar(in, channels, channel, offset, gain, step, out, n);
+        return;
+    }
+    
+    __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    __m128 vo = _mm_set1_ps(offset), vg = _mm_set1_ps(gain), vs = _mm_set1_ps(step);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x;
+        if (channels == 1)
+            x = _mm_loadu_ps(in + i);
+        else if (channel == 0)
+            x = _mm_shuffle_ps(_mm_loadu_ps(in + 2 * i), _mm_loadu_ps(in + 2 * i + 4), _MM_SHUFFLE(2, 0, 2, 0));
+        else
+            x = _mm_shuffle_ps(_mm_loadu_ps(in + 2 * i), _mm_loadu_ps(in + 2 * i + 4), _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 g = _mm_add_ps(vg, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes), vs));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_sub_ps(x, vo), g));
+    }
+    
+    // remainder continues the ramp
+    DeinterleaveScalar(in + i * channels, channels, channel, offset, gain + static_cast<float>(i) * step,
+                       step, out + i, n - i);
+}
+
+MR_TARGET("sse4.2")
+static float DotSSE(const float *a, const float *b, size_t n)
+{
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, sum);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + DotScalar(a + i, b + i, n - i);
+}
+
+// span 1 butterflies in register, wider spans across registers
+MR_TARGET("sse4.2")
+static void HadamardSSE(double *x, unsigned lines, unsigned frames)
+{
+    if (lines < 2) {
+        HadamardScalar(x, lines, frames);
+        return;
+    }
+    
+    __m128d scale = _mm_set1_pd(1.0 / std::sqrt(static_cast<double>(lines)));
+    for (unsigned f = 0; f < frames; ++f, x += lines) {
+        for (unsigned i = 0; i < lines; i += 2) {
+            __m128d a = _mm_loadu_pd(x + i);
+            __m128d t = _mm_shuffle_pd(a, a, 1); // x1 x0
+            _mm_storeu_pd(x + i, _mm_blend_pd(_mm_add_pd(a, t), _mm_sub_pd(t, a), 2));
+        }
+        
+        for (unsigned h = 2; h < lines; h *= 2) {
+            for (unsigned i = 0; i < lines; i += 2 * h) {
+                for (unsigned j = i; j < i + h; j += 2) {
+                    __m128d a = _mm_loadu_pd(x + j), b = _mm_loadu_pd(x + j + h);
+                    _mm_storeu_pd(x + j, _mm_add_pd(a, b));
+                    _mm_storeu_pd(x + j + h, _mm_sub_pd(a, b));
+                }
+            }
+        }
+        
+        for (unsigned i = 0; i < lines; i += 2)
+            _mm_storeu_pd(x + i, _mm_mul_pd(_mm_loadu_pd(x + i), scale));
+    }
+}
+
+// outputs in register across all taps, one unaligned load per tap
+MR_TARGET("sse4.2")
+static void TapSumSSE(const double *ring, const unsigned *starts, const double *gains,
+                      unsigned taps, double *out, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d sum = _mm_setzero_pd();
+        for (unsigned k = 0; k < taps; ++k)
+            sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set1_pd(gains[k]), _mm_loadu_pd(ring + starts[k] + i)));
+        _mm_storeu_pd(out + i, sum);
+    }
+    for (; i < n; ++i) {
+        double sum = 0.0;
+        for (unsigned k = 0; k < taps; ++k)
+            sum += gains[k] * ring[starts[k] + i];
+        out[i] = sum;
+    }
+}
+
+static const DspKernels sseKernels = {
+    "sse4.2",
+    CombFeedSSE, AllPassSSE, AccumulateSSE, MixSSE,
+    ShortToFloatSSE, FloatToShortSSE, PeakAbsSSE, ScaleSSE,
+    DeinterleaveSSE, DotSSE, HadamardSSE, TapSumSSE
+};
+
+//==============================================================================
+// AVX2 (4 doubles / 8 floats)
+
+MR_TARGET("avx2")
+static void CombFeedAVX2(const double *xl, const double *xl1, const double *yl,
+                         double g, double R, double *v, unsigned n)
+{
+    __m256d vg = _mm256_set1_pd(g), vR = _mm256_set1_pd(R);
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d t = _mm256_sub_pd(_mm256_loadu_pd(xl + i), _mm256_mul_pd(vg, _mm256_loadu_pd(xl1 + i)));
+        _mm256_storeu_pd(v + i, _mm256_add_pd(t, _mm256_mul_pd(vR, _mm256_loadu_pd(yl + i))));
+    }
+    CombFeedScalar(xl + i, xl1 + i, yl + i, g, R, v + i, n - i);
+}
+
+MR_TARGET("avx2")
+static void AllPassAVX2(const double *xm, const double *ym, const double *x,
+                        double a, double *y, unsigned n)
+{
+    __m256d va = _mm256_set1_pd(a);
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d d = _mm256_sub_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(ym + i));
+        _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(xm + i), _mm256_mul_pd(va, d)));
+    }
+    AllPassScalar(xm + i, ym + i, x + i, a, y + i, n - i);
+}
+
+MR_TARGET("avx2")
+static void AccumulateAVX2(const double *in, double *acc, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(acc + i, _mm256_add_pd(_mm256_loadu_pd(acc + i), _mm256_loadu_pd(in + i)));
+    AccumulateScalar(in + i, acc + i, n - i);
+}
+
+MR_TARGET("avx2")
+static void MixAVX2(const double *wetSig, const float *drySig, double wet, double dry,
+                    float *out, unsigned n)
+{
+    __m256d vw = _mm256_set1_pd(wet), vd = _mm256_set1_pd(dry);
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d d = _mm256_cvtps_pd(_mm_loadu_ps(drySig + i));
+        __m256d r = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(wetSig + i), vw), _mm256_mul_pd(d, vd));
+        _mm_storeu_ps(out + i, _mm256_cvtpd_ps(r));
+    }
+    MixScalar(wetSig + i, drySig + i, wet, dry, out + i, n - i);
+}
+
+MR_TARGET("avx2")
+static void ShortToFloatAVX2(const short *in, float *out, size_t n)
+{
+    __m256 scale = _mm256_set1_ps(toFloat16);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(s), scale));
+    }
+    ShortToFloatScalar(in + i, out + i, n - i);
+}
+
+MR_TARGET("avx2")
+static void FloatToShortAVX2(const float *in, short *out, size_t n)
+{
+    __m256 scale = _mm256_set1_ps(toShort16);
+    __m256 lower = _mm256_set1_ps(-1.0f), upper = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), lower), upper);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i + 8), lower), upper);
+        __m256i lo = _mm256_cvttps_epi32(_mm256_mul_ps(a, scale));
+        __m256i hi = _mm256_cvttps_epi32(_mm256_mul_ps(b, scale));
+        // packs works per 128 bit lane, restore sample order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    FloatToShortScalar(in + i, out + i, n - i);
+}
+
+MR_TARGET("avx2")
+static float PeakAbsAVX2(const float *x, size_t n)
+{
+    __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 peak = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        peak = _mm256_max_ps(peak, _mm256_and_ps(_mm256_loadu_ps(x + i), mask));
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, peak);
+    float result = PeakAbsScalar(x + i, n - i);
+    for (float f : lanes)
+        if (f > result)
+            result = f;
+    return result;
+}
+
+MR_TARGET("avx2")
+static void ScaleAVX2(float *x, size_t n, float gain)
+{
+    __m256 vg = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), vg));
+    ScaleScalar(x + i, n - i, gain);
+}
+
+// interleaved channels are gathered
+MR_TARGET("avx2")
+static void DeinterleaveAVX2(const float *in, unsigned channels, unsigned channel, float offset,
+                             float gain, float step, float *out, size_t n)
+{
+    __m256 lanes = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    __m256i index = _mm256_mullo_epi32(_mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0),
+                                       _mm256_set1_epi32(static_cast<int>(channels)));
+    __m256 vo = _mm256_set1_ps(offset), vg = _mm256_set1_ps(gain), vs = _mm256_set1_ps(step);
+    const float *src = in + channel;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = (channels == 1) ? _mm256_loadu_ps(src + i) : _mm256_i32gather_ps(src + i * channels, index, 4);
+        __m256 g = _mm256_add_ps(vg, _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lanes), vs));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_sub_ps(x, vo), g));
+    }
+    
+    DeinterleaveScalar(in + i * channels, channels, channel, offset, gain + static_cast<float>(i) * step,
+                       step, out + i, n - i);
+}
+
+MR_TARGET("avx2")
+static float DotAVX2(const float *a, const float *b, size_t n)
+{
+    __m256 sum = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, half);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + DotScalar(a + i, b + i, n - i);
+}
+
+// spans 1 and 2 in register, wider spans across registers
+MR_TARGET("avx2")
+static void HadamardAVX2(double *x, unsigned lines, unsigned frames)
+{
+    if (lines < 4) {
+        HadamardScalar(x, lines, frames);
+        return;
+    }
+    
+    __m256d scale = _mm256_set1_pd(1.0 / std::sqrt(static_cast<double>(lines)));
+    for (unsigned f = 0; f < frames; ++f, x += lines) {
+        for (unsigned i = 0; i < lines; i += 4) {
+            __m256d a = _mm256_loadu_pd(x + i);
+            __m256d t = _mm256_permute_pd(a, 0x5); // x1 x0 x3 x2
+            a = _mm256_blend_pd(_mm256_add_pd(a, t), _mm256_sub_pd(t, a), 0xA);
+            t = _mm256_permute2f128_pd(a, a, 0x01); // x2 x3 x0 x1
+            _mm256_storeu_pd(x + i, _mm256_blend_pd(_mm256_add_pd(a, t), _mm256_sub_pd(t, a), 0xC));
+        }
+        
+        for (unsigned h = 4; h < lines; h *= 2) {
+            for (unsigned i = 0; i < lines; i += 2 * h) {
+                for (unsigned j = i; j < i + h; j += 4) {
+                    __m256d a = _mm256_loadu_pd(x + j), b = _mm256_loadu_pd(x + j + h);
+                    _mm256_storeu_pd(x + j, _mm256_add_pd(a, b));
+                    _mm256_storeu_pd(x + j + h, _mm256_sub_pd(a, b));
+                }
+            }
+        }
+        
+        for (unsigned i = 0; i < lines; i += 4)
+            _mm256_storeu_pd(x + i, _mm256_mul_pd(_mm256_loadu_pd(x + i), scale));
+    }
+}
+
+// two vectors of outputs in register across all taps
+MR_TARGET("avx2")
+static void TapSumAVX2(const double *ring, const unsigned *starts, const double *gains,
+                       unsigned taps, double *out, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+        for (unsigned k = 0; k < taps; ++k) {
+            __m256d g = _mm256_set1_pd(gains[k]);
+            const double *p = ring + starts[k] + i;
+            lo = _mm256_add_pd(lo, _mm256_mul_pd(g, _mm256_loadu_pd(p)));
+            hi = _mm256_add_pd(hi, _mm256_mul_pd(g, _mm256_loadu_pd(p + 4)));
+        }
+        _mm256_storeu_pd(out + i, lo);
+        _mm256_storeu_pd(out + i + 4, hi);
+    }
+    TapSumSSE(ring + i, starts, gains, taps, out + i, n - i);
+}
+
+static const DspKernels avx2Kernels = {
+    "avx2",
+    CombFeedAVX2, AllPassAVX2, AccumulateAVX2, MixAVX2,
+    ShortToFloatAVX2, FloatToShortAVX2, PeakAbsAVX2, ScaleAVX2,
+    DeinterleaveAVX2, DotAVX2, HadamardAVX2, TapSumAVX2
+};
+
+//==============================================================================
+// AVX-512 (8 doubles / 16 floats)
+
+MR_TARGET("avx512f")
+static void CombFeedAVX512(const double *xl, const double *xl1, const double *yl,
+                           double g, double R, double *v, unsigned n)
+{
+    __m512d vg = _mm512_set1_pd(g), vR = _mm512_set1_pd(R);
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d t = _mm512_sub_pd(_mm512_loadu_pd(xl + i), _mm512_mul_pd(vg, _mm512_loadu_pd(xl1 + i)));
+        _mm512_storeu_pd(v + i, _mm512_add_pd(t, _mm512_mul_pd(vR, _mm512_loadu_pd(yl + i))));
+    }
+    CombFeedScalar(xl + i, xl1 + i, yl + i, g, R, v + i, n - i);
+}
+
+MR_TARGET("avx512f")
+static void AllPassAVX512(const double *xm, const double *ym, const double *x,
+                          double a, double *y, unsigned n)
+{
+    __m512d va = _mm512_set1_pd(a);
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d d = _mm512_sub_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(ym + i));
+        _mm512_storeu_pd(y + i, _mm512_add_pd(_mm512_loadu_pd(xm + i), _mm512_mul_pd(va, d)));
+    }
+    AllPassScalar(xm + i, ym + i, x + i, a, y + i, n - i);
+}
+
+MR_TARGET("avx512f")
+static void AccumulateAVX512(const double *in, double *acc, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm512_storeu_pd(acc + i, _mm512_add_pd(_mm512_loadu_pd(acc + i), _mm512_loadu_pd(in + i)));
+    AccumulateScalar(in + i, acc + i, n - i);
+}
+
+MR_TARGET("avx512f")
+static void MixAVX512(const double *wetSig, const float *drySig, double wet, double dry,
+                      float *out, unsigned n)
+{
+    __m512d vw = _mm512_set1_pd(wet), vd = _mm512_set1_pd(dry);
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d d = _mm512_cvtps_pd(_mm256_loadu_ps(drySig + i));
+        __m512d r = _mm512_add_pd(_mm512_mul_pd(_mm512_loadu_pd(wetSig + i), vw), _mm512_mul_pd(d, vd));
+        _mm256_storeu_ps(out + i, _mm512_cvtpd_ps(r));
+    }
+    MixScalar(wetSig + i, drySig + i, wet, dry, out + i, n - i);
+}
+
+MR_TARGET("avx512f")
+static void ShortToFloatAVX512(const short *in, float *out, size_t n)
+{
+    __m512 scale = _mm512_set1_ps(toFloat16);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i s = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)));
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(s), scale));
+    }
+    ShortToFloatScalar(in + i, out + i, n - i);
+}
+
+MR_TARGET("avx512f")
+static void FloatToShortAVX512(const float *in, short *out, size_t n)
+{
+    __m512 scale = _mm512_set1_ps(toShort16);
+    __m512 lower = _mm512_set1_ps(-1.0f), upper = _mm512_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 x = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(in + i), lower), upper);
+        __m512i s = _mm512_cvttps_epi32(_mm512_mul_ps(x, scale));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm512_cvtsepi32_epi16(s));
+    }
+    FloatToShortScalar(in + i, out + i, n - i);
+}
+
+MR_TARGET("avx512f")
+static float PeakAbsAVX512(const float *x, size_t n)
+{
+    __m512 peak = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        peak = _mm512_max_ps(peak, _mm512_abs_ps(_mm512_loadu_ps(x + i)));
+
+    float result = _mm512_reduce_max_ps(peak);
+    float rest = PeakAbsScalar(x + i, n - i);
+    return rest > result ? rest : result;
+}
+
+MR_TARGET("avx512f")
+static void ScaleAVX512(float *x, size_t n, float gain)
+{
+    __m512 vg = _mm512_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(x + i, _mm512_mul_ps(_mm512_loadu_ps(x + i), vg));
+    ScaleScalar(x + i, n - i, gain);
+}
+
+MR_TARGET("avx512f")
+static void DeinterleaveAVX512(const float *in, unsigned channels, unsigned channel, float offset,
+                               float gain, float step, float *out, size_t n)
+{
+    __m512 lanes = _mm512_set_ps(15.0f, 14.0f, 13.0f, 12.0f, 11.0f, 10.0f, 9.0f, 8.0f,
+                                 7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    __m512i index = _mm512_mullo_epi32(_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+                                       _mm512_set1_epi32(static_cast<int>(channels)));
+    __m512 vo = _mm512_set1_ps(offset), vg = _mm512_set1_ps(gain), vs = _mm512_set1_ps(step);
+    const float *src = in + channel;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 x = (channels == 1) ? _mm512_loadu_ps(src + i) : _mm512_i32gather_ps(index, src + i * channels, 4);
+        __m512 g = _mm512_add_ps(vg, _mm512_mul_ps(_mm512_add_ps(_mm512_set1_ps(static_cast<float>(i)), lanes), vs));
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_sub_ps(x, vo), g));
+    }
+    
+    DeinterleaveScalar(in + i * channels, channels, channel, offset, gain + static_cast<float>(i) * step,
+                       step, out + i, n - i);
+}
+
+MR_TARGET("avx512f")
+static float DotAVX512(const float *a, const float *b, size_t n)
+{
+    __m512 sum = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+
+    return _mm512_reduce_add_ps(sum) + DotScalar(a + i, b + i, n - i);
+}
+
+// spans 1, 2 and 4 in register, wider spans across registers
+MR_TARGET("avx512f")
+static void HadamardAVX512(double *x, unsigned lines, unsigned frames)
+{
+    if (lines < 8) {
+        HadamardAVX2(x, lines, frames);
+        return;
+    }
+    
+    __m512d scale = _mm512_set1_pd(1.0 / std::sqrt(static_cast<double>(lines)));
+    for (unsigned f = 0; f < frames; ++f, x += lines) {
+        for (unsigned i = 0; i < lines; i += 8) {
+            __m512d a = _mm512_loadu_pd(x + i);
+            __m512d t = _mm512_permute_pd(a, 0x55); // swap neighbours
+            a = _mm512_mask_blend_pd(0xAA, _mm512_add_pd(a, t), _mm512_sub_pd(t, a));
+            t = _mm512_permutex_pd(a, _MM_SHUFFLE(1, 0, 3, 2)); // swap pairs
+            a = _mm512_mask_blend_pd(0xCC, _mm512_add_pd(a, t), _mm512_sub_pd(t, a));
+            t = _mm512_shuffle_f64x2(a, a, _MM_SHUFFLE(1, 0, 3, 2)); // swap halves
+            _mm512_storeu_pd(x + i, _mm512_mask_blend_pd(0xF0, _mm512_add_pd(a, t), _mm512_sub_pd(t, a)));
+        }
+        
+        for (unsigned h = 8; h < lines; h *= 2) {
+            for (unsigned i = 0; i < lines; i += 2 * h) {
+                for (unsigned j = i; j < i + h; j += 8) {
+                    __m512d a = _mm512_loadu_pd(x + j), b = _mm512_loadu_pd(x + j + h);
+                    _mm512_storeu_pd(x + j, _mm512_add_pd(a, b));
+                    _mm512_storeu_pd(x + j + h, _mm512_sub_pd(a, b));
+                }
+            }
+        }
+        
+        for (unsigned i = 0; i < lines; i += 8)
+            _mm512_storeu_pd(x + i, _mm512_mul_pd(_mm512_loadu_pd(x + i), scale));
+    }
+}
+
+// two vectors of outputs in register across all taps
+MR_TARGET("avx512f")
+static void TapSumAVX512(const double *ring, const unsigned *starts, const double *gains,
+                         unsigned taps, double *out, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512d lo = _mm512_setzero_pd(), hi = _mm512_setzero_pd();
+        for (unsigned k = 0; k < taps; ++k) {
+            __m512d g = _mm512_set1_pd(gains[k]);
+            const double *p = ring + starts[k] + i;
+            lo = _mm512_add_pd(lo, _mm512_mul_pd(g, _mm512_loadu_pd(p)));
+            hi = _mm512_add_pd(hi, _mm512_mul_pd(g, _mm512_loadu_pd(p + 8)));
+        }
+        _mm512_storeu_pd(out + i, lo);
+        _mm512_storeu_pd(out + i + 8, hi);
+    }
+    TapSumAVX2(ring + i, starts, gains, taps, out + i, n - i);
+}
+
+static const DspKernels avx512Kernels = {
+    "avx512",
+    CombFeedAVX512, AllPassAVX512, AccumulateAVX512, MixAVX512,
+    ShortToFloatAVX512, FloatToShortAVX512, PeakAbsAVX512, ScaleAVX512,
+    DeinterleaveAVX512, DotAVX512, HadamardAVX512, TapSumAVX512
+};
+
+//==============================================================================
+// CPU Detection
+
+static void CpuId(unsigned leaf, unsigned sub, unsigned regs[4])
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuidex(r, static_cast<int>(leaf), static_cast<int>(sub));
+    for (int i = 0; i < 4; ++i)
+        regs[i] = static_cast<unsigned>(r[i]);
+#else
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// returns os enabled register state (XCR0)
+static unsigned long long XGetBV()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+}
+
+// returns kernel sets this cpu and os support, best last
+static vector<const DspKernels*> SupportedKernels()
+{
+    vector<const DspKernels*> sets(1, &scalarKernels);
+
+    unsigned regs[4];
+    CpuId(0, 0, regs);
+    unsigned maxLeaf = regs[0];
+
+    CpuId(1, 0, regs);
+    bool sse42 = (regs[2] & (1u << 20)) != 0;
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool avx = (regs[2] & (1u << 28)) != 0;
+
+    if (!sse42)
+        return sets;
+    sets.push_back(&sseKernels);
+
+    if (!osxsave || !avx || maxLeaf < 7)
+        return sets;
+
+    unsigned long long xcr0 = XGetBV();
+    CpuId(7, 0, regs);
+    bool avx2 = (regs[1] & (1u << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    bool avx512 = (regs[1] & (1u << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+
+    if (avx2)
+        sets.push_back(&avx2Kernels);
+    if (avx2 && avx512)
+        sets.push_back(&avx512Kernels);
+
+    return sets;
+}
+#else
+static vector<const DspKernels*> SupportedKernels()
+{
+    return vector<const DspKernels*>(1, &scalarKernels);
+}
+#endif
+
+//==============================================================================
+// Selection
+
+static const DspKernels * SelectKernels()
+{
+    vector<const DspKernels*> sets = SupportedKernels();
+
+    // testing override, ignored if this cpu can't run it
+    if (const char *forced = getenv("MOORER_KERNEL")) {
+        for (const DspKernels *k : sets)
+            if (strcmp(k->name, forced) == 0)
+                return k;
+    }
+
+    return sets.back();
+}
+
+const DspKernels & GetKernels()
+{
+    static const DspKernels *kernels = SelectKernels();
+    return *kernels;
+}
+
+std::string BenchmarkKernels()
+{
+    const unsigned n = 4096;   // samples per pass
+    const unsigned passes = 2000;
+
+    vector<double> a(n), b(n), c(n), d(n);
+    vector<float> f(n), e(n);
+    vector<short> s(n);
+    for (unsigned i = 0; i < n; ++i) {
+        a[i] = b[i] = c[i] = (i % 97) / 97.0 - 0.5;
+        f[i] = static_cast<float>(a[i]);
+    }
+
+    const unsigned taps[4] = { 0, 7, 31, 64 };
+    const double gains[4] = { 0.8, 0.5, 0.3, 0.2 };
+
+    ostringstream report;
+    report << "kernel    ns/sample\n";
+
+    for (const DspKernels *k : SupportedKernels()) {
+        auto start = chrono::steady_clock::now();
+        for (unsigned p = 0; p < passes; ++p) {
+            k->CombFeed(a.data(), b.data(), c.data(), 0.5, 0.4, d.data(), n);
+            k->AllPass(a.data(), b.data(), d.data(), 0.7, c.data(), n);
+            k->Accumulate(c.data(), d.data(), n);
+            k->Mix(d.data(), f.data(), 0.1, 0.9, f.data(), n);
+            k->FloatToShort(f.data(), s.data(), n);
+            k->ShortToFloat(s.data(), f.data(), n);
+            k->Scale(f.data(), n, 1.0f / (1.0f + k->PeakAbs(f.data(), n)));
+            k->Deinterleave(f.data(), 2, 1, 0.0f, 1.0f, 0.0f, e.data(), n / 2);
+            e[0] = k->Dot(f.data(), e.data(), n);
+            k->Hadamard(a.data(), 16, n / 16);
+            k->TapSum(b.data(), taps, gains, 4, d.data(), n - 64);
+        }
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+
+        report << (k == &GetKernels() ? "* " : "  ");
+        report.width(8);
+        report << left << k->name << elapsed.count() / (double(n) * passes) << "\n";
+    }
+
+    report << "selected: " << GetKernels().name << "\n";
+    return report.str();
+}
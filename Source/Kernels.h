@@ -0,0 +1,58 @@
+// Kernels.h
+// Spring 2021
+
+#pragma once
+#include <cstddef> // size_t
+#include <string>  // std::string
+
+// DSP kernel table, one per instruction set (scalar, sse4.2, avx2, avx512)
+// buffers passed to a kernel must not overlap unless noted
+struct DspKernels
+{
+    const char *name; // instruction set name
+
+    // comb feed-forward terms: v = xl - g * xl1 + R * yl
+    void (*CombFeed)(const double *xl, const double *xl1, const double *yl,
+                     double g, double R, double *v, unsigned n);
+
+    // allpass: y = xm + a * (x - ym)
+    void (*AllPass)(const double *xm, const double *ym, const double *x,
+                    double a, double *y, unsigned n);
+
+    // acc += in
+    void (*Accumulate)(const double *in, double *acc, unsigned n);
+
+    // out = wetSig * wet + drySig * dry (out may equal drySig)
+    void (*Mix)(const double *wetSig, const float *drySig, double wet, double dry,
+                float *out, unsigned n);
+
+    // 16 bit pcm <-> float conversion, floats clipped to [-1, 1]
+    void (*ShortToFloat)(const short *in, float *out, size_t n);
+    void (*FloatToShort)(const float *in, short *out, size_t n);
+
+    // normalize helpers
+    float (*PeakAbs)(const float *x, size_t n);        // returns max |x|
+    void (*Scale)(float *x, size_t n, float gain);     // x *= gain
+
+    // playback: out[i] = (in[i * channels + channel] - offset) * (gain + i * step)
+    void (*Deinterleave)(const float *in, unsigned channels, unsigned channel, float offset,
+                         float gain, float step, float *out, size_t n);
+
+    // resampler filter: returns sum of a[i] * b[i]
+    float (*Dot)(const float *a, const float *b, size_t n);
+
+    // fdn feedback matrix: normalized walsh-hadamard transform of each of frames
+    // rows of lines values, in place (lines a power of two)
+    void (*Hadamard)(double *x, unsigned lines, unsigned frames);
+
+    // multi-tap delay: out[i] = sum over taps k of gains[k] * ring[starts[k] + i]
+    void (*TapSum)(const double *ring, const unsigned *starts, const double *gains,
+                   unsigned taps, double *out, unsigned n);
+};
+
+// returns the best kernels for this cpu, chosen once on first call
+// MOORER_KERNEL=scalar|sse4.2|avx2|avx512 overrides the choice for testing
+const DspKernels & GetKernels();
+
+// times every kernel set this cpu supports and reports the chosen one
+std::string BenchmarkKernels();
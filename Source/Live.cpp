@@ -0,0 +1,260 @@
+// Live.cpp
+// Spring 2021
+
+#include "Live.h"
+#include <cmath>   // std::abs
+#include <cstring> // std::memcpy, std::memset
+
+constexpr float LiveProcessor::ProbeThreshold;
+
+const unsigned LiveProcessor::FadeFrames;
+const unsigned LiveProcessor::Combs;
+
+LiveProcessor::LiveProcessor() :
+current(nullptr), fading(nullptr), faded(0), pending(nullptr), retired(nullptr), built(), builtRate(0), builtChannels(0), fresh(true),
+posted(), version(0), applied(0), probe(0), elapsed(0), latency(Idle)
+{
+}
+
+LiveProcessor::~LiveProcessor()
+{
+    delete current;
+    delete fading;
+    delete pending.exchange(nullptr);
+    delete retired.exchange(nullptr);
+}
+
+// coefficients alone keep the chain, SetCoefficients changes them in place
+void LiveProcessor::SetReverb(const Reverb &reverb, unsigned rate, unsigned channels)
+{
+    channels = channels ? channels : 1;
+    if (!fresh && rate == builtRate && channels == builtChannels && SameLines(reverb, built))
+        return;
+    
+    Chain *chain = new Chain;
+    chain->rate = rate;
+    chain->carry = !fresh;
+    chain->revs.assign(channels, reverb);
+    for (Reverb &r : chain->revs) {
+        r.SetSamplingRate(rate);
+        r.Reset();
+    }
+    
+    built = reverb;
+    builtRate = rate;
+    builtChannels = channels;
+    fresh = false;
+    
+    // a chain the audio thread hasn't picked up yet is never used
+    delete pending.exchange(chain);
+}
+
+void LiveProcessor::Flush()
+{
+    fresh = true;
+}
+
+// delays in ms, the rate is compared by the caller
+bool LiveProcessor::SameLines(const Reverb &a, const Reverb &b)
+{
+    if (a.GetNumCombs() != b.GetNumCombs() || a.GetAllPassDelayMs() != b.GetAllPassDelayMs() ||
+        a.GetEarlyReflections() != b.GetEarlyReflections())
+        return false;
+    for (unsigned i = 0; i < a.GetNumCombs(); ++i)
+        if (a.GetCombDelayMs(i) != b.GetCombDelayMs(i))
+            return false;
+    if (!a.GetEarlyReflections())
+        return true;
+    
+    const std::vector<EarlyReflections::Tap> &x = a.GetEarlyTaps(), &y = b.GetEarlyTaps();
+    if (x.size() != y.size())
+        return false;
+    for (size_t i = 0; i < x.size(); ++i)
+        if (x[i].ms != y[i].ms || x[i].gain != y[i].gain)
+            return false;
+    return true;
+}
+
+// each value is its own atomic, a block may see part of a post and the rest with the next
+void LiveProcessor::SetCoefficients(const Reverb &reverb)
+{
+    posted.dry.store(reverb.GetDry(), std::memory_order_relaxed);
+    posted.a.store(reverb.GetAllPass().GetCoefficient(), std::memory_order_relaxed);
+    for (unsigned i = 0; i < Combs && i < reverb.GetNumCombs(); ++i) {
+        const Comb &c = reverb.GetComb(i);
+        posted.g[i].store(c.GetLowPassG(), std::memory_order_relaxed);
+        posted.R[i].store(c.GetGainConstant(), std::memory_order_relaxed);
+        posted.zf[i].store(c.GetZeroFreqGain(), std::memory_order_relaxed);
+    }
+    version.fetch_add(1, std::memory_order_release);
+}
+
+// plain assignments, nothing is reset or allocated
+void LiveProcessor::Apply(Chain &chain)
+{
+    double dry = posted.dry.load(std::memory_order_relaxed);
+    double a = posted.a.load(std::memory_order_relaxed);
+    double g[Combs], R[Combs], zf[Combs];
+    for (unsigned i = 0; i < Combs; ++i) {
+        g[i] = posted.g[i].load(std::memory_order_relaxed);
+        R[i] = posted.R[i].load(std::memory_order_relaxed);
+        zf[i] = posted.zf[i].load(std::memory_order_relaxed);
+    }
+    
+    for (Reverb &r : chain.revs) {
+        r.SetDry(dry);
+        r.GetAllPass().SetCoefficient(a);
+        for (unsigned i = 0; i < Combs && i < r.GetNumCombs(); ++i) {
+            Comb &c = r.GetComb(i);
+            c.SetLowPassG(g[i]);
+            c.SetGainConstant(R[i]);
+            c.SetZeroFreqGain(zf[i]);
+        }
+    }
+}
+
+void LiveProcessor::Collect()
+{
+    delete retired.exchange(nullptr);
+}
+
+void LiveProcessor::MeasureLatency()
+{
+    latency = Measuring;
+    probe = 1;
+}
+
+long LiveProcessor::Latency() const
+{
+    return latency.load(std::memory_order_acquire);
+}
+
+void LiveProcessor::Process(float *const *channels, unsigned numChannels, unsigned inputs, unsigned n)
+{
+    // swap in new lines once the last swapped out chain has faded and been freed,
+    // carrying over the old history so the tail goes on through the new delays
+    bool swapped = false;
+    if (!fading && retired.load(std::memory_order_acquire) == nullptr) {
+        if (Chain *next = pending.exchange(nullptr, std::memory_order_acq_rel)) {
+            if (current && next->carry) {
+                for (size_t j = 0; j < next->revs.size() && j < current->revs.size(); ++j)
+                    next->revs[j].SetState(current->revs[j]);
+                fading = current;
+                faded = 0;
+            }
+            else {
+                retired.store(current, std::memory_order_release);
+            }
+            current = next;
+            swapped = true;
+        }
+    }
+    
+    // coefficients in place, on both chains of a fade; a new chain takes the
+    // latest post over the values it was built with
+    unsigned posts = version.load(std::memory_order_acquire);
+    if (current && posts != 0 && (posts != applied || swapped)) {
+        Apply(*current);
+        if (fading)
+            Apply(*fading);
+        applied = posts;
+    }
+    
+    if (Probe(channels, numChannels, inputs, n))
+        return;
+    
+    if (!current || inputs == 0) {
+        for (unsigned j = 0; j < numChannels; ++j)
+            std::memset(channels[j], 0, n * sizeof(float));
+        return;
+    }
+    
+    // dry/wet mix happens inside the reverb, in place on the input
+    unsigned wet = inputs < current->revs.size() ? inputs : static_cast<unsigned>(current->revs.size());
+    wet = wet < numChannels ? wet : numChannels;
+    for (unsigned j = 0; j < wet; ++j) {
+        if (fading && j < fading->revs.size())
+            Crossfade(fading->revs[j], current->revs[j], channels[j], n);
+        else
+            current->revs[j].Process(channels[j], channels[j], n);
+    }
+    
+    if (fading) {
+        faded += n;
+        if (faded >= FadeFrames) {
+            retired.store(fading, std::memory_order_release);
+            fading = nullptr;
+        }
+    }
+    
+    // outputs without an input of their own
+    for (unsigned j = wet; j < numChannels; ++j) {
+        if (inputs == 1)
+            std::memcpy(channels[j], channels[0], n * sizeof(float));
+        else
+            std::memset(channels[j], 0, n * sizeof(float));
+    }
+}
+
+// the frames of the block still in the fade mix from into to, linearly
+void LiveProcessor::Crossfade(Reverb &from, Reverb &to, float *x, unsigned n)
+{
+    unsigned fade = FadeFrames - faded < n ? FadeFrames - faded : n;
+    float old[Reverb::BlockSize];
+    
+    for (unsigned start = 0; start < fade; start += Reverb::BlockSize) {
+        unsigned count = fade - start < Reverb::BlockSize ? fade - start : Reverb::BlockSize;
+        from.Process(x + start, old, count); // before x is overwritten
+        to.Process(x + start, x + start, count);
+        for (unsigned i = 0; i < count; ++i) {
+            double t = static_cast<double>(faded + start + i) / FadeFrames;
+            x[start + i] = static_cast<float>(old[i] * (1.0 - t) + x[start + i] * t);
+        }
+    }
+    
+    if (fade < n)
+        to.Process(x + fade, x + fade, n - fade);
+}
+
+// latency probe: click out, listen for it on the input; returns true while it owns the output
+bool LiveProcessor::Probe(float *const *channels, unsigned numChannels, unsigned inputs, unsigned n)
+{
+    int state = probe.load(std::memory_order_acquire);
+    if (state == 0)
+        return false;
+    
+    if (state == 2) {
+        // the input still holds this block's samples
+        for (unsigned j = 0; j < inputs && j < numChannels; ++j) {
+            for (unsigned i = 0; i < n; ++i) {
+                if (std::abs(channels[j][i]) > ProbeThreshold) {
+                    latency.store(static_cast<long>(elapsed + i), std::memory_order_release);
+                    probe = 0;
+                    break;
+                }
+            }
+            if (probe.load(std::memory_order_relaxed) == 0)
+                break;
+        }
+        
+        elapsed += n;
+        unsigned rate = current ? current->rate : 48000;
+        if (probe.load(std::memory_order_relaxed) == 2 && elapsed > rate) {
+            latency.store(TimedOut, std::memory_order_release);
+            probe = 0;
+        }
+    }
+    
+    for (unsigned j = 0; j < numChannels; ++j)
+        std::memset(channels[j], 0, n * sizeof(float));
+    
+    // click at the start of the block the probe starts in
+    if (state == 1) {
+        for (unsigned j = 0; j < numChannels; ++j)
+            channels[j][0] = 0.5f;
+        elapsed = n; // listening starts with the next block
+        probe = 2;
+    }
+    
+    return true;
+}
@@ -0,0 +1,76 @@
+// Live.h
+// Spring 2021
+
+#pragma once
+#include <atomic> // std::atomic
+#include <vector> // std::vector
+#include "Reverb.h" // moorer reverb filter
+
+// reverb applied to device input in the audio callback
+// the audio thread never allocates or locks: coefficients are posted through
+// atomics and set in place; delay, early reflection, rate and channel changes
+// build a new chain on the message thread, which the audio thread swaps in
+// between blocks, starting from the old chain's history and crossfading from
+// it over FadeFrames, so neither kind of change cuts the tail
+class LiveProcessor
+{
+public:
+    LiveProcessor();
+    ~LiveProcessor(); // audio must be stopped
+    
+    // message thread
+    void SetReverb(const Reverb &reverb, unsigned rate, unsigned channels); // new chain when the lines change
+    void Flush();          // the next SetReverb builds a chain that starts silent, for a new stream
+    void Collect();        // frees chains the audio thread has swapped out
+    void MeasureLatency(); // sends a click, times its return on the input (needs a loopback)
+    
+    enum { Idle = -1, Measuring = -2, TimedOut = -3 };
+    long Latency() const;  // measured round trip in samples, or one of the above
+    
+    // any one thread, lock-free: dry/wet, allpass a and comb g, R, zf of reverb
+    // apply to every later chain, in place from the next block
+    void SetCoefficients(const Reverb &reverb);
+    
+    // audio thread: reverbs the first inputs channels in place, mono input goes to every channel
+    void Process(float *const *channels, unsigned numChannels, unsigned inputs, unsigned n);
+    
+    static constexpr float ProbeThreshold = 0.1f; // input level that counts as the click
+    static const unsigned FadeFrames = 1024;      // crossfade from a swapped out chain
+    static const unsigned Combs = 6;              // comb coefficients posted
+private:
+    struct Chain
+    {
+        std::vector<Reverb> revs; // per channel
+        unsigned rate;
+        bool carry;               // starts from the chain it replaces
+    };
+    
+    struct Coefficients
+    {
+        std::atomic<double> dry, a;
+        std::atomic<double> g[Combs], R[Combs], zf[Combs];
+    };
+    
+    static bool SameLines(const Reverb &a, const Reverb &b); // same delays and early reflections
+    void Apply(Chain &chain);                                 // posted coefficients
+    void Crossfade(Reverb &from, Reverb &to, float *x, unsigned n);
+    bool Probe(float *const *channels, unsigned numChannels, unsigned inputs, unsigned n);
+    
+    Chain *current;               // audio thread
+    Chain *fading;                // swapped out, still fading (audio thread)
+    unsigned faded;               // frames of the fade done
+    std::atomic<Chain*> pending;  // set by the message thread
+    std::atomic<Chain*> retired;  // swapped out, freed by the message thread
+    
+    Reverb built;                 // lines of the last chain built (message thread)
+    unsigned builtRate, builtChannels;
+    bool fresh;                   // next chain starts silent
+    
+    Coefficients posted;
+    std::atomic<unsigned> version; // posts so far
+    unsigned applied;              // version set in the current chain (audio thread)
+    
+    std::atomic<int> probe;       // 0 idle, 1 requested, 2 listening
+    unsigned long long elapsed;   // samples since the click (audio thread)
+    std::atomic<long> latency;
+};
@@ -0,0 +1,112 @@
+// Load.cpp
+// Spring 2021
+
+#include "Load.h"
+#include "RenderCache.h" // input hash
+#include "Resample.h"    // rate conversion
+#include <stdexcept>
+
+LoadJob::LoadJob(const std::string &filename, unsigned rate) :
+filename(filename),
+rate(rate),
+sourceRate(0),
+data(),
+error(),
+hash(0),
+overview(),
+progress(0.0),
+finished(false),
+cancelled(false),
+worker()
+{
+}
+
+LoadJob::~LoadJob()
+{
+    Cancel();
+}
+
+void LoadJob::Start()
+{
+    worker = std::thread(&LoadJob::Run, this);
+}
+
+void LoadJob::Cancel()
+{
+    cancelled = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+double LoadJob::Progress() const
+{
+    return progress.load(std::memory_order_relaxed);
+}
+
+bool LoadJob::Finished() const
+{
+    return finished.load(std::memory_order_acquire);
+}
+
+bool LoadJob::Failed() const
+{
+    return Finished() && !data;
+}
+
+AudioData * LoadJob::Release()
+{
+    return Finished() ? data.release() : nullptr;
+}
+
+std::shared_ptr<const WaveOverview> LoadJob::GetOverview() const
+{
+    return std::atomic_load(&overview);
+}
+
+// reads file and converts it to the target rate, errors become the error message
+void LoadJob::Run()
+{
+    // reading is the first half of the progress when converting
+    double share = rate ? 0.5 : 1.0;
+    
+    try {
+        // a current sidecar draws the waveform while the samples load
+        const Hash64 key = WaveOverview::SidecarKey(filename, rate);
+        std::shared_ptr<WaveOverview> sidecar(new WaveOverview(0, 0));
+        if (sidecar->Load(WaveOverview::SidecarName(filename), key))
+            std::atomic_store(&overview, std::shared_ptr<const WaveOverview>(sidecar));
+        
+        data.reset(new AudioData(filename.c_str(), [this, share](double fraction) {
+            progress.store(fraction * share, std::memory_order_relaxed);
+            return !cancelled;
+        }));
+        sourceRate = data->rate();
+        
+        if (rate && data->rate() != rate) {
+            data.reset(new AudioData(Resample(*data, rate, [this](double fraction) {
+                progress.store(0.5 + fraction * 0.5, std::memory_order_relaxed);
+                return !cancelled;
+            })));
+        }
+        
+        hash = RenderCache::HashInput(*data);
+        
+        // built in parallel, or again when the sidecar doesn't match what was loaded
+        if (!overview || overview->GetFrames() != data->frames() || overview->GetChannels() != data->channels()) {
+            std::shared_ptr<WaveOverview> built(new WaveOverview(data->frames(), data->channels()));
+            built->Build(*data);
+            built->Save(WaveOverview::SidecarName(filename), key); // read-only folders just build again
+            std::atomic_store(&overview, std::shared_ptr<const WaveOverview>(built));
+        }
+    }
+    catch (const std::exception &e) {
+        data.reset();
+        error = e.what();
+    }
+    catch (...) {
+        data.reset();
+        error = "unknown error";
+    }
+    
+    finished.store(true, std::memory_order_release);
+}
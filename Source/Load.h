@@ -0,0 +1,55 @@
+// Load.h
+// Spring 2021
+
+#pragma once
+#include <atomic> // std::atomic
+#include <memory> // std::unique_ptr, std::shared_ptr
+#include <string> // std::string
+#include <thread> // std::thread
+#include "AudioData.h" // audio buffer
+#include "Hash.h"      // Hash64
+#include "Overview.h"  // waveform overview
+
+// loads a wave file on a worker thread
+// files at another rate are converted to rate (0 keeps the file's rate)
+// the waveform overview is read from a sidecar next to the file when it is
+// current, else built once loaded and saved there
+class LoadJob
+{
+public:
+    LoadJob(const std::string &filename, unsigned rate = 0);
+    ~LoadJob(); // cancels load
+    
+    void Start();  // start worker thread
+    void Cancel(); // stop an unfinished load and wait for the worker
+    
+    double Progress() const; // fraction of data read and converted [0,1]
+    bool Finished() const;   // worker done, loaded or failed
+    bool Failed() const;     // finished with an error (or cancelled)
+    
+    // valid once finished
+    const std::string & GetError() const { return error; }
+    Hash64 GetHash() const { return hash; } // input identity for the render cache
+    unsigned GetSourceRate() const { return sourceRate; } // file's rate before conversion
+    AudioData * Release(); // loaded audio, caller takes ownership
+    
+    // overview of the converted audio, nullptr until ready; a sidecar makes it
+    // ready as the load starts
+    std::shared_ptr<const WaveOverview> GetOverview() const;
+private:
+    void Run(); // worker thread
+    
+    std::string filename;
+    unsigned rate;       // target rate
+    unsigned sourceRate; // file rate
+    std::unique_ptr<AudioData> data;
+    std::string error;
+    Hash64 hash;
+    std::shared_ptr<const WaveOverview> overview; // shared with the gui, atomic_load and atomic_store
+    
+    std::atomic<double> progress;
+    std::atomic<bool> finished;
+    std::atomic<bool> cancelled;
+    
+    std::thread worker;
+};
@@ -8,6 +8,29 @@
 
 #include <JuceHeader.h>
 #include "MainComponent.h"
+#include "Kernels.h"
+#include "Convolver.h"
+#include "FileRender.h"
+#include "Automation.h"
+#include "Sweep.h"
+#include "Fit.h"
+#include "Preset.h"
+#include "Daemon.h"
+#include "Overview.h"
+#include "Capacity.h"
+#include "StereoReverb.h"
+#include "FdnReverb.h"
+#include "Multirate.h"
+#include "EarlyReflections.h"
+#include "PluginProcessor.h"
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+// set by ctrl-c or kill, ends --watch
+static std::atomic<bool> stopRequested (false);
+static void RequestStop (int) { stopRequested = true; }
 
 //==============================================================================
 class MoorerReverbApplication  : public juce::JUCEApplication
@@ -25,6 +48,287 @@ public:
     {
         // This method is where you should put your application's initialisation code..
 
+        // report dsp kernel timings and the kernel chosen for this cpu
+        if (commandLine.contains ("--kernel-bench"))
+        {
+            std::cout << BenchmarkKernels();
+            quit();
+            return;
+        }
+
+        // compare recursive and convolution render throughput
+        if (commandLine.contains ("--convolution-bench"))
+        {
+            std::cout << BenchmarkConvolution();
+            quit();
+            return;
+        }
+
+        // compare per channel and shared comb bank stereo reverbs
+        if (commandLine.contains ("--stereo-bench"))
+        {
+            std::cout << BenchmarkStereo();
+            quit();
+            return;
+        }
+
+        // compare comb bank and delay network cost and echo density
+        if (commandLine.contains ("--fdn-bench"))
+        {
+            std::cout << BenchmarkFdn();
+            quit();
+            return;
+        }
+
+        // full rate against decimated comb bank at 96 and 192 kHz
+        if (commandLine.contains ("--eco-bench"))
+        {
+            std::cout << BenchmarkMultirate();
+            quit();
+            return;
+        }
+
+        // cost of early reflection tap tables against a comb
+        if (commandLine.contains ("--early-bench"))
+        {
+            std::cout << BenchmarkEarlyReflections();
+            quit();
+            return;
+        }
+
+        // max real-time reverb instances on this machine, no audio device needed
+        // usage: --capacity [rate] [block] [target load %]
+        if (commandLine.contains ("--capacity"))
+        {
+            juce::StringArray args = juce::StringArray::fromTokens (commandLine, true);
+            int i = args.indexOf ("--capacity");
+            double rate = (i + 1 < args.size()) ? args[i + 1].getDoubleValue() : 48000.0;
+            int block = (i + 2 < args.size()) ? args[i + 2].getIntValue() : 64;
+            double target = (i + 3 < args.size()) ? args[i + 3].getDoubleValue() / 100.0 : 0.7;
+            
+            std::cout << BenchmarkCapacity (rate > 0 ? rate : 48000.0, block > 0 ? static_cast<unsigned> (block) : 64,
+                                            target > 0 ? target : 0.7);
+            quit();
+            return;
+        }
+
+        // host the plugin processor headlessly and check it against the reverb
+        if (commandLine.contains ("--plugin-check"))
+        {
+            bool passed = false;
+            std::cout << CheckPlugin (passed);
+            setApplicationReturnValue (passed ? 0 : 1);
+            quit();
+            return;
+        }
+
+        // resume a checkpointed render and compare it with the continuous one
+        if (commandLine.contains ("--checkpoint-check"))
+        {
+            bool passed = false;
+            std::cout << CheckCheckpoints (passed);
+            setApplicationReturnValue (passed ? 0 : 1);
+            quit();
+            return;
+        }
+
+        // automated renders give the same output whatever the block sizes
+        if (commandLine.contains ("--automation-check"))
+        {
+            bool passed = false;
+            std::cout << CheckAutomation (passed);
+            setApplicationReturnValue (passed ? 0 : 1);
+            quit();
+            return;
+        }
+
+        // waveform overview queries, chunked updates and sidecar against the samples
+        if (commandLine.contains ("--overview-check"))
+        {
+            bool passed = false;
+            std::cout << CheckOverview (passed);
+            setApplicationReturnValue (passed ? 0 : 1);
+            quit();
+            return;
+        }
+
+        // fit the response of known settings and compare decay times
+        if (commandLine.contains ("--fit-check"))
+        {
+            bool passed = false;
+            std::cout << CheckFit (passed);
+            setApplicationReturnValue (passed ? 0 : 1);
+            quit();
+            return;
+        }
+
+        // fit reverb parameters to a measured impulse response, saved as a preset
+        // usage: --fit ir.wav preset.txt [evaluations]
+        if (commandLine.contains ("--fit"))
+        {
+            juce::StringArray args = juce::StringArray::fromTokens (commandLine, true);
+            int i = args.indexOf ("--fit");
+            
+            if (i + 2 >= args.size())
+            {
+                std::cerr << "usage: --fit ir.wav preset.txt [evaluations]\n";
+                setApplicationReturnValue (1);
+            }
+            else
+            {
+                int evaluations = (i + 3 < args.size()) ? args[i + 3].getIntValue() : 20000;
+                
+                try
+                {
+                    AudioData ir (args[i + 1].unquoted().toRawUTF8());
+                    FitResult fit = FitReverb (ir, evaluations > 0 ? static_cast<size_t> (evaluations) : 20000);
+                    std::cout << fit.Report();
+                    
+                    if (! SavePreset (args[i + 2].unquoted().toStdString(), fit.reverb))
+                        throw std::runtime_error ("unable to write preset");
+                }
+                catch (std::exception &e)
+                {
+                    std::cerr << "fit failed: " << e.what() << "\n";
+                    setApplicationReturnValue (1);
+                }
+            }
+            
+            quit();
+            return;
+        }
+
+        // render wave files dropped into a directory until interrupted
+        // usage: --watch indir outdir [workers] [queue]
+        if (commandLine.contains ("--watch"))
+        {
+            juce::StringArray args = juce::StringArray::fromTokens (commandLine, true);
+            int i = args.indexOf ("--watch");
+            
+            if (i + 2 >= args.size())
+            {
+                std::cerr << "usage: --watch indir outdir [workers] [queue]\n";
+                setApplicationReturnValue (1);
+            }
+            else
+            {
+                RenderDaemon::Options options;
+                options.input = args[i + 1].unquoted().toStdString();
+                options.output = args[i + 2].unquoted().toStdString();
+                options.workers = (i + 3 < args.size()) ? static_cast<unsigned> (args[i + 3].getIntValue()) : 0;
+                options.capacity = (i + 4 < args.size()) ? static_cast<size_t> (args[i + 4].getIntValue()) : 16;
+                options.tail = 1000;
+                options.dB = -1.5f;
+                
+                try
+                {
+                    RenderDaemon daemon (options);
+                    std::signal (SIGINT, RequestStop);
+                    std::signal (SIGTERM, RequestStop);
+                    std::cout << "watching " << options.input << ", status in " << options.output << "/status.txt\n";
+                    daemon.Run (stopRequested);
+                    std::cout << daemon.Status();
+                }
+                catch (std::exception &e)
+                {
+                    std::cerr << "watch failed: " << e.what() << "\n";
+                    setApplicationReturnValue (1);
+                }
+            }
+            
+            quit();
+            return;
+        }
+
+        // render one input with every combination of the sweep file's values
+        // usage: --sweep in.wav sweep.txt outdir [tail ms]
+        if (commandLine.contains ("--sweep"))
+        {
+            juce::StringArray args = juce::StringArray::fromTokens (commandLine, true);
+            int i = args.indexOf ("--sweep");
+            
+            if (i + 3 >= args.size())
+            {
+                std::cerr << "usage: --sweep in.wav sweep.txt outdir [tail ms]\n";
+                setApplicationReturnValue (1);
+            }
+            else
+            {
+                unsigned tail = (i + 4 < args.size()) ? static_cast<unsigned> (args[i + 4].getIntValue()) : 1000;
+                juce::File in (args[i + 1].unquoted());
+                juce::File dir (args[i + 3].unquoted());
+                
+                try
+                {
+                    AudioData input (in.getFullPathName().toRawUTF8());
+                    
+                    // variants are built at the rate they render at
+                    Reverb base;
+                    base.SetSamplingRate (input.rate());
+                    std::vector<SweepVariant> variants = SweepVariants (base, LoadSweep (args[i + 2].unquoted().toStdString()));
+                    
+                    // outputs are numbered in sweep order, the listing gives each one's values
+                    std::vector<std::string> outputs;
+                    dir.createDirectory();
+                    for (size_t v = 0; v < variants.size(); ++v)
+                    {
+                        juce::String name = in.getFileNameWithoutExtension() + "_" + juce::String (static_cast<int> (v)).paddedLeft ('0', 3) + ".wav";
+                        outputs.push_back (dir.getChildFile (name).getFullPathName().toStdString());
+                        std::cout << name << "  " << variants[v].name << "\n";
+                    }
+                    
+                    std::cout << RenderSweep (input, variants, outputs, tail).Report();
+                }
+                catch (std::exception &e)
+                {
+                    std::cerr << "sweep failed: " << e.what() << "\n";
+                    setApplicationReturnValue (1);
+                }
+            }
+            
+            quit();
+            return;
+        }
+
+        // render a file to a file with the default reverb, in constant memory
+        // usage: --render in.wav out.wav [tail ms] [--automation lanes.txt]
+        if (commandLine.contains ("--render"))
+        {
+            juce::StringArray args = juce::StringArray::fromTokens (commandLine, true);
+            int i = args.indexOf ("--render");
+            int a = args.indexOf ("--automation");
+            
+            if (i + 2 >= args.size() || (a >= 0 && a + 1 >= args.size()))
+            {
+                std::cerr << "usage: --render in.wav out.wav [tail ms] [--automation lanes.txt]\n";
+                setApplicationReturnValue (1);
+            }
+            else
+            {
+                bool hasTail = i + 3 < args.size() && ! args[i + 3].startsWith ("--");
+                unsigned tail = hasTail ? static_cast<unsigned> (args[i + 3].getIntValue()) : 1000;
+                const char *dir = std::getenv ("MOORER_CACHE_DIR");
+                
+                try
+                {
+                    Automation automation;
+                    if (a >= 0)
+                        automation = Automation::Load (args[a + 1].unquoted().toStdString());
+                    
+                    RenderFile (args[i + 1].unquoted().toStdString(), args[i + 2].unquoted().toStdString(),
+                                Reverb(), tail, -1.5f, dir ? dir : "", nullptr, a >= 0 ? &automation : nullptr);
+                }
+                catch (std::exception &e)
+                {
+                    std::cerr << "render failed: " << e.what() << "\n";
+                    setApplicationReturnValue (1);
+                }
+            }
+            
+            quit();
+            return;
+        }
+
         mainWindow.reset (new MainWindow (getApplicationName()));
     }
 
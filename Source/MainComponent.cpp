@@ -1,7 +1,14 @@
 #include "MainComponent.h"
+#include "Kernels.h"
+#include "Preset.h"  // reverb presets
+#include <cstdlib> // std::getenv
+#include <fstream> // stats file
+
+const double checkpointSeconds = 5.0; // render checkpoint interval
+const size_t MainComponent::NoSeek;
 
 //==============================================================================
-MainComponent::MainComponent() : numCombs(6), input(nullptr), output(nullptr), data(nullptr), reverb(), playing(false), reverbOn(false), tail(1000), width(1100), height(700), sample(0), total_samples(0)
+MainComponent::MainComponent() : numCombs(6), input(nullptr), data(nullptr), render(), rendering(false), base(), resumePending(false), load(), cache(), cached(), inputOverview(), cachedOverview(), overviewWorker(), inputHash(0), renderKey(), stream(), filePath(), inputPath(), playGain(1.0f), reverb(), playing(false), reverbOn(false), convolutionOn(false), stereoOn(false), fdnOn(false), ecoOn(false), streamOn(false), liveOn(false), liveInputs(0), tail(1000), width(1100), height(700), sample(0), total_samples(0), seekTo(NoSeek), loopStart(0), loopEnd(0), loopOn(false)
 {
     // file selection component
     fileComp.reset (new juce::FilenameComponent ("fileComp",
@@ -32,6 +39,83 @@ MainComponent::MainComponent() : numCombs(6), input(nullptr), output(nullptr), d
     reverbOnOff.setBounds(600, 160, reverbOnOff.getWidth(), 30);
     reverbOnOff.changeWidthToFitText();
     
+    // convolution render on/off
+    convolutionOnOff.setButtonText("Convolution");
+    InitButton(&convolutionOnOff, cID, [this]{ UpdateToggleState(&convolutionOnOff, "convolutionOn"); });
+    convolutionOnOff.setBounds(600, 160, convolutionOnOff.getWidth(), 30);
+    convolutionOnOff.changeWidthToFitText();
+    
+    // shared comb bank stereo render on/off
+    stereoOnOff.setButtonText("True Stereo");
+    InitButton(&stereoOnOff, yID, [this]{ UpdateToggleState(&stereoOnOff, "stereoOn"); });
+    stereoOnOff.setBounds(600, 160, stereoOnOff.getWidth(), 30);
+    stereoOnOff.changeWidthToFitText();
+    
+    // feedback delay network render on/off
+    fdnOnOff.setButtonText("FDN");
+    InitButton(&fdnOnOff, fID, [this]{ UpdateToggleState(&fdnOnOff, "fdnOn"); });
+    fdnOnOff.setBounds(600, 160, fdnOnOff.getWidth(), 30);
+    fdnOnOff.changeWidthToFitText();
+    
+    // decimated comb bank render on/off
+    ecoOnOff.setButtonText("Eco");
+    InitButton(&ecoOnOff, oID, [this]{ UpdateToggleState(&ecoOnOff, "ecoOn"); });
+    ecoOnOff.setBounds(600, 160, ecoOnOff.getWidth(), 30);
+    ecoOnOff.changeWidthToFitText();
+    
+    // early reflections on/off
+    earlyOnOff.setButtonText("Early Reflections");
+    InitButton(&earlyOnOff, eID, [this]{ UpdateToggleState(&earlyOnOff, "earlyOn"); });
+    earlyOnOff.setBounds(600, 160, earlyOnOff.getWidth(), 30);
+    earlyOnOff.changeWidthToFitText();
+    
+    // disk streaming on/off
+    streamOnOff.setButtonText("Stream From Disk");
+    InitButton(&streamOnOff, sID, [this]{ UpdateToggleState(&streamOnOff, "streamOn"); });
+    streamOnOff.setBounds(600, 160, streamOnOff.getWidth(), 30);
+    streamOnOff.changeWidthToFitText();
+    
+    // live input
+    liveOnOff.setButtonText("Live Input");
+    InitButton(&liveOnOff, lID, [this]{ UpdateToggleState(&liveOnOff, "liveOn"); });
+    liveOnOff.setBounds(600, 160, liveOnOff.getWidth(), 30);
+    liveOnOff.changeWidthToFitText();
+    
+    for (int size : { 32, 64, 128, 256 })
+        liveBlock.addItem(juce::String(size) + " samples", size);
+    liveBlock.setSelectedId(64, juce::dontSendNotification);
+    liveBlock.onChange = [this]{ if (liveOn) SetLive(true); };
+    addAndMakeVisible(liveBlock);
+    
+    measure.setButtonText("Measure Latency");
+    measure.onClick = [this]{ if (liveOn) live.MeasureLatency(); };
+    addAndMakeVisible(measure);
+    addAndMakeVisible(latencyLabel);
+    
+    // playhead and loop region
+    position.setSliderStyle(juce::Slider::ThreeValueHorizontal);
+    position.setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+    position.setRange(0.0, 1.0);
+    position.setMinAndMaxValues(0.0, 1.0, juce::dontSendNotification);
+    position.setValue(0.0, juce::dontSendNotification);
+    position.onValueChange = [this]{ PositionChanged(); };
+    addAndMakeVisible(position);
+    
+    loopOnOff.setButtonText("Loop");
+    InitButton(&loopOnOff, rID, [this]{ UpdateToggleState(&loopOnOff, "loopOn"); });
+    loopOnOff.setBounds(600, 160, loopOnOff.getWidth(), 30);
+    loopOnOff.changeWidthToFitText();
+    
+    // dsp load meter and stats file
+    loadMeter.setFont(juce::Font(13.0f));
+    addAndMakeVisible(loadMeter);
+    statsDump.setButtonText("Save Stats");
+    statsDump.onClick = [this]{ DumpStats(); };
+    addAndMakeVisible(statsDump);
+    presetLoad.setButtonText("Load Preset");
+    presetLoad.onClick = [this]{ LoadPresetClicked(); };
+    addAndMakeVisible(presetLoad);
+    
     // parameter header
     paramHeader.setFont(juce::Font (26.0f, juce::Font::bold | juce::Font::underlined));
     paramHeader.setText("Reverb Parameters", juce::dontSendNotification);
@@ -40,7 +124,7 @@ MainComponent::MainComponent() : numCombs(6), input(nullptr), output(nullptr), d
     // general parameters
     InitHeader(&ratioHeader, "Dry/Wet Ratio");
     drySlider.label.setText("K", juce::dontSendNotification);
-    drySlider.slider.onValueChange = [this] {reverb.SetDryPercetage(drySlider.slider.getValue());
+    drySlider.slider.onValueChange = [this] {reverb.SetDryPercetage(drySlider.slider.getValue()); ParametersChanged();
         wetSlider.slider.setValue(100 - drySlider.slider.getValue(), juce::dontSendNotification); };
     InitSlider(&drySlider.slider, &drySlider.label, 0, 100, 90, "%", 0, 1);
     
@@ -53,11 +137,11 @@ MainComponent::MainComponent() : numCombs(6), input(nullptr), output(nullptr), d
     
     aSlider.label.setText("a", juce::dontSendNotification);
     InitSlider(&aSlider.slider, &aSlider.label, 0, 1, reverb.GetAllPassCoeff(), "", 2);
-    aSlider.slider.onValueChange = [this] {reverb.SetAllPassCoeff(aSlider.slider.getValue()); };
+    aSlider.slider.onValueChange = [this] {reverb.SetAllPassCoeff(aSlider.slider.getValue()); ParametersChanged(); };
     
     mSlider.label.setText("m", juce::dontSendNotification);
     InitSlider(&mSlider.slider, &mSlider.label, 0, 100, reverb.GetAllPassDelay(), "ms", 0, 1);
-    mSlider.slider.onValueChange = [this] {reverb.SetAllPassDelay(mSlider.slider.getValue()); };
+    mSlider.slider.onValueChange = [this] {reverb.SetAllPassDelay(mSlider.slider.getValue()); ParametersChanged(); };
 
     
     // comb filter parameters
@@ -70,22 +154,22 @@ MainComponent::MainComponent() : numCombs(6), input(nullptr), output(nullptr), d
         // L value sliders
         group->L.label.setText("L", juce::dontSendNotification);
         InitSlider(&group->L.slider, &group->L.label, 0, 100, reverb.GetCombDelay(i), "ms", 0, 1);
-        group->L.slider.onValueChange = [this, group] {reverb.SetCombDelay(group->L.slider.getValue(), group->ID);};
+        group->L.slider.onValueChange = [this, group] {reverb.SetCombDelay(group->L.slider.getValue(), group->ID); ParametersChanged();};
         
         // g value sliders
         group->G.label.setText("g", juce::dontSendNotification);
         InitSlider(&group->G.slider, &group->G.label, 0, .99, reverb.GetCombLowPassCoeff(i), "", 4);
-        group->G.slider.onValueChange = [this, group] {reverb.SetCombLowPassCoeff(group->G.slider.getValue(), group->ID); UpdateSliderGroup(group);};
+        group->G.slider.onValueChange = [this, group] {reverb.SetCombLowPassCoeff(group->G.slider.getValue(), group->ID); UpdateSliderGroup(group); ParametersChanged();};
         
         // R value sliders
         group->R.label.setText("R", juce::dontSendNotification);
         InitSlider(&group->R.slider, &group->R.label, 0, .99, reverb.GetCombGainConstant(i), "", 4);
-        group->R.slider.onValueChange = [this, group] {reverb.SetCombGainConstant(group->R.slider.getValue(), group->ID); UpdateSliderGroup(group);};
+        group->R.slider.onValueChange = [this, group] {reverb.SetCombGainConstant(group->R.slider.getValue(), group->ID); UpdateSliderGroup(group); ParametersChanged();};
         
         // ZF value sliders
         group->ZF.label.setText("R/(1-g)", juce::dontSendNotification);
         InitSlider(&group->ZF.slider, &group->ZF.label, 0, 0.99, reverb.GetCombZeroFreqGain(i), "", 2, 0.01f);
-        group->ZF.slider.onValueChange = [this, group] {reverb.SetCombZeroFreqGain(group->ZF.slider.getValue(), group->ID); UpdateSliderGroup(group);};
+        group->ZF.slider.onValueChange = [this, group] {reverb.SetCombZeroFreqGain(group->ZF.slider.getValue(), group->ID); UpdateSliderGroup(group); ParametersChanged();};
         
         combGroups.push_back(group);
     }
@@ -107,9 +191,14 @@ MainComponent::MainComponent() : numCombs(6), input(nullptr), output(nullptr), d
         setAudioChannels (0, 2);
     }
     
-    // want to be able to specify sampling rate
-    setup = deviceManager.getAudioDeviceSetup();
-    deviceManager.setAudioDeviceSetup(setup, true);
+    // render cache settings
+    if (const char *mb = std::getenv("MOORER_CACHE_MB"))
+        cache.SetBudget(static_cast<size_t>(std::atoll(mb)) << 20);
+    if (const char *dir = std::getenv("MOORER_CACHE_DIR"))
+        cache.SetDirectory(dir);
+    
+    // progress and meter updates
+    startTimerHz(10);
 }
 
 MainComponent::~MainComponent()
@@ -117,14 +206,22 @@ MainComponent::~MainComponent()
     // This shuts down the audio device and clears the audio source.
     shutdownAudio();
     
+    // keep stats of the session for post-mortem analysis
+    if (const char *fname = std::getenv("MOORER_STATS_FILE"))
+        DumpStats(fname);
+    
+    // stop load, render and stream before their data goes away
+    load.reset();
+    render.reset();
+    base.reset();
+    stream.reset();
+    if (overviewWorker.joinable())
+        overviewWorker.join();
+    
     if (input) {
         delete input;
         input = nullptr;
     }
-    if (output) {
-        delete output;
-        output = nullptr;
-    }
     
     for (CombSliderGroup * csg : combGroups) {
         delete csg;
@@ -144,17 +241,52 @@ void MainComponent::prepareToPlay (int samplesPerBlockExpected, double sampleRat
     // For more details, see the help for AudioProcessor::prepareToPlay()
     playing = false;
     data = nullptr;
+    callbackStats.Prepare(sampleRate, static_cast<unsigned>(samplesPerBlockExpected));
 }
 
 void MainComponent::getNextAudioBlock (const juce::AudioSourceChannelInfo& bufferToFill)
 {
+    DspStats::Scope timing(callbackStats, static_cast<unsigned>(bufferToFill.numSamples));
+    
+    // live input, processed in place in the device buffer
+    if (liveOn) {
+        const int maxChannels = 32;
+        float *channels[maxChannels];
+        int nChannels = juce::jmin(bufferToFill.buffer->getNumChannels(), maxChannels);
+        for (int j = 0; j < nChannels; ++j)
+            channels[j] = bufferToFill.buffer->getWritePointer(j, bufferToFill.startSample);
+        
+        live.Process(channels, nChannels, liveInputs, bufferToFill.numSamples);
+        return;
+    }
+    
     // Right now we are not producing any data, in which case we need to clear the buffer
     // (to prevent the output of random noise)
     if (!playing) {
         bufferToFill.clearActiveBufferRegion();
         return;
     }
-    else if (sample >= total_samples) {
+    
+    // disk stream, the prefetch thread keeps the ring buffer filled
+    if (stream) {
+        const int maxOutputs = 32;
+        float *outputs[maxOutputs];
+        int nOutputs = juce::jmin(bufferToFill.buffer->getNumChannels(), maxOutputs);
+        for (int j = 0; j < nOutputs; ++j)
+            outputs[j] = bufferToFill.buffer->getWritePointer(j, bufferToFill.startSample);
+        
+        stream->Read(outputs, nOutputs, bufferToFill.numSamples);
+        if (stream->Finished())
+            playing = false;
+        return;
+    }
+    
+    // seek requested by the position slider
+    size_t target = seekTo.exchange(NoSeek);
+    if (target != NoSeek)
+        sample = juce::jmin(target, total_samples);
+    
+    if (sample >= total_samples) {
         playing = false;
         data = nullptr;
         bufferToFill.clearActiveBufferRegion();
@@ -163,23 +295,66 @@ void MainComponent::getNextAudioBlock (const juce::AudioSourceChannelInfo& buffe
     
     int nChannels = bufferToFill.buffer->getNumChannels();
     int nSamples = bufferToFill.numSamples;
-
-    int hold = sample;
+    unsigned srcChannels = data->channels();
+    
+    size_t available = total_samples;
+    float gain = 1.0f;
+    
+    // rendered output, never play past the renderer
+    if (render) {
+        if (render->Cancelled()) {
+            playing = false;
+            data = nullptr;
+            bufferToFill.clearActiveBufferRegion();
+            return;
+        }
+        
+        available = render->Rendered();
+        gain = render->Gain();
+    }
     
-    // send filtered signal to output
-    for (int j = 0; j < nChannels; ++j) {
-        auto* buffer = bufferToFill.buffer->getWritePointer(j, bufferToFill.startSample);
-        sample = hold;
+    // glide toward a changed gain (exact normalization replacing the prediction)
+    float startGain = playGain;
+    playGain += (gain - playGain) * 0.1f;
+    float gainStep = (playGain - startGain) / nSamples;
+    
+    // inside the loop region, playback wraps from its end to its start
+    const size_t start = loopStart, end = loopEnd;
+    const bool looping = loopOn && end > start && sample >= start && sample < end;
+    const DspKernels &k = GetKernels();
+    
+    // frames to copy this block, the rest is silence (end of file or renderer)
+    size_t done = 0;
+    while (done < static_cast<size_t>(nSamples)) {
+        size_t last = looping ? juce::jmin(available, end) : available;
+        size_t n = (last > sample) ? juce::jmin(last - sample, nSamples - done) : 0;
+        if (n == 0)
+            break;
         
-        for (int i = 0; i < nSamples; ++i, ++sample) {
-            if (sample >= total_samples) {
-                buffer[i] = 0.0;
-                continue;
+        // mono plays on every output, otherwise source channel j goes to output j
+        const float *frames = data->data() + sample * srcChannels;
+        for (int j = 0; j < nChannels; ++j) {
+            float *out = bufferToFill.buffer->getWritePointer(j, bufferToFill.startSample) + done;
+            
+            if (srcChannels == 1 || j < static_cast<int>(srcChannels)) {
+                unsigned c = (srcChannels == 1) ? 0 : static_cast<unsigned>(j);
+                float offset = render ? render->Offset(c) : 0.0f;
+                k.Deinterleave(frames, srcChannels, c, offset, startGain + done * gainStep, gainStep, out, n);
             }
-            buffer[i] = data->sample(sample);
+            else
+                juce::FloatVectorOperations::clear(out, static_cast<int>(n));
         }
         
+        sample += n;
+        done += n;
+        if (!looping || sample < end)
+            break;
+        sample = start;
     }
+    
+    for (int j = 0; j < nChannels; ++j)
+        juce::FloatVectorOperations::clear(bufferToFill.buffer->getWritePointer(j, bufferToFill.startSample) + done,
+                                           nSamples - static_cast<int>(done));
 }
 
 void MainComponent::releaseResources()
@@ -197,6 +372,83 @@ void MainComponent::paint (juce::Graphics& g)
 {
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+    
+    // waveforms come from overviews only, a repaint never reads the samples;
+    // a file's sidecar shows while it loads
+    std::shared_ptr<const WaveOverview> in = inputOverview;
+    if (load && !playing)
+        if (std::shared_ptr<const WaveOverview> loading = load->GetOverview())
+            in = loading;
+    
+    const WaveOverview *out = nullptr;
+    float outGain = 1.0f;
+    if (render) {
+        out = &render->Overview();
+        outGain = render->Gain();
+    }
+    else if (cached)
+        out = cachedOverview.get();
+    else if (data && data == input)
+        out = in.get();
+    
+    g.setColour(juce::Colours::black.withAlpha(0.25f));
+    g.fillRect(waveArea);
+    
+    // zoomed to the loop region
+    double total = data ? static_cast<double>(total_samples) : (in ? static_cast<double>(in->GetFrames()) : 0.0);
+    double start = position.getMinValue() * total, end = position.getMaxValue() * total;
+    if (end <= start) {
+        start = 0.0;
+        end = total;
+    }
+    if (end <= start)
+        return;
+    
+    juce::Rectangle<int> area = waveArea;
+    juce::Rectangle<int> top = area.removeFromTop(area.getHeight() / 2);
+    if (in)
+        PaintWaveform(g, *in, top, start, end, 1.0f);
+    if (out)
+        PaintWaveform(g, *out, area, start, end, outGain);
+    
+    size_t playhead = sample;
+    if (data && playhead >= start && playhead < end) {
+        float x = waveArea.getX() + static_cast<float>((playhead - start) / (end - start) * waveArea.getWidth());
+        g.setColour(juce::Colours::orange);
+        g.drawLine(x, static_cast<float>(waveArea.getY()), x, static_cast<float>(waveArea.getBottom()));
+    }
+}
+
+// one column per pixel, peak envelope with the rms inside it, channels combined
+void MainComponent::PaintWaveform(juce::Graphics& g, const WaveOverview &overview, juce::Rectangle<int> area,
+                                  double start, double end, float gain)
+{
+    const unsigned columns = static_cast<unsigned>(juce::jmax(0, area.getWidth()));
+    const unsigned channels = overview.GetChannels();
+    if (columns == 0 || channels == 0)
+        return;
+    
+    std::vector<WaveOverview::Bucket> view(columns), other(columns);
+    overview.Query(0, start, end, view.data(), columns);
+    for (unsigned c = 1; c < channels; ++c) {
+        overview.Query(c, start, end, other.data(), columns);
+        for (unsigned i = 0; i < columns; ++i) {
+            view[i].min = juce::jmin(view[i].min, other[i].min);
+            view[i].max = juce::jmax(view[i].max, other[i].max);
+            view[i].power += other[i].power;
+        }
+    }
+    
+    const float mid = static_cast<float>(area.getCentreY()), half = area.getHeight() * 0.5f;
+    auto y = [&](float value) { return mid - juce::jlimit(-1.0f, 1.0f, value * gain) * half; };
+    for (unsigned i = 0; i < columns; ++i) {
+        int x = area.getX() + static_cast<int>(i);
+        float rms = std::sqrt(view[i].power / channels);
+        g.setColour(juce::Colours::lightblue.withAlpha(0.5f));
+        g.drawVerticalLine(x, y(view[i].max), juce::jmax(y(view[i].min), y(view[i].max) + 1.0f));
+        g.setColour(juce::Colours::lightblue);
+        g.drawVerticalLine(x, y(rms), y(-rms));
+    }
 }
 
 void MainComponent::resized()
@@ -217,8 +469,25 @@ void MainComponent::resized()
     // playback
     y += 100;
     reverbOnOff.setTopLeftPosition(x, y);
+    fdnOnOff.setTopLeftPosition(x + 120, y);
     play.setSize(95, 30);
     play.setTopLeftPosition(x, y + 40);
+    loadMeter.setBounds(x + 100, y + 40, 170, 30);
+    convolutionOnOff.setTopLeftPosition(x, y + 80);
+    stereoOnOff.setTopLeftPosition(x + 120, y + 80);
+    streamOnOff.setTopLeftPosition(x, y + 110);
+    ecoOnOff.setTopLeftPosition(x + 120, y + 110);
+    statsDump.setSize(95, 30);
+    statsDump.setTopLeftPosition(x, y + 150);
+    earlyOnOff.setTopLeftPosition(x + 110, y + 150);
+    liveOnOff.setTopLeftPosition(x, y + 190);
+    liveBlock.setBounds(x, y + 225, 95, 25);
+    measure.setBounds(x + 100, y + 225, 120, 25);
+    latencyLabel.setBounds(x, y + 255, 250, 25);
+    position.setBounds(x, y + 290, 250, 25);
+    loopOnOff.setTopLeftPosition(x, y + 320);
+    presetLoad.setBounds(x + 120, y + 320, 110, 25);
+    waveArea.setBounds(x, y + 360, 250, 120);
     
     x = 320;
     y = vert_hold;
@@ -310,12 +579,6 @@ void MainComponent::filenameComponentChanged(juce::FilenameComponent* fileCompon
 // read in a file
 void MainComponent::ReadFile(juce::File file)
 {
-    // dont read in a new file while audio is playing
-    if (playing) {
-        fileText->setText("Error: Cannot load file while audio is playing");
-        return;
-    }
-    
     // make sure file exists
     if (!file.existsAsFile()) {
         fileText->setText("Error: File does not exist");
@@ -328,22 +591,83 @@ void MainComponent::ReadFile(juce::File file)
         return;
     }
     
-    // open wav file
-    UpdateAudioData(file.getFullPathName().toStdString());
+    filePath = file.getFullPathName().toStdString();
     
+    // streamed files are only opened when played, check the header now
+    if (streamOn) {
+        try {
+            WaveFormat format = WaveReader(filePath.c_str()).GetFormat();
+            fileText->setText("Streaming: " + juce::String(format.frames / double(format.rate), 1) + " s, "
+                              + juce::String(format.channels) + " ch, " + juce::String(format.rate) + " Hz");
+        }
+        catch (std::exception &e) {
+            fileText->setText("Error: " + juce::String(e.what()));
+            filePath.clear();
+        }
+        return;
+    }
+    
+    // open wav file in the background, replacing any load in progress
+    load.reset(new LoadJob(filePath, DeviceRate()));
+    load->Start();
 }
 
-void MainComponent::UpdateAudioData(std::string filename)
+// replace input with a loaded file
+void MainComponent::UpdateAudioData(AudioData * loaded, Hash64 hash)
 {
+    // stop render before its input goes away
+    render.reset();
+    base.reset();
+    cached.reset();
+    cachedOverview.reset();
+    data = nullptr;
+    
     if (input) {
         delete input;
         input = nullptr;
     }
     
-    input = new AudioData(filename.c_str());
-    if (input == nullptr) {
-        fileText->setText("Error: File failed to load");
+    input = loaded;
+    inputHash = hash;
+}
+
+// reports load progress, returns true while still loading
+bool MainComponent::UpdateLoad()
+{
+    if (!load)
+        return false;
+    
+    if (!load->Finished()) {
+        int percent = juce::roundToInt(load->Progress() * 100.0);
+        fileText->setText("Loading: " + juce::String(percent) + "%");
+        return true;
+    }
+    
+    if (load->Failed()) {
+        fileText->setText("Error: " + juce::String(load->GetError()));
+        load.reset();
+        return false;
     }
+    
+    // current input is in use until playback stops
+    if (playing) {
+        fileText->setText("Loaded, waiting for playback to stop");
+        return true;
+    }
+    
+    UpdateAudioData(load->Release(), load->GetHash());
+    inputOverview = load->GetOverview();
+    inputPath = filePath;
+    
+    juce::String converted;
+    if (load->GetSourceRate() != input->rate())
+        converted = " (from " + juce::String(load->GetSourceRate()) + " Hz)";
+    load.reset();
+    
+    fileText->setText("Loaded: " + juce::String(input->frames() / double(input->rate()), 1) + " s, "
+                      + juce::String(input->channels()) + " ch, " + juce::String(input->rate()) + " Hz"
+                      + converted);
+    return false;
 }
 
 
@@ -403,6 +727,20 @@ void MainComponent::UpdateSliderGroup(CombSliderGroup * group)
     group->ZF.slider.setValue(reverb.GetCombZeroFreqGain(group->ID), juce::dontSendNotification);
 }
 
+// every slider from the reverb's parameters, without notifications
+void MainComponent::UpdateSliders()
+{
+    drySlider.slider.setValue(reverb.GetDryPercentage(), juce::dontSendNotification);
+    wetSlider.slider.setValue(100 - reverb.GetDryPercentage(), juce::dontSendNotification);
+    aSlider.slider.setValue(reverb.GetAllPassCoeff(), juce::dontSendNotification);
+    mSlider.slider.setValue(reverb.GetAllPassDelay(), juce::dontSendNotification);
+    for (CombSliderGroup * group : combGroups) {
+        group->L.slider.setValue(reverb.GetCombDelay(group->ID), juce::dontSendNotification);
+        UpdateSliderGroup(group);
+    }
+    earlyOnOff.setToggleState(reverb.GetEarlyReflections(), juce::dontSendNotification);
+}
+
 //==============================================================================
 // Buttons
 
@@ -420,35 +758,90 @@ void MainComponent::InitButton(juce::Button * button, int groupID, std::function
 // play was clicked
 void MainComponent::PlayClicked()
 {
+    // device output belongs to the live input
+    if (liveOn) {
+        return;
+    }
+    
+    if (streamOn) {
+        PlayStream();
+        return;
+    }
+    
     // already playing or no file loaded
     if (playing || input == nullptr) {
         return;
     }
+    stream.reset();
     
-    // update sampling rate
-    setup.sampleRate = input->rate();
-    deviceManager.setAudioDeviceSetup(setup, true);
+    // device rate changed since loading, convert again
+    if (input->rate() != DeviceRate()) {
+        if (!load)
+            ReadFile(juce::File(inputPath));
+        return;
+    }
 
     if (reverbOn) {
         // reset reverb filter
         reverb.SetSamplingRate(input->rate());
         reverb.Reset();
         
-        if (output) {
-            delete output;
-            output = nullptr;
-        }
+        // reuse an earlier render of this file with these parameters
+        render.reset();
+        base.reset();
+        renderKey = RenderCache::MakeKey(inputHash, reverb, tail, RenderMode());
+        cached = cache.Find(renderKey);
         
-        ApplyReverb();
-        data = output;
+        if (cached) {
+            data = cached.get();
+            BuildCachedOverview();
+        }
+        else {
+            // render in the background, playback follows the renderer
+            ApplyReverb();
+            data = &render->Output();
+        }
     }
     else {
+        render.reset();
+        base.reset();
+        cached.reset();
+        cachedOverview.reset();
         data = input;
     }
+    playGain = render ? render->Gain() : 1.0f;
 
     // ready to play
     sample = 0;
+    seekTo = NoSeek;
     total_samples = data->frames();
+    PositionChanged();
+    playing = true;
+}
+
+// play selected file from disk, reverb is applied as it streams
+void MainComponent::PlayStream()
+{
+    if (playing || filePath.empty()) {
+        return;
+    }
+    
+    stream.reset();
+    data = nullptr;
+    
+    try {
+        // the stream converts to the device rate, reverb runs at that rate
+        unsigned rate = DeviceRate();
+        reverb.SetSamplingRate(rate);
+        reverb.Reset();
+        stream.reset(new StreamSource(filePath, rate, reverbOn ? &reverb : nullptr, tail));
+    }
+    catch (std::exception &e) {
+        fileText->setText("Error: " + juce::String(e.what()));
+        return;
+    }
+    
+    stream->Start();
     playing = true;
 }
 
@@ -458,42 +851,323 @@ void MainComponent::UpdateToggleState(juce::Button* button, juce::String name)
         reverbOn = !reverbOn;
         reverbOnOff.setToggleState(reverbOn, juce::dontSendNotification);
     }
+    else if (reinterpret_cast<juce::ToggleButton*>(button) == &convolutionOnOff) {
+        convolutionOn = !convolutionOn;
+        convolutionOnOff.setToggleState(convolutionOn, juce::dontSendNotification);
+    }
+    else if (reinterpret_cast<juce::ToggleButton*>(button) == &stereoOnOff) {
+        stereoOn = !stereoOn;
+        stereoOnOff.setToggleState(stereoOn, juce::dontSendNotification);
+    }
+    else if (reinterpret_cast<juce::ToggleButton*>(button) == &fdnOnOff) {
+        fdnOn = !fdnOn;
+        fdnOnOff.setToggleState(fdnOn, juce::dontSendNotification);
+    }
+    else if (reinterpret_cast<juce::ToggleButton*>(button) == &ecoOnOff) {
+        ecoOn = !ecoOn;
+        ecoOnOff.setToggleState(ecoOn, juce::dontSendNotification);
+    }
+    else if (reinterpret_cast<juce::ToggleButton*>(button) == &earlyOnOff) {
+        reverb.SetEarlyReflections(!reverb.GetEarlyReflections());
+        earlyOnOff.setToggleState(reverb.GetEarlyReflections(), juce::dontSendNotification);
+        ParametersChanged();
+    }
+    else if (reinterpret_cast<juce::ToggleButton*>(button) == &streamOnOff) {
+        streamOn = !streamOn;
+        streamOnOff.setToggleState(streamOn, juce::dontSendNotification);
+        
+        // file was only checked for streaming, load it now
+        if (!streamOn && !filePath.empty() && filePath != inputPath && !load)
+            ReadFile(juce::File(filePath));
+    }
+    else if (reinterpret_cast<juce::ToggleButton*>(button) == &loopOnOff) {
+        loopOn = !loopOn;
+        loopOnOff.setToggleState(loopOn, juce::dontSendNotification);
+    }
+    else if (reinterpret_cast<juce::ToggleButton*>(button) == &liveOnOff) {
+        SetLive(!liveOn);
+    }
 }
 
 
 void MainComponent::ApplyReverb()
 {
-    unsigned rate = input->rate();
-    unsigned channels = input->channels();
-    unsigned extra = rate * tail / 1000;
+    render.reset(new RenderJob(*input, reverb, tail, -1.5, RenderMode()));
+    render->SetCheckpointInterval(checkpointSeconds);
+    render->SetNormalizedCopy(true);
+    render->Start();
+    rendering = true;
+}
+
+// cached outputs have no render to follow, summarize one in the background;
+// the worker holds its own references, it finishes even if a new play drops them
+void MainComponent::BuildCachedOverview()
+{
+    if (overviewWorker.joinable())
+        overviewWorker.join();
+    
+    std::shared_ptr<WaveOverview> overview(new WaveOverview(cached->frames(), cached->channels()));
+    std::shared_ptr<const AudioData> out = cached;
+    overviewWorker = std::thread([overview, out] { overview->Build(*out); });
+    cachedOverview = overview;
+}
 
-    // store reverb data for channels separetly
-    std::vector<Reverb> revs;
-    for (unsigned j = 0; j < channels; ++j) {
-        revs.push_back(reverb);
+// running device rate, files are converted to it
+unsigned MainComponent::DeviceRate()
+{
+    juce::AudioIODevice *device = deviceManager.getCurrentAudioDevice();
+    return device ? static_cast<unsigned>(device->getCurrentSampleRate()) : 44100;
+}
+
+// selected render mode
+RenderJob::Mode MainComponent::RenderMode()
+{
+    if (convolutionOn)
+        return RenderJob::Convolution;
+    if (fdnOn)
+        return RenderJob::Fdn;
+    if (ecoOn)
+        return RenderJob::Eco;
+    return stereoOn ? RenderJob::Stereo : RenderJob::Recursive;
+}
+
+// parameters changed, live input picks them up, an unfinished render is out of date
+// unless it resumes from a finished one, which takes the change on the next tick
+// live coefficients change in place, only new delays or early reflections build
+// a chain, which carries on from the running one
+void MainComponent::ParametersChanged()
+{
+    if (playing && (base || (render && render->Finished() && !render->Checkpoints().empty())))
+        resumePending = true;
+    else
+        CancelRender();
+    
+    if (liveOn) {
+        live.SetCoefficients(reverb);
+        live.SetReverb(reverb, DeviceRate(), liveInputs);
+    }
+}
+
+// live input: opens the device inputs at the selected block size and
+// reverbs them in the audio callback
+void MainComponent::SetLive(bool on)
+{
+    // audio thread leaves the live path while the device changes
+    liveOn = false;
+    playing = false;
+    
+    if (on && juce::RuntimePermissions::isRequired(juce::RuntimePermissions::recordAudio)
+        && !juce::RuntimePermissions::isGranted(juce::RuntimePermissions::recordAudio)) {
+        juce::RuntimePermissions::request(juce::RuntimePermissions::recordAudio,
+                                          [this](bool granted) { if (granted) SetLive(true); });
+        on = false;
     }
     
-    // output signal
-    output = new AudioData(input->frames() + extra, rate, channels);
+    if (on) {
+        setAudioChannels(2, 2);
+        
+        juce::AudioDeviceManager::AudioDeviceSetup setup = deviceManager.getAudioDeviceSetup();
+        setup.bufferSize = liveBlock.getSelectedId();
+        deviceManager.setAudioDeviceSetup(setup, true);
+        
+        juce::AudioIODevice *device = deviceManager.getCurrentAudioDevice();
+        liveInputs = device ? static_cast<unsigned>(device->getActiveInputChannels().countNumberOfSetBits()) : 0;
+        live.Flush();
+        live.SetCoefficients(reverb); // sliders moved while live was off
+        live.SetReverb(reverb, DeviceRate(), liveInputs);
+        liveOn = liveInputs > 0;
+        
+        if (!liveOn)
+            fileText->setText("Error: no input channels");
+    }
+    else {
+        setAudioChannels(0, 2);
+    }
     
-    unsigned size = input->frames();
-    unsigned i = 0;
+    liveOnOff.setToggleState(liveOn, juce::dontSendNotification);
+    UpdateLatency();
+}
 
-    for (unsigned j = 0; j < channels; ++j) {
-        Reverb &rev = revs[j];
-        for (; i < size; ++i) {
-            output->sample(i, j) = rev(input->sample(i, j));
-        }
+// reported and measured round trip latency of the live path
+void MainComponent::UpdateLatency()
+{
+    live.Collect();
+    
+    juce::AudioIODevice *device = deviceManager.getCurrentAudioDevice();
+    if (!liveOn || !device) {
+        latencyLabel.setText("", juce::dontSendNotification);
+        return;
     }
     
-    // add tail
-    size = output->frames();
-    for (; i < size; ++i) {
-        for (unsigned j = 0; j < channels; ++j) {
-            output->sample(i, j) = revs[j](0);
+    double rate = device->getCurrentSampleRate();
+    int reported = device->getInputLatencyInSamples() + device->getOutputLatencyInSamples()
+                   + device->getCurrentBufferSizeSamples();
+    juce::String text = "Latency " + juce::String(reported * 1000.0 / rate, 1) + " ms";
+    
+    long measured = live.Latency();
+    if (measured >= 0)
+        text << ", measured " << juce::String(measured * 1000.0 / rate, 1) << " ms";
+    else if (measured == LiveProcessor::Measuring)
+        text << ", measuring...";
+    else if (measured == LiveProcessor::TimedOut)
+        text << ", no loopback";
+    
+    latencyLabel.setText(text, juce::dontSendNotification);
+}
+
+// parameters changed, an unfinished render is out of date
+void MainComponent::CancelRender()
+{
+    if (render)
+        render->Cancel();
+}
+
+// re-renders from the checkpoint before the playhead with the current parameters,
+// keeping the output before it; edits keep resuming from the last finished
+// full render, so a resume still running is replaced rather than waited for.
+// nothing changes hands unless the resume starts, so on failure the caller
+// cancels the render that is still playing
+bool MainComponent::ResumeRender()
+{
+    RenderJob *from = (render && render->Finished() && !render->Resumed()) ? render.get() : base.get();
+    if (!from || !input || from->GetMode() != RenderMode())
+        return false;
+    
+    // Resume takes the modes Checkpointable() takes
+    std::unique_ptr<RenderJob> next(new RenderJob(*input, reverb, tail, -1.5, RenderMode()));
+    next->SetCheckpointInterval(checkpointSeconds);
+    if (!next->Resume(from->Output(), from->Checkpoints(), sample, &from->Overview()))
+        return false;
+    next->Start();
+    
+    // the audio thread reads the old output until the swap
+    std::unique_ptr<RenderJob> old;
+    {
+        const juce::ScopedLock lock(deviceManager.getAudioCallbackLock());
+        if (from == render.get())
+            base = std::move(render);
+        old = std::move(render);
+        render = std::move(next);
+        data = &render->Output();
+    }
+    rendering = true;
+    return true;
+}
+
+// the middle thumb seeks, the outer ones bound the loop region
+void MainComponent::PositionChanged()
+{
+    loopStart = static_cast<size_t>(position.getMinValue() * total_samples);
+    loopEnd = static_cast<size_t>(position.getMaxValue() * total_samples);
+    if (position.getThumbBeingDragged() == 0)
+        seekTo = static_cast<size_t>(position.getValue() * total_samples);
+}
+
+// reports render progress, returns true while still rendering
+bool MainComponent::UpdateRender()
+{
+    if (!render || !rendering)
+        return false;
+    
+    if (render->Cancelled()) {
+        fileText->setText("Render cancelled");
+        rendering = false;
+    }
+    else if (render->Finished()) {
+        // store normalized output for the next play with these parameters,
+        // a resumed render mixes two parameter sets and has no copy
+        if (std::shared_ptr<const AudioData> out = render->Normalized())
+            cache.Insert(renderKey, out);
+        
+        fileText->setText("Render complete");
+        rendering = false;
+    }
+    else {
+        int percent = juce::roundToInt(render->Progress() * 100.0);
+        fileText->setText("Rendering: " + juce::String(percent) + "%");
+    }
+    
+    return rendering;
+}
+
+// shows callback load next to play
+void MainComponent::UpdateMeter()
+{
+    DspStats::Snapshot s = callbackStats.GetSnapshot();
+    juce::String text = "DSP " + juce::String(s.load * 100.0, 1) + "% (max "
+                        + juce::String(s.maxLoad * 100.0, 0) + "%)";
+    
+    int xruns = DeviceXruns();
+    if (xruns > 0 || s.overruns > 0)
+        text << " xruns " << juce::String(juce::jmax(static_cast<juce::int64>(xruns), static_cast<juce::int64>(s.overruns)));
+    
+    loadMeter.setText(text, juce::dontSendNotification);
+}
+
+// driver reported xruns, -1 if it doesn't count them
+int MainComponent::DeviceXruns()
+{
+    juce::AudioIODevice *device = deviceManager.getCurrentAudioDevice();
+    return device ? device->getXRunCount() : -1;
+}
+
+// writes callback and stream stats to fname, or MOORER_STATS_FILE, or a file in documents
+void MainComponent::DumpStats(std::string fname)
+{
+    if (fname.empty()) {
+        const char *env = std::getenv("MOORER_STATS_FILE");
+        fname = env ? env : juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                                .getChildFile("MoorerReverb-stats.txt").getFullPathName().toStdString();
+    }
+    
+    std::ofstream file(fname);
+    file << "[audio callback]\n" << DspStats::Format(callbackStats.GetSnapshot(), DeviceXruns());
+    if (stream)
+        file << "\n[stream prefetch]\n" << DspStats::Format(stream->GetStats().GetSnapshot());
+    
+    fileText->setText(file ? "Stats saved to " + juce::String(fname) : "Error: unable to save stats");
+}
+
+// applies a preset file onto the current parameters
+void MainComponent::LoadPresetClicked()
+{
+    presetChooser.reset(new juce::FileChooser("Select preset to load", {}, "*.txt"));
+    presetChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                               [this](const juce::FileChooser &chooser) {
+        juce::File file = chooser.getResult();
+        if (file == juce::File())
+            return;
+        
+        try {
+            LoadPreset(file.getFullPathName().toStdString(), reverb);
+        }
+        catch (std::exception &e) {
+            fileText->setText("Error: " + juce::String(e.what()));
+            return;
         }
+        UpdateSliders();
+        ParametersChanged();
+        fileText->setText("Preset " + file.getFileName() + " loaded");
+    });
+}
+
+// reports load and render progress and dsp load, redraws the waveform
+void MainComponent::timerCallback()
+{
+    UpdateLoad();
+    
+    // parameter edits while playing a render, at most one resume per tick
+    if (resumePending) {
+        resumePending = false;
+        if (!playing || !ResumeRender())
+            CancelRender();
     }
+    UpdateRender();
     
-    // normalize
-    normalize(*output, -1.5);
+    // playhead follows playback unless it is being dragged
+    if (playing && data && total_samples && position.getThumbBeingDragged() < 0)
+        position.setValue(static_cast<double>(sample) / total_samples, juce::dontSendNotification);
+    UpdateMeter();
+    UpdateLatency();
+    repaint(waveArea);
 }
@@ -1,12 +1,22 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <atomic>
+#include <thread>
 #include <vector>
 #include "AudioData.h" // audio buffer
 #include "Reverb.h"    // moorer reverb filter
+#include "Render.h"    // background reverb render
+#include "RenderCache.h" // rendered output cache
+#include "Load.h"      // background file loading
+#include "Stream.h"    // disk streaming playback
+#include "Stats.h"     // dsp load statistics
+#include "Live.h"      // live input reverb
+#include "Overview.h"  // waveform overview
 
 //==============================================================================
-class MainComponent  : public juce::AudioAppComponent, private juce::FilenameComponentListener
+class MainComponent  : public juce::AudioAppComponent, private juce::FilenameComponentListener,
+                       private juce::Timer
 {
 public:
     //==============================================================================
@@ -27,23 +37,49 @@ private:
     // variables
     const unsigned numCombs; // number of parallel comb filters
     AudioData * input;
-    AudioData * output;
-    AudioData * data;
+    const AudioData * data;
+    std::unique_ptr<RenderJob> render; // reverb render, owns output
+    bool rendering;                    // render progress not yet reported
+    std::unique_ptr<RenderJob> base;   // finished checkpointed render that edits resume from
+    bool resumePending;                // parameters changed while playing a render
+    std::unique_ptr<LoadJob> load;     // file being loaded
+    RenderCache cache;                 // normalized reverb outputs
+    std::shared_ptr<const AudioData> cached; // cached output being played
+    std::shared_ptr<const WaveOverview> inputOverview;  // from the load, or its sidecar while loading
+    std::shared_ptr<const WaveOverview> cachedOverview; // of cached, built by overviewWorker
+    std::thread overviewWorker;
+    Hash64 inputHash;                  // identity of loaded input
+    RenderCache::Key renderKey;        // key of current render
+    std::unique_ptr<StreamSource> stream; // disk stream being played
+    std::string filePath;  // selected file
+    std::string inputPath; // file loaded into input
+    float playGain; // playback gain, follows render gain
     Reverb reverb;  // moorer reverb filter
     bool playing;   // audio is playing
     bool reverbOn;  // turn reverb on/off
+    bool convolutionOn; // render with the captured impulse response
+    bool stereoOn;  // render stereo input through one shared comb bank
+    bool fdnOn;     // render with a feedback delay network instead of the comb bank
+    bool ecoOn;     // render with the comb bank at a decimated rate
+    bool streamOn;  // play from disk instead of loading the file
+    bool liveOn;    // reverb device input instead of playing a file
+    unsigned liveInputs; // active device inputs
+    LiveProcessor live;  // live input reverb
+    DspStats callbackStats; // audio callback load
     unsigned tail;  // reverb tail in ms
     
     const int width;  // default window width
     const int height; // default window height
     
-    int sample;
-    int total_samples;
+    size_t sample;        // playback position (frames)
+    size_t total_samples; // frames to play
+    std::atomic<size_t> seekTo;    // position requested by the message thread, NoSeek if none
+    std::atomic<size_t> loopStart; // loop region (frames)
+    std::atomic<size_t> loopEnd;
+    std::atomic<bool> loopOn;
+    static const size_t NoSeek = ~static_cast<size_t>(0);
     
-    // audio device settings
-    juce::AudioDeviceManager::AudioDeviceSetup setup;
-        
-    void UpdateAudioData(std::string filename);
+    void UpdateAudioData(AudioData * loaded, Hash64 hash);
     
     //==============================================================================
     // GUI objects
@@ -52,12 +88,29 @@ private:
     std::unique_ptr<juce::FilenameComponent> fileComp;
     std::unique_ptr<juce::TextEditor> fileText;
     
-    enum ButtonID { bID = 1001, tID = 1002 };
+    enum ButtonID { bID = 1001, tID = 1002, cID = 1003, sID = 1004, lID = 1005, yID = 1006, fID = 1007, eID = 1008, oID = 1009, rID = 1010 };
     
     // playback
     juce::ToggleButton reverbOnOff;
+    juce::ToggleButton convolutionOnOff;
+    juce::ToggleButton stereoOnOff;
+    juce::ToggleButton fdnOnOff;
+    juce::ToggleButton earlyOnOff;
+    juce::ToggleButton ecoOnOff;
+    juce::ToggleButton streamOnOff;
+    juce::ToggleButton liveOnOff;
+    juce::ComboBox liveBlock;    // live block size
+    juce::TextButton measure;    // loopback latency measurement
+    juce::Label latencyLabel;
     juce::Label reverbOnLabel;
     juce::TextButton play;
+    juce::Slider position;       // playhead, loop region between the outer thumbs
+    juce::ToggleButton loopOnOff;
+    juce::Label loadMeter;     // callback dsp load
+    juce::TextButton statsDump; // save stats to a file
+    juce::TextButton presetLoad; // load a preset file, e.g. from --fit
+    std::unique_ptr<juce::FileChooser> presetChooser;
+    juce::Rectangle<int> waveArea; // input waveform above the output, between the loop thumbs
     
     // slider info
     struct MrSlider
@@ -107,6 +160,7 @@ private:
     void ResizeSlider(juce::Slider* slider, int x, int y, int w, int h);
     
     void UpdateSliderGroup(CombSliderGroup * group);
+    void UpdateSliders(); // every slider and the early toggle from reverb
     
 //    void sliderValueChanged(juce::Slider *slider) override;
     
@@ -115,9 +169,28 @@ private:
     void UpdateToggleState(juce::Button* button, juce::String name);
    
     void PlayClicked();
+    void PlayStream();
+    void PositionChanged();
     
     
     void ApplyReverb();
+    void ParametersChanged();
+    void CancelRender();
+    bool ResumeRender();
+    void SetLive(bool on);
+    void UpdateLatency();
+    bool UpdateLoad();
+    bool UpdateRender();
+    RenderJob::Mode RenderMode();
+    unsigned DeviceRate();
+    void UpdateMeter();
+    int DeviceXruns();
+    void DumpStats(std::string fname = "");
+    void LoadPresetClicked();
+    void BuildCachedOverview();
+    void PaintWaveform(juce::Graphics& g, const WaveOverview &overview, juce::Rectangle<int> area,
+                       double start, double end, float gain);
+    void timerCallback() override; // load and render progress, dsp meter, waveform
     
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MainComponent)
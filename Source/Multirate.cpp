@@ -0,0 +1,280 @@
+// Multirate.cpp
+// Spring 2021
+
+#include "Multirate.h"
+#include "Bench.h"    // noise, timing for benchmark
+#include "Kernels.h"  // vectorized block kernels
+#include "Resample.h" // Kaiser
+#include <algorithm>  // std::copy, std::max
+#include <cmath>      // std::abs, std::pow, std::sin, std::cos, std::sqrt, std::log10
+#include <sstream>    // benchmark report
+
+const unsigned MultirateReverb::ZeroCrossings;
+const unsigned MultirateReverb::Lag;
+const unsigned MultirateReverb::BlockSize;
+constexpr double MultirateReverb::HighFloor;
+const unsigned MultirateReverb::MaxEchoes;
+
+// combs keep their delays and loop gain in seconds: delays scale with the rate,
+// a lowpass pole g per full rate sample becomes g^factor per low rate sample.
+// Each comb is shortened by the filters' delay, which moves its whole output
+// up to where the full rate comb has it; later passes come Lag earlier each
+MultirateReverb::MultirateReverb(const Reverb &reverb, unsigned factor) :
+late(reverb), early(reverb.GetEarly()), echoes(reverb.GetSamplingRate(), {}), lowEchoes(reverb.GetSamplingRate(), {}),
+earlyOn(reverb.GetEarlyReflections()), dry(reverb.GetDry()), wet(reverb.GetWet()), maxGain(0.0),
+factor(factor > 2 ? 4 : 2), taps(0), down(), downStarts(), up(), offsets(), input(), low(), phases(), phase(0)
+{
+    Reverb full = reverb; // getters aren't const
+    const double pi = 3.14159265358979323846;
+    const unsigned lowRate = reverb.GetSamplingRate() / this->factor;
+    const double lowMs = 1000.0 / lowRate; // one low rate sample
+
+    // the high band's response: every pass of comb i returns L_i later through
+    // its loop gain R / |1 - g e^-jw|, taken mid band, then the allpass gives a
+    // at once and (1 - a^2) (-a)^(j-1) after j * M; what is left of the product
+    // above HighFloor sits on the low rate grid, so the low band's copy cancels
+    const double w = pi * (1.0 + 1.0 / this->factor) / 2.0;
+    std::vector<EarlyReflections::Tap> high, lowHigh;
+    late.SetEarlyReflections(false);
+    late.SetSamplingRate(lowRate);
+    const double a = late.GetAllPass().GetCoefficient();
+    const unsigned M = late.GetAllPass().GetDelay();
+    for (unsigned i = 0; i < late.GetNumCombs(); ++i) {
+        Comb &c = late.GetComb(i);
+        double g = c.GetLowPassG();
+        double R = c.GetGainConstant();
+        double rho = R / std::sqrt(1.0 - 2.0 * g * std::cos(w) + g * g);
+        unsigned delay = c.GetDelay();
+        double gain = 1.0;
+        for (unsigned k = 1; k <= MaxEchoes && gain >= HighFloor && delay > 0; ++k, gain *= rho)
+            for (unsigned j = 0; j <= MaxEchoes; ++j) {
+                double tap = gain * (j == 0 ? a : (1.0 - a * a) * std::pow(-a, j - 1.0));
+                unsigned at = k * delay + j * M;
+                if (std::abs(tap) < HighFloor)
+                    continue;
+                high.push_back({ at * lowMs, tap });
+                lowHigh.push_back({ (at > Lag ? at - Lag : 0) * lowMs, -tap });
+            }
+
+        double loop = (g < 1.0) ? R / (1.0 - g) : 0.0;
+        g = std::pow(g, static_cast<double>(this->factor));
+        c.SetLowPassG(g);
+        c.SetGainConstant(loop * (1.0 - g));
+        late.SetCombDelayMs(std::max(late.GetCombDelayMs(i) - Lag * lowMs, 0.0), i);
+    }
+    echoes.SetTaps(high);
+    lowEchoes.SetSamplingRate(lowRate);
+    lowEchoes.SetTaps(lowHigh);
+
+    // kaiser windowed sinc, cutoff at the low rate's nyquist, centred on
+    // Lag * factor / 2 and padded with factor - 1 zeros to whole phases
+    const double beta = 6.0;
+    taps = 2 * ZeroCrossings * this->factor;
+    const unsigned centre = Lag * this->factor / 2;
+    std::vector<double> h(taps, 0.0);
+    double sum = 0.0;
+    for (unsigned j = 0; j <= 2 * centre; ++j) {
+        double d = static_cast<double>(j) - centre;
+        double x = d / this->factor;
+        h[j] = (j == centre ? 1.0 : std::sin(pi * x) / (pi * x)) * Kaiser(d / (centre + 1.0), beta);
+        sum += h[j];
+    }
+
+    // polyphase split, J taps each; the decimator correlates with h and the
+    // interpolator convolves with it, so the pair is linear phase and, with the
+    // zeros last, delays by twice the centre: Lag whole low rate samples.
+    // decimator phase r sees every factor-th input from r, from its own row of
+    // the deinterleaved input; interpolator phase p gets the taps that land on
+    // low rate samples, scaled for the zeros in between
+    const unsigned J = taps / this->factor;
+    down.resize(taps);
+    downStarts.resize(taps);
+    up.assign(this->factor, std::vector<double>(J));
+    for (unsigned p = 0; p < this->factor; ++p)
+        for (unsigned j = 0; j < J; ++j) {
+            down[p * J + j] = h[p + j * this->factor] / sum;
+            downStarts[p * J + j] = p * Row(this->factor) + j;
+            up[p][J - 1 - j] = this->factor * h[p + j * this->factor] / sum;
+        }
+    // the filters can ring above unity, scale the wet bound by their absolute sums;
+    // the high band is the input less the low band
+    double downSum = 0.0, upSum = 0.0;
+    for (unsigned p = 0; p < this->factor; ++p) {
+        double phaseSum = 0.0;
+        for (unsigned j = 0; j < J; ++j) {
+            downSum += std::abs(down[p * J + j]);
+            phaseSum += std::abs(up[p][j]);
+        }
+        upSum = phaseSum > upSum ? phaseSum : upSum;
+    }
+    double feed = earlyOn ? early.GetGainSum() : 1.0;
+    maxGain = dry + (full.GetMaxGain() - dry) * downSum * upSum + wet * feed * echoes.GetGainSum() * (1.0 + downSum * upSum);
+
+    offsets.resize(J);
+    for (unsigned j = 0; j < J; ++j)
+        offsets[j] = j;
+
+    Reset();
+}
+
+void MultirateReverb::Reset()
+{
+    late.Reset();
+    early.Reset();
+    echoes.Reset();
+    lowEchoes.Reset();
+    input.assign(taps - 1 + BlockSize, 0.0);
+    low.assign(taps / factor + BlockSize, 0.0);
+    phases.assign(factor * (BlockSize / factor + 2), 0.0);
+    phase = 0;
+}
+
+double MultirateReverb::GetMaxGain() const
+{
+    return maxGain;
+}
+
+unsigned MultirateReverb::FactorFor(unsigned rate)
+{
+    return rate >= 176400 ? 4 : 2;
+}
+
+// filters a block of signal values
+// both filters run as multi-tap delays over runs of low rate samples, so the
+// products vectorize across outputs rather than along one short filter
+void MultirateReverb::Process(const float *in, float *out, unsigned n)
+{
+    const DspKernels &k = GetKernels();
+    const unsigned J = taps / factor;
+    double x[BlockSize], reflections[BlockSize], lowIn[BlockSize], sum[BlockSize], wetSig[BlockSize], high[BlockSize];
+    double poly[BlockSize + 8 * ZeroCrossings]; // factor rows of Row(factor)
+    const unsigned row = Row(factor);
+
+    while (n > 0) {
+        unsigned count = n < BlockSize ? n : BlockSize;
+
+        // early reflections at the full rate, they feed the combs
+        for (unsigned i = 0; i < count; ++i)
+            x[i] = in[i];
+        if (earlyOn)
+            early.Process(x, reflections, count);
+        const double *src = earlyOn ? reflections : x;
+
+        // decimate: low rate sample q is taken from the window starting at input
+        // first + q * factor; phase r of the window is every factor-th sample from
+        // r, deinterleaved into row r so one pass over all taps sums the phases
+        std::copy(src, src + count, &input[taps - 1]);
+        const unsigned first = factor - 1 - phase;
+        const unsigned m = count > first ? (count - 1 - first) / factor + 1 : 0;
+        if (m > 0) {
+            for (unsigned r = 0; r < factor; ++r)
+                for (unsigned q = 0; q < m + J - 1; ++q)
+                    poly[r * row + q] = input[first + r + q * factor];
+            k.TapSum(poly, downStarts.data(), down.data(), taps, lowIn, m);
+        }
+        std::copy(&input[count], &input[count + taps - 1], &input[0]);
+
+        // late section at the low rate, after the J samples of history, less the
+        // low band's share of the echoes, so what they add is the high band's
+        late.ProcessCombs(lowIn, sum, nullptr, m);
+        late.GetAllPass().Process(sum, &low[J], m);
+        lowEchoes.Process(lowIn, sum, m);
+        k.Accumulate(sum, &low[J], m);
+
+        // interpolate: each phase over every low rate position, then output i
+        // picks its phase (inputs since the newest low rate sample) and position;
+        // factor is a power of two, s = phase + 1 + i splits into both
+        for (unsigned p = 0; p < factor; ++p)
+            k.TapSum(low.data(), offsets.data(), up[p].data(), J, &phases[p * (m + 1)], m + 1);
+        const unsigned shift = factor == 4 ? 2 : 1, mask = factor - 1;
+        for (unsigned i = 0, s = phase + 1; i < count; ++i, ++s)
+            wetSig[i] = phases[(s & mask) * (m + 1) + (s >> shift)];
+        std::copy(&low[m], &low[m + J], &low[0]);
+        phase = (phase + count) & mask;
+
+        echoes.Process(src, high, count);
+        k.Accumulate(high, wetSig, count);
+
+        if (earlyOn)
+            k.Accumulate(reflections, wetSig, count);
+        k.Mix(wetSig, in, wet, dry, out, count);
+
+        in += count;
+        out += count;
+        n -= count;
+    }
+}
+
+//==============================================================================
+// Benchmark
+
+// the tails are noise-like and comb delays round differently at the low rate,
+// so compare schroeder decay curves (energy left after each 10 ms window) of the
+// response to a pulse band limited to cutoff (cycles per sample, 0.5 is an
+// impulse), down to 40 dB; returns the largest difference
+static double EnvelopeError(Reverb full, MultirateReverb eco, unsigned rate, double cutoff)
+{
+    full.Reset();
+    eco.Reset();
+    const unsigned window = rate / 100, windows = 150;
+    std::vector<float> a(window * windows), b(a.size());
+
+    const double pi = 3.14159265358979323846;
+    const int half = static_cast<int>(16 / cutoff);
+    for (int i = -half; i <= half; ++i) {
+        double x = 2.0 * cutoff * i;
+        double sinc = i == 0 ? 1.0 : std::sin(pi * x) / (pi * x);
+        a[i + half] = b[i + half] = static_cast<float>(2.0 * cutoff * sinc * Kaiser(double(i) / half, 8.0));
+    }
+    full.Process(a.data(), a.data(), static_cast<unsigned>(a.size()));
+    eco.Process(b.data(), b.data(), static_cast<unsigned>(b.size()));
+
+    std::vector<double> ea(windows + 1), eb(windows + 1);
+    for (unsigned w = windows; w-- > 0;) {
+        ea[w] = ea[w + 1];
+        eb[w] = eb[w + 1];
+        for (unsigned i = 0; i < window; ++i) {
+            size_t j = size_t(w) * window + i;
+            ea[w] += double(a[j]) * a[j];
+            eb[w] += double(b[j]) * b[j];
+        }
+    }
+
+    double worst = 0.0;
+    for (unsigned w = 0; w < windows && ea[w] > ea[0] * 1e-4; ++w) {
+        double d = std::abs(10.0 * std::log10((eb[w] / eb[0]) / (ea[w] / ea[0])));
+        worst = d > worst ? d : worst;
+    }
+    return worst;
+}
+
+std::string BenchmarkMultirate()
+{
+    std::ostringstream report;
+    report << "rate    mode        ns/sample  speedup  decay error (dB): band limited, impulse\n";
+
+    for (unsigned rate : { 96000u, 192000u }) {
+        Reverb reverb;
+        reverb.SetSamplingRate(rate);
+        reverb.Reset(); // lines sized for the new rate
+        reverb.SetDryPercetage(0); // wet only, so the error is the reverb's
+
+        // 5 s of noise
+        std::vector<float> signal = Noise(5 * rate), full(signal.size()), eco(signal.size());
+
+        Reverb ref = reverb;
+        double base = TimeProcess([&](const float *in, float *o, unsigned n) { ref.Process(in, o, n); }, signal, full, Reverb::BlockSize);
+        report << rate << "  full rate   " << base << "\n";
+
+        for (unsigned factor : { 2u, 4u }) {
+            MultirateReverb multi(reverb, factor);
+            double t = TimeProcess([&](const float *in, float *o, unsigned n) { multi.Process(in, o, n); }, signal, eco, Reverb::BlockSize);
+
+            report << rate << "  eco 1/" << factor << "     " << t << "  " << base / t << "  "
+                   << EnvelopeError(reverb, multi, rate, 0.4 / factor) << "  "
+                   << EnvelopeError(reverb, multi, rate, 0.5) << "\n";
+        }
+    }
+
+    return report.str();
+}
@@ -0,0 +1,58 @@
+// Multirate.h
+// Spring 2021
+
+#pragma once
+#include <string>   // std::string
+#include <vector>   // std::vector
+#include "Reverb.h" // moorer reverb filter
+
+// eco mode: the comb bank and allpass run at 1/2 or 1/4 of the sampling rate
+// the input is split in two bands: the low band is decimated by a polyphase
+// lowpass, reverbed at the low rate and interpolated back; the high band (the
+// input less the low band) decays within a few comb passes, so it only gets
+// each comb's echoes down to HighFloor, a full rate multi-tap delay. The
+// filters' delay comes off the low rate comb delays, so the wet signal lines
+// up with the full rate reverb, dry signal and early reflections.
+class MultirateReverb
+{
+public:
+    MultirateReverb(const Reverb &reverb, unsigned factor = 2); // factor 2 or 4
+
+    void Reset();
+
+    void Process(const float *in, float *out, unsigned n); // filter block (in may equal out)
+
+    unsigned GetFactor() const  { return factor; }
+    double GetMaxGain() const;  // upper bound on steady-state gain
+
+    static unsigned FactorFor(unsigned rate); // 4 from 176.4 kHz, else 2
+    static const unsigned ZeroCrossings = 4;  // lowpass half length in low rate periods, padded
+    static const unsigned Lag = 2 * ZeroCrossings - 1; // both filters' delay (low rate samples)
+    static const unsigned BlockSize = Reverb::BlockSize;
+    static constexpr double HighFloor = 0.5;  // quietest high band echo kept (-6 dB)
+    static const unsigned MaxEchoes = 8;      // comb passes and allpass terms per echo at most
+private:
+    Reverb late;                // combs and allpass at the low rate, shortened by Lag
+    EarlyReflections early;     // full rate
+    EarlyReflections echoes;    // comb echoes for the high band, full rate, of the whole input
+    EarlyReflections lowEchoes; // the same echoes negated at the low rate, of the low band
+    bool earlyOn;
+    double dry, wet;
+    double maxGain;
+
+    unsigned factor;
+    unsigned taps;                         // prototype lowpass length, last factor - 1 zero
+    static unsigned Row(unsigned factor) { return BlockSize / factor + 2 * ZeroCrossings; } // deinterleaved phase length
+
+    std::vector<double> down;              // decimation filter, factor phases of J taps
+    std::vector<unsigned> downStarts;      // their positions, phase r in row r
+    std::vector<std::vector<double>> up;   // interpolation phase filters, reversed, gain factor
+    std::vector<unsigned> offsets;         // 0 .. taps / factor - 1, tap positions
+    std::vector<double> input;             // decimator history (taps - 1) + block
+    std::vector<double> low;               // interpolator history (taps / factor) + block
+    std::vector<double> phases;            // interpolator output per phase and position
+    unsigned phase;                        // inputs since the last low rate sample
+};
+
+// full rate against eco mode at 96 and 192 kHz: time and wet error
+std::string BenchmarkMultirate();
@@ -0,0 +1,389 @@
+// Overview.cpp
+// Spring 2021
+
+#include "Overview.h"
+#include "Bench.h"    // noise for the check
+#include "WorkPool.h" // work-stealing pool
+#include "Trace.h"
+#include <algorithm>  // std::min, std::max
+#include <chrono>     // check timing
+#include <cmath>      // std::floor, std::ceil
+#include <cstdio>     // std::remove, std::rename
+#include <fstream>
+#include <sstream>    // check report
+#include <sys/stat.h> // stat
+
+using namespace std;
+
+struct SidecarHeader
+{
+    char tag[4]; // "MRO1"
+    unsigned channels;
+    unsigned long long frames;
+    unsigned long long key;
+    unsigned base, factor; // BaseFrames, Factor when written
+};
+
+WaveOverview::WaveOverview(size_t frames, unsigned channels) :
+frames(frames), channels(channels), spans(1, BaseFrames), levels(), ready(0)
+{
+    while ((frames + spans.back() - 1) / spans.back() > 1)
+        spans.push_back(spans.back() * Factor);
+    for (size_t l = 0; l < spans.size(); ++l)
+        levels.push_back(vector<Bucket>(Count(l) * channels, Bucket{ 0.0f, 0.0f, 0.0f }));
+}
+
+size_t WaveOverview::Bytes() const
+{
+    size_t bytes = 0;
+    for (const vector<Bucket> &level : levels)
+        bytes += level.size() * sizeof(Bucket);
+    return bytes;
+}
+
+// buckets end early at the file's end and at frame limit
+void WaveOverview::Summarize(const AudioData &data, size_t first, size_t last, size_t limit)
+{
+    const float *samples = data.data();
+    limit = min(limit, min(frames, data.frames()));
+    for (size_t b = first; b < last; ++b) {
+        size_t from = b * BaseFrames, to = min(from + BaseFrames, limit);
+        for (unsigned c = 0; c < channels; ++c) {
+            Bucket *out = At(0, b, c);
+            if (from >= to) {
+                *out = Bucket{ 0.0f, 0.0f, 0.0f };
+                continue;
+            }
+            float lo = samples[from * channels + c], hi = lo;
+            double sum = 0.0;
+            for (size_t i = from; i < to; ++i) {
+                float x = samples[i * channels + c];
+                lo = min(lo, x);
+                hi = max(hi, x);
+                sum += static_cast<double>(x) * x;
+            }
+            *out = Bucket{ lo, hi, static_cast<float>(sum / (to - from)) };
+        }
+    }
+}
+
+// power is weighted by the frames each child covers, the file's last one is short
+void WaveOverview::Merge(size_t level, size_t first, size_t last)
+{
+    const size_t below = Count(level - 1), span = Span(level - 1);
+    for (size_t b = first; b < last; ++b) {
+        size_t c0 = b * Factor, c1 = min(c0 + Factor, below);
+        for (unsigned c = 0; c < channels; ++c) {
+            Bucket merged = *At(level - 1, c0, c);
+            double sum = 0.0, weight = 0.0;
+            for (size_t k = c0; k < c1; ++k) {
+                const Bucket *child = At(level - 1, k, c);
+                double n = static_cast<double>(min(span, frames - k * span));
+                merged.min = min(merged.min, child->min);
+                merged.max = max(merged.max, child->max);
+                sum += child->power * n;
+                weight += n;
+            }
+            merged.power = weight > 0.0 ? static_cast<float>(sum / weight) : 0.0f;
+            *At(level, b, c) = merged;
+        }
+    }
+}
+
+void WaveOverview::Build(const AudioData &data, unsigned threads)
+{
+    MR_TRACE_SCOPE("overview");
+    ready.store(0, memory_order_release);
+
+    // finest level in slices, each task writes its own buckets
+    const size_t slice = 4096;
+    WorkPool pool(threads);
+    vector<WorkPool::Task> tasks;
+    for (size_t b = 0; b < Count(0); b += slice)
+        tasks.push_back([this, &data, b, slice](unsigned) { Summarize(data, b, min(b + slice, Count(0)), frames); });
+    pool.Run(move(tasks));
+
+    // the rest is 1/BaseFrames of the work
+    for (size_t l = 1; l < levels.size(); ++l)
+        Merge(l, 0, Count(l));
+    ready.store(frames, memory_order_release);
+}
+
+// buckets from the one holding from are summarized again, a bucket ending
+// after to is partial until a later update completes it
+void WaveOverview::Update(const AudioData &data, size_t from, size_t to)
+{
+    to = min(to, frames);
+    if (from >= to)
+        return;
+
+    size_t first = from / BaseFrames, last = (to + BaseFrames - 1) / BaseFrames;
+    Summarize(data, first, last, to);
+    for (size_t l = 1; l < levels.size(); ++l) {
+        first /= Factor;
+        last = (last + Factor - 1) / Factor;
+        Merge(l, first, last);
+    }
+    if (to > ready.load(memory_order_relaxed))
+        ready.store(to, memory_order_release);
+}
+
+// a bucket ending by to covers whole children in both overviews, so it is the
+// same whatever either file's length
+void WaveOverview::Adopt(const WaveOverview &other, const AudioData &data, size_t to)
+{
+    to = min(to, frames);
+    if (other.channels != channels || other.Ready() < to) {
+        Update(data, 0, to);
+        return;
+    }
+
+    // levels other lacks span more than its frames, none of their buckets end by to
+    for (size_t l = 0; l < levels.size() && l < other.levels.size(); ++l) {
+        size_t complete = to / Span(l);
+        copy(other.levels[l].begin(), other.levels[l].begin() + complete * channels, levels[l].begin());
+    }
+
+    const size_t from = to / BaseFrames * BaseFrames;
+    if (from < to) {
+        Update(data, from, to);
+        return;
+    }
+    for (size_t l = 1; l < levels.size(); ++l)
+        if (to % Span(l))
+            Merge(l, to / Span(l), to / Span(l) + 1);
+    if (to > ready.load(memory_order_relaxed))
+        ready.store(to, memory_order_release);
+}
+
+void WaveOverview::Query(unsigned channel, double start, double end, Bucket *out, unsigned columns) const
+{
+    if (columns == 0)
+        return;
+    const double width = (end - start) / columns;
+    const size_t done = Ready();
+
+    // coarsest level with a bucket per column
+    size_t level = 0;
+    while (level + 1 < levels.size() && Span(level + 1) <= width)
+        ++level;
+    const size_t span = Span(level);
+    const size_t available = done >= frames ? Count(level) : done / span; // complete buckets
+
+    for (unsigned col = 0; col < columns; ++col) {
+        double a = max(0.0, start + col * width), b = start + (col + 1) * width;
+        size_t i0 = static_cast<size_t>(floor(a / span));
+        size_t i1 = b > 0.0 ? static_cast<size_t>(ceil(b / span)) : 0;
+        i1 = min(max(i1, i0 + 1), available);
+
+        Bucket merged = { 0.0f, 0.0f, 0.0f };
+        if (channel < channels && i0 < i1) {
+            merged = *At(level, i0, channel);
+            double sum = 0.0;
+            for (size_t i = i0; i < i1; ++i) {
+                const Bucket *bucket = At(level, i, channel);
+                merged.min = min(merged.min, bucket->min);
+                merged.max = max(merged.max, bucket->max);
+                sum += bucket->power;
+            }
+            merged.power = static_cast<float>(sum / (i1 - i0));
+        }
+        out[col] = merged;
+    }
+}
+
+//==============================================================================
+// Sidecar
+
+string WaveOverview::SidecarName(const string &wave)
+{
+    return wave + ".mro";
+}
+
+// file size, modification time and load rate, the samples aren't read
+Hash64 WaveOverview::SidecarKey(const string &wave, unsigned rate)
+{
+    struct stat info;
+    if (stat(wave.c_str(), &info) != 0)
+        return 0;
+    Hash64 h = HashValue(static_cast<long long>(info.st_size));
+    h = HashValue(static_cast<long long>(info.st_mtime), h);
+    return HashValue(rate, h);
+}
+
+bool WaveOverview::Save(const string &fname, Hash64 key) const
+{
+    if (Ready() < frames)
+        return false;
+
+    string temp = fname + ".tmp";
+    fstream out(temp.c_str(), ios_base::binary | ios_base::out | ios_base::trunc);
+    if (!out.is_open())
+        return false;
+
+    SidecarHeader header = { {'M', 'R', 'O', '1'}, channels, frames, key, BaseFrames, Factor };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const vector<Bucket> &level : levels)
+        if (!level.empty())
+            out.write(reinterpret_cast<const char*>(&level[0]), level.size() * sizeof(Bucket));
+    out.close();
+
+    // readers never see a partial file
+    if (!out || rename(temp.c_str(), fname.c_str()) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool WaveOverview::Load(const string &fname, Hash64 key)
+{
+    fstream in(fname.c_str(), ios_base::binary | ios_base::in);
+    if (!in || key == 0)
+        return false;
+
+    SidecarHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || header.tag[0] != 'M' || header.tag[1] != 'R' || header.tag[2] != 'O' || header.tag[3] != '1'
+        || header.key != key || header.base != BaseFrames || header.factor != Factor)
+        return false;
+
+    WaveOverview loaded(static_cast<size_t>(header.frames), header.channels);
+    for (vector<Bucket> &level : loaded.levels)
+        if (!level.empty())
+            in.read(reinterpret_cast<char*>(&level[0]), level.size() * sizeof(Bucket));
+    if (!in)
+        return false;
+
+    frames = loaded.frames;
+    channels = loaded.channels;
+    spans.swap(loaded.spans);
+    levels.swap(loaded.levels);
+    ready.store(frames, memory_order_release);
+    return true;
+}
+
+//==============================================================================
+// Overview check
+
+// the exact summary of frames [from, to) of channel
+static WaveOverview::Bucket Exact(const AudioData &data, unsigned channel, size_t from, size_t to)
+{
+    WaveOverview::Bucket b = { data.sample(from, channel), data.sample(from, channel), 0.0f };
+    double sum = 0.0;
+    for (size_t i = from; i < to; ++i) {
+        b.min = min(b.min, data.sample(i, channel));
+        b.max = max(b.max, data.sample(i, channel));
+        sum += static_cast<double>(data.sample(i, channel)) * data.sample(i, channel);
+    }
+    b.power = static_cast<float>(sum / (to - from));
+    return b;
+}
+
+static bool Same(const vector<WaveOverview::Bucket> &a, const vector<WaveOverview::Bucket> &b)
+{
+    for (size_t i = 0; i < a.size(); ++i)
+        if (a[i].min != b[i].min || a[i].max != b[i].max || a[i].power != b[i].power)
+            return false;
+    return true;
+}
+
+string CheckOverview(bool &passed)
+{
+    const unsigned rate = 44100, channels = 2, columns = 250;
+    const size_t frames = 600 * rate + 123; // ten minutes, a short last bucket
+
+    // noise bursts of rising level, channels differ
+    AudioData input(frames, rate, channels);
+    Lcg lcg;
+    for (size_t i = 0; i < frames; ++i)
+        for (unsigned j = 0; j < channels; ++j) {
+            float level = ((i / rate) % 5 == j) ? 0.0f : static_cast<float>(i) / frames;
+            input.sample(i, j) = level * lcg.Noise();
+        }
+
+    auto start = chrono::steady_clock::now();
+    WaveOverview built(frames, channels);
+    built.Build(input);
+    chrono::duration<double, milli> buildTime = chrono::steady_clock::now() - start;
+
+    // one column per bucket: a whole column is exact on min and max, power to rounding
+    bool exact = true;
+    vector<WaveOverview::Bucket> view(columns);
+    const size_t span = WaveOverview::BaseFrames * WaveOverview::Factor * WaveOverview::Factor;
+    for (unsigned j = 0; j < channels; ++j) {
+        const size_t from = 1234 * span;
+        built.Query(j, static_cast<double>(from), static_cast<double>(from + columns * span), &view[0], columns);
+        for (unsigned c = 0; c < columns; ++c) {
+            WaveOverview::Bucket e = Exact(input, j, from + c * span, from + (c + 1) * span);
+            exact = exact && view[c].min == e.min && view[c].max == e.max
+                    && abs(view[c].power - e.power) <= 1.0e-5f * e.power;
+        }
+    }
+
+    // every zoom, from under a bucket per column to the whole file: a column
+    // holds the samples it covers, plus at most a bucket either side
+    bool bounded = true;
+    double queryTime = 0.0;
+    for (double width = WaveOverview::BaseFrames / 2.0; width * columns < 2.0 * frames; width *= 3.0) {
+        const double from = frames / 3.0;
+        auto t = chrono::steady_clock::now();
+        built.Query(0, from, from + width * columns, &view[0], columns);
+        queryTime = max(queryTime, chrono::duration<double, milli>(chrono::steady_clock::now() - t).count());
+        for (unsigned c = 0; c < columns; ++c) {
+            size_t a = static_cast<size_t>(from + c * width), b = static_cast<size_t>(from + (c + 1) * width);
+            if (a >= frames)
+                bounded = bounded && view[c].min == 0.0f && view[c].max == 0.0f;
+            else if (b > a) {
+                WaveOverview::Bucket e = Exact(input, 0, a, min(b, frames));
+                bounded = bounded && view[c].min <= e.min && view[c].max >= e.max;
+            }
+        }
+    }
+
+    // updates in render chunks, with queries between them, end up the same as a build
+    WaveOverview grown(frames, channels);
+    bool partial = true;
+    for (size_t pos = 0; pos < frames; pos += 8192 - 37) {
+        grown.Update(input, pos, pos + 8192 - 37);
+        grown.Query(1, 0.0, static_cast<double>(frames), &view[0], columns);
+        size_t ready = grown.Ready();
+        for (unsigned c = 0; c < columns; ++c)
+            if (static_cast<double>(c) * frames / columns >= ready)
+                partial = partial && view[c].max == 0.0f && view[c].min == 0.0f;
+    }
+    bool incremental = partial && grown.Ready() == frames;
+    for (double width = WaveOverview::BaseFrames; width * columns < 2.0 * frames; width *= 2.0)
+        for (unsigned j = 0; j < channels; ++j) {
+            vector<WaveOverview::Bucket> other(columns);
+            built.Query(j, 1000.0, 1000.0 + width * columns, &view[0], columns);
+            grown.Query(j, 1000.0, 1000.0 + width * columns, &other[0], columns);
+            incremental = incremental && Same(view, other);
+        }
+
+    // sidecar round trip, a different key is stale
+    const string fname = "overview-check.mro";
+    WaveOverview loaded(0, 0), stale(0, 0);
+    bool sidecar = built.Save(fname, 42) && loaded.Load(fname, 42) && !stale.Load(fname, 43)
+                   && loaded.GetFrames() == frames && loaded.GetChannels() == channels;
+    for (double width = WaveOverview::BaseFrames; sidecar && width * columns < 2.0 * frames; width *= 2.0) {
+        vector<WaveOverview::Bucket> other(columns);
+        built.Query(1, 0.0, width * columns, &view[0], columns);
+        loaded.Query(1, 0.0, width * columns, &other[0], columns);
+        sidecar = Same(view, other);
+    }
+    remove(fname.c_str());
+
+    passed = exact && bounded && incremental && sidecar;
+
+    ostringstream report;
+    report << "overview of " << frames / double(rate) << " s x " << channels << " ch: "
+           << built.Bytes() / 1024 << " KB (" << 100.0 * built.Bytes() / (input.size() * sizeof(float))
+           << "% of the samples), built in " << buildTime.count() << " ms\n";
+    report << "slowest " << columns << " column query: " << queryTime << " ms\n";
+    report << "exact at one bucket per column: " << (exact ? "yes (ok)" : "no (failed)") << "\n";
+    report << "columns hold their samples at every zoom: " << (bounded ? "yes (ok)" : "no (failed)") << "\n";
+    report << "chunked updates match the build: " << (incremental ? "yes (ok)" : "no (failed)") << "\n";
+    report << "sidecar round trip: " << (sidecar ? "yes (ok)" : "no (failed)") << "\n";
+    return report.str();
+}
@@ -0,0 +1,73 @@
+// Overview.h
+// Spring 2021
+
+#pragma once
+#include <atomic>      // std::atomic
+#include <string>      // std::string
+#include <vector>      // std::vector
+#include "AudioData.h" // audio buffer
+#include "Hash.h"      // Hash64
+
+// multi-resolution waveform overview: min, max and mean square per bucket
+// of BaseFrames frames, then levels of Factor times fewer buckets up to one
+// bucket for the whole file. A view of any width reads about Factor buckets
+// per column from the coarsest fitting level, never the samples.
+// one thread updates in frame order while others query, queries only see
+// buckets below Ready()
+class WaveOverview
+{
+public:
+    struct Bucket
+    {
+        float min, max;
+        float power; // mean square
+    };
+
+    WaveOverview(size_t frames, unsigned channels);
+
+    // builds every level from data on a work-stealing pool (0 = one per core)
+    void Build(const AudioData &data, unsigned threads = 0);
+    // data frames [from, to) were written, from at or before the last to
+    void Update(const AudioData &data, size_t from, size_t to);
+    // data frames [0, to) were written and other summarized the same frames:
+    // takes other's buckets that end by to, summarizes only the partial ones
+    void Adopt(const WaveOverview &other, const AudioData &data, size_t to);
+
+    // columns buckets covering frames [start, end) of channel, silence past Ready()
+    void Query(unsigned channel, double start, double end, Bucket *out, unsigned columns) const;
+
+    size_t Ready() const { return ready.load(std::memory_order_acquire); } // frames summarized
+    size_t GetFrames() const { return frames; }
+    unsigned GetChannels() const { return channels; }
+    size_t Bytes() const; // memory held
+
+    // sidecar file of a complete overview, key identifies the summarized data;
+    // Load returns false, leaving the overview empty, on a missing or stale file
+    bool Save(const std::string &fname, Hash64 key) const;
+    bool Load(const std::string &fname, Hash64 key);
+
+    // sidecar name and key for a wave file loaded at rate (0 = file rate), 0 key if unreadable
+    static std::string SidecarName(const std::string &wave);
+    static Hash64 SidecarKey(const std::string &wave, unsigned rate);
+
+    static const unsigned BaseFrames = 256; // frames per bucket, finest level
+    static const unsigned Factor = 4;       // buckets merged per bucket of the next level
+private:
+    size_t Span(size_t level) const { return spans[level]; } // frames per bucket
+    size_t Count(size_t level) const { return (frames + spans[level] - 1) / spans[level]; }
+    Bucket * At(size_t level, size_t bucket, unsigned channel) { return &levels[level][bucket * channels + channel]; }
+    const Bucket * At(size_t level, size_t bucket, unsigned channel) const { return &levels[level][bucket * channels + channel]; }
+
+    void Summarize(const AudioData &data, size_t first, size_t last, size_t limit); // level 0 buckets [first, last), frames before limit
+    void Merge(size_t level, size_t first, size_t last);              // level buckets from the one below
+
+    size_t frames;
+    unsigned channels;
+    std::vector<size_t> spans;                 // frames per bucket, per level
+    std::vector<std::vector<Bucket>> levels;   // buckets interleaved by channel
+    std::atomic<size_t> ready;
+};
+
+// compares queries with brute force over the samples at several zooms,
+// incremental updates with a full build, and a sidecar round trip
+std::string CheckOverview(bool &passed);
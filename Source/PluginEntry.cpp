@@ -0,0 +1,10 @@
+// PluginEntry.cpp
+// Spring 2021
+// plugin builds only (MoorerReverbPlugin.jucer)
+
+#include "PluginProcessor.h"
+
+juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
+{
+    return new MoorerReverbProcessor();
+}
@@ -0,0 +1,318 @@
+// PluginProcessor.cpp
+// Spring 2021
+
+#include "PluginProcessor.h"
+#include "Bench.h"     // noise for the check
+#include "Convolver.h" // CaptureImpulse
+#include <cmath>   // std::abs
+#include <sstream> // std::ostringstream
+#include <vector>  // std::vector
+
+// parameter ids
+static juce::String CombID(unsigned i, const char *name)
+{
+    return "comb" + juce::String(i + 1) + "_" + name;
+}
+
+MoorerReverbProcessor::MoorerReverbProcessor() :
+AudioProcessor(BusesProperties().withInput("Input", juce::AudioChannelSet::stereo(), true)
+                                .withOutput("Output", juce::AudioChannelSet::stereo(), true)),
+parameters(*this, nullptr, "MoorerReverb", CreateParameters()),
+live(), dirty(true), structural(true), tail(0.0), rate(44100.0), channels(2), coefficients()
+{
+    for (juce::AudioProcessorParameter *p : getParameters())
+        if (auto *param = dynamic_cast<juce::AudioProcessorParameterWithID*>(p))
+            parameters.addParameterListener(param->paramID, this);
+
+    coefficientValues[0] = parameters.getRawParameterValue("dry");
+    coefficientValues[1] = parameters.getRawParameterValue("apCoeff");
+    for (unsigned i = 0; i < NumCombs; ++i) {
+        coefficientValues[2 + i] = parameters.getRawParameterValue(CombID(i, "g"));
+        coefficientValues[2 + NumCombs + i] = parameters.getRawParameterValue(CombID(i, "zf"));
+    }
+    for (float &v : appliedValues)
+        v = -1.0f;
+
+    tail = GetReverb().GetDecayTime(TailFloor);
+    startTimerHz(30);
+}
+
+MoorerReverbProcessor::~MoorerReverbProcessor()
+{
+    stopTimer();
+}
+
+// same ranges and defaults as the standalone sliders
+juce::AudioProcessorValueTreeState::ParameterLayout MoorerReverbProcessor::CreateParameters()
+{
+    Reverb reverb;
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+
+    layout.add(std::make_unique<juce::AudioParameterFloat>("dry", "Dry", juce::NormalisableRange<float>(0.0f, 100.0f, 1.0f), 90.0f));
+    layout.add(std::make_unique<juce::AudioParameterBool>("early", "Early Reflections", false));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("apCoeff", "Allpass a", juce::NormalisableRange<float>(0.0f, 1.0f, 0.01f),
+                                                           reverb.GetAllPassCoeff()));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("apDelay", "Allpass Delay", juce::NormalisableRange<float>(1.0f, 100.0f, 1.0f),
+                                                           reverb.GetAllPassDelay()));
+
+    for (unsigned i = 0; i < NumCombs; ++i) {
+        juce::String name = "Comb " + juce::String(i + 1) + " ";
+        layout.add(std::make_unique<juce::AudioParameterFloat>(CombID(i, "delay"), name + "Delay",
+                                                               juce::NormalisableRange<float>(1.0f, 100.0f, 1.0f),
+                                                               static_cast<float>(reverb.GetCombDelay(i))));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(CombID(i, "g"), name + "g",
+                                                               juce::NormalisableRange<float>(0.0f, 0.99f, 0.0001f),
+                                                               static_cast<float>(reverb.GetCombLowPassCoeff(i))));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(CombID(i, "zf"), name + "Zero Freq Gain",
+                                                               juce::NormalisableRange<float>(0.0f, 0.99f, 0.01f),
+                                                               static_cast<float>(reverb.GetCombZeroFreqGain(i))));
+    }
+
+    return layout;
+}
+
+// delays are set in ms after the rate, so they convert at the host rate
+Reverb MoorerReverbProcessor::GetReverb() const
+{
+    auto value = [this](const juce::String &id) { return parameters.getRawParameterValue(id)->load(); };
+
+    Reverb reverb;
+    reverb.SetSamplingRate(static_cast<unsigned>(rate));
+    reverb.SetDryPercetage(static_cast<unsigned>(value("dry")));
+    reverb.SetEarlyReflections(value("early") >= 0.5f);
+    reverb.SetAllPassCoeff(value("apCoeff"));
+    reverb.SetAllPassDelay(static_cast<unsigned>(value("apDelay")));
+
+    for (unsigned i = 0; i < NumCombs; ++i) {
+        reverb.SetCombDelay(static_cast<unsigned>(value(CombID(i, "delay"))), i);
+        reverb.SetCombLowPassCoeff(value(CombID(i, "g")), i);
+        reverb.SetCombZeroFreqGain(value(CombID(i, "zf")), i);
+    }
+
+    return reverb;
+}
+
+//==============================================================================
+// builds the chain here, so the first block never allocates
+void MoorerReverbProcessor::prepareToPlay(double sampleRate, int)
+{
+    rate = sampleRate;
+    channels = static_cast<unsigned>(juce::jmax(getTotalNumInputChannels(), getTotalNumOutputChannels()));
+    setLatencySamples(0);
+    live.Flush();
+    Rebuild(true);
+}
+
+void MoorerReverbProcessor::releaseResources()
+{
+}
+
+// mono or stereo, or mono in to stereo out
+bool MoorerReverbProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
+{
+    const juce::AudioChannelSet &in = layouts.getMainInputChannelSet();
+    const juce::AudioChannelSet &out = layouts.getMainOutputChannelSet();
+
+    if (out != juce::AudioChannelSet::mono() && out != juce::AudioChannelSet::stereo())
+        return false;
+
+    return in == out || (in == juce::AudioChannelSet::mono() && out == juce::AudioChannelSet::stereo());
+}
+
+// in place on the host's buffers, coefficient changes from this block on
+void MoorerReverbProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
+{
+    juce::ScopedNoDenormals noDenormals;
+
+    ApplyCoefficients();
+    live.Process(buffer.getArrayOfWritePointers(), static_cast<unsigned>(buffer.getNumChannels()),
+                 static_cast<unsigned>(getTotalNumInputChannels()), static_cast<unsigned>(buffer.getNumSamples()));
+}
+
+double MoorerReverbProcessor::getTailLengthSeconds() const
+{
+    return tail.load(std::memory_order_relaxed);
+}
+
+//==============================================================================
+juce::AudioProcessorEditor* MoorerReverbProcessor::createEditor()
+{
+    return new juce::GenericAudioProcessorEditor(*this);
+}
+
+void MoorerReverbProcessor::getStateInformation(juce::MemoryBlock& destData)
+{
+    std::unique_ptr<juce::XmlElement> xml(parameters.copyState().createXml());
+    copyXmlToBinary(*xml, destData);
+}
+
+void MoorerReverbProcessor::setStateInformation(const void* data, int sizeInBytes)
+{
+    std::unique_ptr<juce::XmlElement> xml(getXmlFromBinary(data, sizeInBytes));
+    if (xml && xml->hasTagName(parameters.state.getType()))
+        parameters.replaceState(juce::ValueTree::fromXml(*xml));
+}
+
+// reads the coefficient parameters, posts them to the chain when one moved
+void MoorerReverbProcessor::ApplyCoefficients()
+{
+    bool changed = false;
+    for (unsigned k = 0; k < NumCoefficients; ++k) {
+        float v = coefficientValues[k]->load(std::memory_order_relaxed);
+        changed = changed || v != appliedValues[k];
+        appliedValues[k] = v;
+    }
+    if (!changed)
+        return;
+
+    // same order as GetReverb, so R comes out the same
+    coefficients.SetDryPercetage(static_cast<unsigned>(appliedValues[0]));
+    coefficients.SetAllPassCoeff(appliedValues[1]);
+    for (unsigned i = 0; i < NumCombs; ++i) {
+        coefficients.SetCombLowPassCoeff(appliedValues[2 + i], i);
+        coefficients.SetCombZeroFreqGain(appliedValues[2 + NumCombs + i], i);
+    }
+    live.SetCoefficients(coefficients);
+}
+
+//==============================================================================
+bool MoorerReverbProcessor::IsCoefficient(const juce::String& id)
+{
+    return id == "dry" || id == "apCoeff" || id.endsWith("_g") || id.endsWith("_zf");
+}
+
+// any thread, including the audio thread during automation: only flags the change,
+// coefficients reach the audio thread through processBlock
+void MoorerReverbProcessor::parameterChanged(const juce::String& id, float)
+{
+    if (!IsCoefficient(id))
+        structural.store(true, std::memory_order_release);
+    dirty.store(true, std::memory_order_release);
+}
+
+void MoorerReverbProcessor::timerCallback()
+{
+    UpdateParameters();
+}
+
+void MoorerReverbProcessor::UpdateParameters()
+{
+    live.Collect();
+    bool chain = structural.exchange(false, std::memory_order_acq_rel);
+    if (dirty.exchange(false, std::memory_order_acq_rel) || chain)
+        Rebuild(chain);
+}
+
+// tail reported from the decay of the current parameters
+void MoorerReverbProcessor::Rebuild(bool chain)
+{
+    dirty = false;
+    Reverb reverb = GetReverb();
+    if (chain) {
+        structural = false;
+        live.Collect();
+        live.SetReverb(reverb, static_cast<unsigned>(rate), channels);
+    }
+
+    double seconds = reverb.GetDecayTime(TailFloor);
+    if (std::abs(seconds - tail.exchange(seconds)) > 0.001)
+        updateHostDisplay();
+}
+
+//==============================================================================
+std::string CheckPlugin(bool &passed)
+{
+    const double rate = 48000.0;
+    const int maxBlock = 512;
+    const int channels = 2;
+    const int frames = static_cast<int>(rate) * 2;
+    const int blocks[] = { 512, 1, 64, 7, 256, 33, 128, 500 }; // host block sizes vary
+
+    MoorerReverbProcessor plugin;
+    plugin.setPlayConfigDetails(channels, channels, rate, maxBlock);
+    plugin.prepareToPlay(rate, maxBlock);
+
+    std::vector<std::vector<float>> signal(channels, std::vector<float>(frames));
+    Lcg lcg;
+    for (std::vector<float> &x : signal)
+        for (float &v : x)
+            v = lcg.Noise();
+
+    std::vector<Reverb> revs(channels, plugin.GetReverb());
+    for (Reverb &r : revs)
+        r.Reset();
+    std::vector<Reverb> olds(revs); // crossfaded from after the delay change
+    int faded = static_cast<int>(LiveProcessor::FadeFrames);
+
+    juce::AudioBuffer<float> buffer(channels, maxBlock);
+    juce::MidiBuffer midi;
+    float error = 0.0f;
+    int stage = 0;
+
+    for (int pos = 0, b = 0; pos < frames; ++b) {
+        int n = juce::jmin(blocks[b % 8], frames - pos);
+
+        // coefficients reach the audio thread with the next block, without the timer,
+        // and change the reference in place
+        if (stage == 0 && pos >= frames / 3) {
+            plugin.parameters.getParameter("dry")->setValueNotifyingHost(0.5f);
+            plugin.parameters.getParameter(CombID(0, "zf"))->setValueNotifyingHost(0.9f);
+            Reverb changed = plugin.GetReverb();
+            for (Reverb &r : revs) {
+                r.SetDryPercetage(changed.GetDryPercentage());
+                r.SetCombZeroFreqGain(changed.GetCombZeroFreqGain(0), 0);
+            }
+            stage = 1;
+        }
+
+        // a delay builds a new chain that starts from the old history and fades over from it
+        if (stage == 1 && pos >= 2 * frames / 3) {
+            plugin.parameters.getParameter(CombID(1, "delay"))->setValueNotifyingHost(0.3f);
+            plugin.UpdateParameters();
+            unsigned delay = plugin.GetReverb().GetCombDelay(1);
+            olds = revs;
+            for (int j = 0; j < channels; ++j) {
+                revs[j].SetCombDelay(delay, 1);
+                revs[j].Reset();
+                revs[j].SetState(olds[j]);
+            }
+            faded = 0;
+            stage = 2;
+        }
+
+        buffer.setSize(channels, n, false, false, true);
+        for (int j = 0; j < channels; ++j)
+            buffer.copyFrom(j, 0, &signal[j][pos], n);
+        plugin.processBlock(buffer, midi);
+
+        float expected[maxBlock], old[maxBlock];
+        int fade = juce::jmin(n, static_cast<int>(LiveProcessor::FadeFrames) - faded);
+        for (int j = 0; j < channels; ++j) {
+            revs[j].Process(&signal[j][pos], expected, n);
+            if (fade > 0)
+                olds[j].Process(&signal[j][pos], old, fade);
+            for (int i = 0; i < fade; ++i) {
+                double t = static_cast<double>(faded + i) / LiveProcessor::FadeFrames;
+                expected[i] = static_cast<float>(old[i] * (1.0 - t) + expected[i] * t);
+            }
+            for (int i = 0; i < n; ++i)
+                error = juce::jmax(error, std::abs(buffer.getSample(j, i) - expected[i]));
+        }
+        faded += fade;
+
+        pos += n;
+    }
+
+    plugin.releaseResources();
+
+    Reverb reverb = plugin.GetReverb();
+    std::vector<float> ir = CaptureImpulse(reverb, -static_cast<float>(MoorerReverbProcessor::TailFloor));
+
+    std::ostringstream report;
+    passed = error < 1.0e-6f;
+    report << "max error: " << error << (passed ? " (ok)" : " (failed)") << "\n";
+    report << "tail: " << plugin.getTailLengthSeconds() << " s reported, "
+           << ir.size() / rate << " s to -" << MoorerReverbProcessor::TailFloor << " dB measured\n";
+    report << "latency: " << plugin.getLatencySamples() << " samples\n";
+    return report.str();
+}
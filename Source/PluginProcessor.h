@@ -0,0 +1,86 @@
+// PluginProcessor.h
+// Spring 2021
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include "Reverb.h" // moorer reverb filter
+#include "Live.h"   // in-place reverb chain with lock-free swaps
+
+// moorer reverb as an audio plugin
+// the host's channel buffers are processed in place; processBlock reads the
+// coefficient parameters from their atomics and sets them in place, delay and
+// early reflection changes are rebuilt into a new chain on the message thread,
+// which the audio thread crossfades to between blocks without locking or allocating
+class MoorerReverbProcessor  : public juce::AudioProcessor,
+                               private juce::AudioProcessorValueTreeState::Listener,
+                               private juce::Timer
+{
+public:
+    MoorerReverbProcessor();
+    ~MoorerReverbProcessor() override;
+
+    //==============================================================================
+    void prepareToPlay(double sampleRate, int samplesPerBlock) override;
+    void releaseResources() override;
+    bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi) override;
+
+    //==============================================================================
+    juce::AudioProcessorEditor* createEditor() override;
+    bool hasEditor() const override { return true; }
+
+    const juce::String getName() const override { return "MoorerReverb"; }
+    bool acceptsMidi() const override  { return false; }
+    bool producesMidi() const override { return false; }
+    bool isMidiEffect() const override { return false; }
+    double getTailLengthSeconds() const override; // decay estimate of the current parameters
+
+    int getNumPrograms() override    { return 1; }
+    int getCurrentProgram() override { return 0; }
+    void setCurrentProgram(int) override {}
+    const juce::String getProgramName(int) override { return {}; }
+    void changeProgramName(int, const juce::String&) override {}
+
+    void getStateInformation(juce::MemoryBlock& destData) override;
+    void setStateInformation(const void* data, int sizeInBytes) override;
+
+    //==============================================================================
+    juce::AudioProcessorValueTreeState parameters;
+
+    Reverb GetReverb() const; // reverb built from the current parameter values
+    void UpdateParameters();  // applies changed parameters now (message thread)
+
+    static const unsigned NumCombs = 6;
+    static constexpr double TailFloor = 90.0; // dB reported tail covers
+private:
+    static juce::AudioProcessorValueTreeState::ParameterLayout CreateParameters();
+
+    static bool IsCoefficient(const juce::String& id); // set in place, no new chain
+
+    void parameterChanged(const juce::String& id, float value) override;
+    void timerCallback() override; // picks up parameter changes, frees old chains
+    void Rebuild(bool chain);      // tail, and a new chain for the audio thread
+    void ApplyCoefficients();      // audio thread
+
+    LiveProcessor live;          // per channel reverbs, swapped in place
+    std::atomic<bool> dirty;     // parameters changed since the last tail update
+    std::atomic<bool> structural; // delays or early reflections changed since the last rebuild
+    std::atomic<double> tail;    // seconds
+    double rate;                 // host sampling rate
+    unsigned channels;           // channels the chain was built for
+
+    // audio thread: coefficient parameters, dry, allpass a, then g and zf per comb
+    static const unsigned NumCoefficients = 2 + 2 * NumCombs;
+    std::atomic<float> *coefficientValues[NumCoefficients];
+    float appliedValues[NumCoefficients]; // last set, negative before the first block
+    Reverb coefficients;                  // converts them as GetReverb does
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MoorerReverbProcessor)
+};
+
+// runs the processor like a host would, with varying block sizes, a
+// coefficient change and a delay change, and checks it against the reverb
+// run directly and never reset
+std::string CheckPlugin(bool &passed);
@@ -0,0 +1,49 @@
+// Preset.cpp
+// Spring 2021
+
+#include "Preset.h"
+#include "Automation.h" // parameter ids
+#include <fstream>
+#include <sstream>      // line parsing
+#include <stdexcept>
+
+// g before zf, so R = zf * (1 - g) comes out as saved
+bool SavePreset(const std::string &fname, Reverb &reverb)
+{
+    std::ofstream file(fname);
+    file.precision(17);
+    file << "# moorer reverb preset: parameter value\n";
+    file << Automation::Id(Automation::Dry) << ' ' << reverb.GetDryPercentage() << '\n';
+    file << Automation::Id(Automation::AllPassCoeff) << ' ' << reverb.GetAllPassCoeff() << '\n';
+    file << Automation::Id(Automation::AllPassDelay) << ' ' << reverb.GetAllPassDelay() << '\n';
+    for (unsigned i = 0; i < 6; ++i) {
+        file << Automation::Id(Automation::CombDelay, i) << ' ' << reverb.GetCombDelay(i) << '\n';
+        file << Automation::Id(Automation::CombG, i) << ' ' << reverb.GetCombLowPassCoeff(i) << '\n';
+        file << Automation::Id(Automation::CombZF, i) << ' ' << reverb.GetCombZeroFreqGain(i) << '\n';
+    }
+    file << Automation::Id(Automation::Early) << ' ' << (reverb.GetEarlyReflections() ? 1 : 0) << '\n';
+    return static_cast<bool>(file);
+}
+
+void LoadPreset(const std::string &fname, Reverb &reverb)
+{
+    std::ifstream file(fname);
+    if (!file)
+        throw std::runtime_error("unable to read preset " + fname);
+
+    std::string line;
+    for (unsigned number = 1; std::getline(file, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string id;
+        if (!(fields >> id))
+            continue; // blank or comment
+
+        Automation::Parameter parameter;
+        unsigned comb;
+        double value;
+        if (!(fields >> value) || !Automation::ParseId(id, parameter, comb))
+            throw std::runtime_error(fname + ":" + std::to_string(number) + ": expected parameter id, value");
+        AutomatedReverb::Apply(reverb, parameter, comb, value);
+    }
+}
@@ -0,0 +1,16 @@
+// Preset.h
+// Spring 2021
+
+#pragma once
+#include <string>   // std::string
+#include "Reverb.h" // moorer reverb filter
+
+// reverb presets: one parameter per line, its id (as in automation lanes)
+// then its value, '#' comments; delays are in ms, so a preset suits any rate
+
+// writes dry, the allpass, every comb's delay, g and zf, and early
+bool SavePreset(const std::string &fname, Reverb &reverb);
+
+// applies the preset's values onto reverb in file order, the rest are kept;
+// throws on unreadable lines or unknown ids
+void LoadPreset(const std::string &fname, Reverb &reverb);
@@ -0,0 +1,509 @@
+// Render.cpp
+// Spring 2021
+
+#include "Render.h"
+#include "Bench.h"   // noise for the checkpoint check
+#include "Kernels.h"
+#include "Trace.h"
+#include <algorithm> // std::copy, std::min
+#include <cfloat>    // FLT_MAX
+#include <chrono>    // timing for checkpoint check
+#include <cmath>     // std::pow
+#include <sstream>   // checkpoint report
+
+const unsigned RenderJob::ChunkFrames;
+const unsigned RenderJob::ConvolutionBlock;
+const unsigned RenderJob::FadeFrames;
+
+// sets up output and predicts playback gain
+RenderJob::RenderJob(const AudioData &input, const Reverb &reverb, unsigned tail, float dB, Mode mode) :
+input(input),
+output(input.frames() + static_cast<size_t>(input.rate()) * tail / 1000, input.rate(), input.channels()),
+overview(output.frames(), output.channels()),
+revs(input.channels(), reverb),
+convs(),
+stereo(),
+fdns(),
+ecos(),
+planes(input.channels(), std::vector<float>(ChunkFrames)),
+mode(mode),
+target(std::pow(10.0f, dB / 20.0f)),
+checkpoints(),
+interval(0),
+first(0),
+faded(0),
+sums(input.channels(), 0.0),
+lows(input.channels(), FLT_MAX),
+highs(input.channels(), -FLT_MAX),
+offsets(input.channels(), 0.0f),
+copy(false),
+normalized(),
+gain(1.0f),
+rendered(0),
+finished(false),
+cancelled(false),
+worker(),
+helpers(),
+chunkLock(),
+chunkWake(),
+chunkStart(0),
+chunkEnd(0),
+chunkCount(0),
+chunkDone(0),
+helpersQuit(false)
+{
+    // output can't exceed the input peak times the reverb's max gain,
+    // so this gain never clips before the exact pass is done
+    if (mode == Stereo && input.channels() == 2)
+        stereo.assign(1, StereoReverb(reverb));
+    if (mode == Fdn)
+        fdns.assign(input.channels(), FdnReverb(reverb));
+    if (mode == Eco)
+        ecos.assign(input.channels(), MultirateReverb(reverb, MultirateReverb::FactorFor(input.rate())));
+    
+    double maxGain = !stereo.empty() ? stereo[0].GetMaxGain() : !fdns.empty() ? fdns[0].GetMaxGain()
+                   : !ecos.empty() ? ecos[0].GetMaxGain() : revs[0].GetMaxGain();
+    float peak = GetKernels().PeakAbs(input.data(), input.size()) * static_cast<float>(maxGain);
+    if (peak > 0.0f)
+        gain = target / peak;
+}
+
+RenderJob::~RenderJob()
+{
+    Cancel();
+}
+
+void RenderJob::Start()
+{
+    worker = std::thread(&RenderJob::Run, this);
+}
+
+void RenderJob::Cancel()
+{
+    cancelled = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+// comb/allpass network per channel, including stereo mode on mono input
+bool RenderJob::Checkpointable() const
+{
+    return (mode == Recursive || mode == Stereo) && stereo.empty();
+}
+
+void RenderJob::SetCheckpointInterval(double seconds)
+{
+    interval = (Checkpointable() && seconds > 0.0) ? static_cast<size_t>(seconds * output.rate() + 0.5) : 0;
+}
+
+// restores the checkpoint states, so the output continues the previous render's
+// reverb state with this job's parameters, and its sums and extremes, so only
+// frames from the checkpoint on are scanned again
+bool RenderJob::Resume(const AudioData &previous, const std::vector<Checkpoint> &points, size_t frame,
+                       const WaveOverview *previousOverview)
+{
+    const Checkpoint *from = Nearest(points, frame);
+    if (!from || !Checkpointable() || previous.channels() != output.channels() || from->states.size() != revs.size() ||
+        from->sums.size() != output.channels())
+        return false;
+    
+    size_t keep = std::min(from->frame + FadeFrames, std::min(previous.frames(), output.frames()));
+    if (from->frame > keep)
+        return false;
+    
+    std::copy(previous.data(), previous.data() + keep * output.channels(), output.data());
+    for (size_t j = 0; j < revs.size(); ++j)
+        revs[j].SetState(from->states[j]);
+    
+    checkpoints.clear();
+    for (const Checkpoint &point : points)
+        if (point.frame <= from->frame)
+            checkpoints.push_back(point);
+    
+    first = from->frame;
+    faded = keep;
+    sums = from->sums;
+    lows = from->lows;
+    highs = from->highs;
+    rendered.store(first, std::memory_order_release);
+    if (previousOverview)
+        overview.Adopt(*previousOverview, output, first);
+    
+    // the kept output may peak above the prediction for these parameters;
+    // the checkpoint's extremes cover it up to first
+    float peak = GetKernels().PeakAbs(output.data() + first * output.channels(), (keep - first) * output.channels());
+    for (unsigned j = 0; j < output.channels(); ++j)
+        peak = std::max(peak, std::max(highs[j], -lows[j]));
+    if (peak > 0.0f && target / peak < gain)
+        gain = target / peak;
+    return true;
+}
+
+size_t RenderJob::CheckpointBytes() const
+{
+    size_t bytes = 0;
+    for (const Checkpoint &point : checkpoints)
+        for (const Reverb::State &state : point.states)
+            bytes += state.Bytes();
+    return bytes;
+}
+
+const RenderJob::Checkpoint * RenderJob::Nearest(const std::vector<Checkpoint> &points, size_t frame)
+{
+    const Checkpoint *nearest = nullptr;
+    for (const Checkpoint &point : points)
+        if (point.frame <= frame && (!nearest || point.frame > nearest->frame))
+            nearest = &point;
+    return nearest;
+}
+
+size_t RenderJob::Rendered() const
+{
+    return rendered.load(std::memory_order_acquire);
+}
+
+double RenderJob::Progress() const
+{
+    return output.frames() ? static_cast<double>(Rendered()) / output.frames() : 1.0;
+}
+
+bool RenderJob::Finished() const
+{
+    return finished.load(std::memory_order_acquire);
+}
+
+bool RenderJob::Cancelled() const
+{
+    return cancelled && !Finished();
+}
+
+std::shared_ptr<const AudioData> RenderJob::Normalized() const
+{
+    return Finished() ? normalized : nullptr;
+}
+
+float RenderJob::Gain() const
+{
+    return gain.load(std::memory_order_relaxed);
+}
+
+float RenderJob::Offset(unsigned channel) const
+{
+    return Finished() ? offsets[channel] : 0.0f;
+}
+
+// renders one channel of output frames [start, end) into its plane
+void RenderJob::RenderChannel(unsigned j, size_t start, size_t end)
+{
+    const size_t size = input.frames();
+    const unsigned block = (mode == Convolution) ? ConvolutionBlock : Reverb::BlockSize;
+    std::vector<float> buffer(block);
+    MR_TRACE_SCOPE_ARG(start >= size ? "tail" : "reverb", "channel", j);
+    
+    // input past the end is silence (tail)
+    for (size_t i = start; i < end; i += block) {
+        size_t n = (end - i < block) ? end - i : block;
+        
+        for (unsigned k = 0; k < block; ++k)
+            buffer[k] = (k < n && i + k < size) ? input.sample(i + k, j) : 0.0f;
+        
+        if (mode == Convolution)
+            convs[j].ProcessBlock(&buffer[0], &buffer[0]);
+        else if (mode == Fdn)
+            fdns[j].Process(&buffer[0], &buffer[0], n);
+        else if (mode == Eco)
+            ecos[j].Process(&buffer[0], &buffer[0], n);
+        else
+            revs[j].Process(&buffer[0], &buffer[0], n);
+        
+        for (unsigned k = 0; k < n; ++k)
+            planes[j][i - start + k] = buffer[k];
+    }
+}
+
+// hands the chunk to the helpers, renders channel 0 and waits for the rest
+void RenderJob::RenderChannels(size_t start, size_t end)
+{
+    const unsigned channels = output.channels();
+    if (helpers.empty())
+        for (unsigned j = 1; j < channels; ++j)
+            helpers.push_back(std::thread(&RenderJob::Helper, this, j));
+    
+    {
+        std::lock_guard<std::mutex> hold(chunkLock);
+        chunkStart = start;
+        chunkEnd = end;
+        chunkDone = 0;
+        ++chunkCount;
+    }
+    chunkWake.notify_all();
+    
+    RenderChannel(0, start, end);
+    
+    std::unique_lock<std::mutex> hold(chunkLock);
+    chunkWake.wait(hold, [this, channels] { return chunkDone == channels - 1; });
+}
+
+void RenderJob::Helper(unsigned channel)
+{
+    unsigned seen = 0;
+    while (true) {
+        size_t start, end;
+        {
+            std::unique_lock<std::mutex> hold(chunkLock);
+            chunkWake.wait(hold, [this, seen] { return helpersQuit || chunkCount != seen; });
+            if (helpersQuit)
+                return;
+            seen = chunkCount;
+            start = chunkStart;
+            end = chunkEnd;
+        }
+        
+        RenderChannel(channel, start, end);
+        
+        {
+            std::lock_guard<std::mutex> hold(chunkLock);
+            ++chunkDone;
+        }
+        chunkWake.notify_all();
+    }
+}
+
+void RenderJob::StopHelpers()
+{
+    {
+        std::lock_guard<std::mutex> hold(chunkLock);
+        helpersQuit = true;
+    }
+    chunkWake.notify_all();
+    for (std::thread &t : helpers)
+        t.join();
+    helpers.clear();
+}
+
+// renders both channels of output frames [start, end) through the shared comb bank
+void RenderJob::RenderStereo(size_t start, size_t end)
+{
+    const size_t size = input.frames();
+    const unsigned block = StereoReverb::BlockSize;
+    float left[block], right[block];
+    MR_TRACE_SCOPE(start >= size ? "tail" : "reverb");
+    
+    for (size_t i = start; i < end; i += block) {
+        size_t n = (end - i < block) ? end - i : block;
+        
+        for (unsigned k = 0; k < n; ++k) {
+            left[k] = (i + k < size) ? input.sample(i + k, 0) : 0.0f;
+            right[k] = (i + k < size) ? input.sample(i + k, 1) : 0.0f;
+        }
+        
+        stereo[0].Process(left, right, left, right, static_cast<unsigned>(n));
+        
+        for (unsigned k = 0; k < n; ++k) {
+            planes[0][i - start + k] = left[k];
+            planes[1][i - start + k] = right[k];
+        }
+    }
+}
+
+// renders output in chunks, then measures exact normalization
+void RenderJob::Run()
+{
+    const size_t total = output.frames();
+    const unsigned channels = output.channels();
+    
+    // the network is linear and time invariant, one impulse response serves every channel
+    if (mode == Convolution) {
+        MR_TRACE_SCOPE("capture impulse");
+        std::vector<float> ir = CaptureImpulse(revs[0]);
+        convs.assign(channels, Convolver(ir, ConvolutionBlock));
+    }
+    
+    // output kept from the previous render, unless Resume took its overview
+    if (first > 0 && overview.Ready() < first)
+        overview.Update(output, 0, first);
+    
+    size_t next = first + (first ? interval : 0); // next checkpoint frame
+    for (size_t pos = first; pos < total; ) {
+        if (cancelled) {
+            StopHelpers();
+            return;
+        }
+        
+        // states before rendering the chunk, at chunk boundaries
+        if (interval && pos >= next) {
+            MR_TRACE_SCOPE("checkpoint");
+            Checkpoint point = { pos, {}, sums, lows, highs };
+            for (Reverb &r : revs)
+                point.states.push_back(r.GetState());
+            checkpoints.push_back(std::move(point));
+            while (next <= pos)
+                next += interval;
+        }
+        
+        size_t end = (total - pos < ChunkFrames) ? total : pos + ChunkFrames;
+        
+        // channels are independent, render them in parallel
+        if (!stereo.empty())
+            RenderStereo(pos, end);
+        else
+            RenderChannels(pos, end);
+        
+        MR_TRACE_SCOPE("interleave");
+        size_t i = pos;
+        for (; i < end && i < faded; ++i) {
+            // resumed: the output still holds the previous render, fade into this one
+            float t = static_cast<float>(i - first) / FadeFrames;
+            for (unsigned j = 0; j < channels; ++j)
+                output.sample(i, j) += (planes[j][i - pos] - output.sample(i, j)) * t;
+        }
+        for (; i < end; ++i)
+            for (unsigned j = 0; j < channels; ++j)
+                output.sample(i, j) = planes[j][i - pos];
+        
+        // running sums and extremes in frame order, for the normalize pass
+        for (i = pos; i < end; ++i)
+            for (unsigned j = 0; j < channels; ++j) {
+                float value = output.sample(i, j);
+                sums[j] += value;
+                lows[j] = std::min(lows[j], value);
+                highs[j] = std::max(highs[j], value);
+            }
+        overview.Update(output, pos, end);
+        
+        pos = end;
+        rendered.store(pos, std::memory_order_release);
+    }
+    StopHelpers();
+    
+    // same result as normalize() without touching the output: the furthest
+    // sample from the offset is one of the extremes
+    MR_TRACE_SCOPE("normalize");
+    float peak = 0.0f;
+    for (unsigned j = 0; j < channels && total > 0; ++j) {
+        offsets[j] = static_cast<float>(sums[j] / total);
+        peak = std::max(peak, std::max(highs[j] - offsets[j], offsets[j] - lows[j]));
+    }
+    
+    if (peak > 0.0f)
+        gain.store(target / peak, std::memory_order_relaxed);
+    
+    // what normalize() would make of the output, for the cache, off the message thread
+    if (copy && first == 0) {
+        MR_TRACE_SCOPE("normalized copy");
+        const float scale = peak > 0.0f ? target / peak : 1.0f;
+        std::shared_ptr<AudioData> out(new AudioData(total, output.rate(), channels));
+        for (size_t i = 0; i < total; ++i)
+            for (unsigned j = 0; j < channels; ++j)
+                out->sample(i, j) = (output.sample(i, j) - offsets[j]) * scale;
+        normalized = out;
+    }
+    finished.store(true, std::memory_order_release);
+}
+
+//==============================================================================
+// Checkpoint check
+
+static void Wait(RenderJob &job)
+{
+    while (!job.Finished() && !job.Cancelled())
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+}
+
+std::string CheckCheckpoints(bool &passed)
+{
+    const unsigned rate = 44100, channels = 2;
+    const double seconds = 60.0, every = 5.0;
+    const unsigned tail = 2000;
+
+    // a minute of noise bursts
+    AudioData input(static_cast<size_t>(seconds * rate), rate, channels);
+    Lcg lcg;
+    for (size_t i = 0; i < input.frames(); ++i)
+        for (unsigned j = 0; j < channels; ++j) {
+            float v = lcg.Noise();
+            input.sample(i, j) = ((i / rate) % 3 == 0) ? v : 0.0f;
+        }
+
+    Reverb reverb;
+    reverb.SetSamplingRate(rate);
+    reverb.Reset();
+
+    auto start = std::chrono::steady_clock::now();
+    RenderJob full(input, reverb, tail);
+    full.SetCheckpointInterval(every);
+    full.Start();
+    Wait(full);
+    std::chrono::duration<double, std::milli> fullTime = std::chrono::steady_clock::now() - start;
+
+    // seek near the end with unchanged parameters: same output from the checkpoint on
+    const size_t seek = static_cast<size_t>((seconds - 7.0) * rate);
+    start = std::chrono::steady_clock::now();
+    RenderJob resumed(input, reverb, tail);
+    resumed.SetCheckpointInterval(every);
+    bool ok = resumed.Resume(full.Output(), full.Checkpoints(), seek);
+    resumed.Start();
+    Wait(resumed);
+    std::chrono::duration<double, std::milli> resumeTime = std::chrono::steady_clock::now() - start;
+
+    float error = 0.0f, peak = 0.0f;
+    for (size_t i = 0; i < full.Output().size(); ++i) {
+        error = std::max(error, std::abs(full.Output().data()[i] - resumed.Output().data()[i]));
+        peak = std::max(peak, std::abs(full.Output().data()[i]));
+    }
+
+    // changed parameters apply from the checkpoint, earlier output is kept
+    Reverb changed = reverb;
+    changed.SetCombZeroFreqGain(0.9, 0);
+    RenderJob edit(input, changed, tail);
+    edit.Resume(full.Output(), full.Checkpoints(), seek, &full.Overview());
+    edit.Start();
+    Wait(edit);
+    const size_t from = RenderJob::Nearest(full.Checkpoints(), seek)->frame;
+    bool kept = std::equal(full.Output().data(), full.Output().data() + from * channels, edit.Output().data());
+    bool differs = !std::equal(full.Output().data() + from * channels, full.Output().data() + full.Output().size(),
+                               edit.Output().data() + from * channels);
+
+    // carried sums, extremes and overview buckets match a scan of the whole output
+    const AudioData &out = edit.Output();
+    float editPeak = 0.0f;
+    bool offsetsMatch = true;
+    for (unsigned j = 0; j < channels; ++j) {
+        double sum = 0.0;
+        for (size_t i = 0; i < out.frames(); ++i)
+            sum += out.sample(i, j);
+        float offset = static_cast<float>(sum / out.frames());
+        offsetsMatch = offsetsMatch && offset == edit.Offset(j);
+        for (size_t i = 0; i < out.frames(); ++i)
+            editPeak = std::max(editPeak, std::abs(out.sample(i, j) - offset));
+    }
+    bool gainMatches = edit.Gain() == std::pow(10.0f, -1.5f / 20.0f) / editPeak;
+    
+    WaveOverview built(out.frames(), channels);
+    built.Build(out, 1);
+    bool overviewMatches = edit.Overview().Ready() == out.frames();
+    for (unsigned columns : { 1u, 100u, 5000u })
+        for (unsigned j = 0; j < channels; ++j) {
+            std::vector<WaveOverview::Bucket> a(columns), b(columns);
+            built.Query(j, 0.0, static_cast<double>(out.frames()), a.data(), columns);
+            edit.Overview().Query(j, 0.0, static_cast<double>(out.frames()), b.data(), columns);
+            for (unsigned k = 0; k < columns; ++k)
+                overviewMatches = overviewMatches && a[k].min == b[k].min && a[k].max == b[k].max &&
+                                  a[k].power == b[k].power;
+        }
+    
+    passed = ok && error <= peak * 1.0e-5f && kept && differs && offsetsMatch && gainMatches && overviewMatches;
+
+    std::ostringstream report;
+    report << "checkpoints: " << full.Checkpoints().size() << " every " << every << " s, "
+           << full.CheckpointBytes() / full.Checkpoints().size() / 1024 << " KB each, "
+           << 100.0 * full.CheckpointBytes() / (full.Output().size() * sizeof(float)) << "% of the output\n";
+    report << "resume at " << from / double(rate) << " s: " << resumeTime.count() << " ms vs "
+           << fullTime.count() << " ms full render\n";
+    report << "max error: " << error / peak << " of peak" << (error <= peak * 1.0e-5f ? " (ok)" : " (failed)") << "\n";
+    report << "edit keeps earlier output: " << (kept ? "yes" : "no") << ", changes later output: "
+           << (differs ? "yes" : "no") << (kept && differs ? " (ok)" : " (failed)") << "\n";
+    report << "resumed normalization matches a full scan: " << (offsetsMatch && gainMatches ? "yes (ok)" : "no (failed)")
+           << ", overview matches a full build: " << (overviewMatches ? "yes (ok)" : "no (failed)") << "\n";
+    return report.str();
+}
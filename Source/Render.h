@@ -0,0 +1,140 @@
+// Render.h
+// Spring 2021
+
+#pragma once
+#include <atomic> // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <memory> // std::shared_ptr
+#include <mutex>  // std::mutex
+#include <string> // std::string
+#include <thread> // std::thread
+#include <vector> // std::vector
+#include "AudioData.h" // audio buffer
+#include "Reverb.h"    // moorer reverb filter
+#include "Convolver.h" // impulse response convolution
+#include "StereoReverb.h" // shared comb bank stereo reverb
+#include "FdnReverb.h"  // feedback delay network reverb
+#include "Multirate.h" // decimated comb bank
+#include "Overview.h"  // waveform overview
+
+// offline reverb render on a worker thread
+// output frames [0, Rendered()) can be played while the render runs
+class RenderJob
+{
+public:
+    enum Mode
+    {
+        Recursive,   // comb/allpass network
+        Convolution, // captured impulse response, partitioned fft convolution
+        Stereo,      // one comb bank for both channels, decorrelated outputs (stereo input, else Recursive)
+        Fdn,         // 16 line feedback delay network instead of the comb bank
+        Eco          // comb bank at 1/2 the rate (1/4 from 176.4 kHz) on the low band, echoes on the high band
+    };
+    
+    // reverb states at the start of an output frame, one per channel, and
+    // what the normalize pass needs of the output before it
+    struct Checkpoint
+    {
+        size_t frame;
+        std::vector<Reverb::State> states;
+        std::vector<double> sums;       // per channel, sum of frames [0, frame)
+        std::vector<float> lows, highs; // per channel, their extremes
+    };
+    
+    // input must outlive the job, tail in ms, dB = normalization target
+    RenderJob(const AudioData &input, const Reverb &reverb, unsigned tail, float dB = -1.5f,
+              Mode mode = Recursive);
+    ~RenderJob(); // cancels render
+    
+    // before Start, checkpointable modes only: store a checkpoint every seconds (0 = none)
+    void SetCheckpointInterval(double seconds);
+    // before Start, checkpointable modes only: keep previous output before the latest
+    // checkpoint at or before frame and render from there with this job's
+    // parameters, crossfading from the previous output over FadeFrames; the
+    // kept frames aren't summarized again with the previous output's overview.
+    // returns false, rendering from the start, without a usable checkpoint at or before frame
+    bool Resume(const AudioData &previous, const std::vector<Checkpoint> &points, size_t frame,
+                const WaveOverview *previousOverview = nullptr);
+    // before Start: once finished, also keep a normalized copy of a full render
+    void SetNormalizedCopy(bool on) { copy = on; }
+    
+    void Start();  // start worker thread
+    void Cancel(); // stop an unfinished render and wait for the worker
+    
+    size_t Rendered() const;   // frames ready for playback
+    double Progress() const;   // fraction of output rendered [0,1]
+    bool Finished() const;     // render and normalization pass complete
+    bool Cancelled() const;    // render stopped before finishing
+    
+    // playback normalization: (sample - offset) * gain
+    // gain is a conservative prediction until finished, offsets are zero
+    float Gain() const;
+    float Offset(unsigned channel) const;
+    
+    AudioData & Output() { return output; } // unnormalized output
+    std::shared_ptr<const AudioData> Normalized() const; // normalized copy once finished, see SetNormalizedCopy
+    const WaveOverview & Overview() const { return overview; } // of the unnormalized output, follows Rendered()
+    
+    const std::vector<Checkpoint> & Checkpoints() const { return checkpoints; } // valid once finished
+    size_t CheckpointBytes() const;
+    bool Resumed() const { return first > 0; } // output mixes two parameter sets
+    bool Checkpointable() const; // channels render through revs, so checkpoints and Resume work
+    Mode GetMode() const { return mode; }
+    
+    // latest checkpoint at or before frame, nullptr if none
+    static const Checkpoint * Nearest(const std::vector<Checkpoint> &points, size_t frame);
+    
+    static const unsigned ChunkFrames = 8192; // frames rendered per progress update
+    static const unsigned ConvolutionBlock = 4096; // uniform partition size for offline renders
+    static const unsigned FadeFrames = 512; // resume crossfade
+private:
+    void Run(); // worker thread
+    void RenderChannel(unsigned channel, size_t start, size_t end); // into planes[channel]
+    void RenderChannels(size_t start, size_t end); // every channel, helpers render all but the first
+    void Helper(unsigned channel); // helper thread, renders its channel of each chunk
+    void StopHelpers();
+    void RenderStereo(size_t start, size_t end); // both channels into planes
+    
+    const AudioData &input;
+    AudioData output;
+    WaveOverview overview;
+    std::vector<Reverb> revs; // reverb state per channel
+    std::vector<Convolver> convs; // convolver per channel (convolution mode)
+    std::vector<StereoReverb> stereo; // shared stereo reverb (stereo mode, two channels)
+    std::vector<FdnReverb> fdns; // delay network per channel (fdn mode)
+    std::vector<MultirateReverb> ecos; // decimated reverb per channel (eco mode)
+    std::vector<std::vector<float>> planes; // chunk output per channel
+    Mode mode;
+    float target;             // normalization target (linear)
+    
+    std::vector<Checkpoint> checkpoints;
+    size_t interval; // frames between checkpoints, 0 = none
+    size_t first;    // first rendered frame, earlier ones were resumed from
+    size_t faded;    // output before this holds previous output (resume)
+    
+    std::vector<double> sums;       // per channel, sum of frames [0, Rendered())
+    std::vector<float> lows, highs; // per channel, their extremes
+    std::vector<float> offsets;     // dc offset per channel, valid once finished
+    bool copy;                      // make normalized
+    std::shared_ptr<const AudioData> normalized;
+    std::atomic<float> gain;        // playback gain
+    std::atomic<size_t> rendered;   // frames rendered
+    std::atomic<bool> finished;
+    std::atomic<bool> cancelled;
+    
+    std::thread worker;
+    
+    // one helper per channel after the first, started once per render
+    std::vector<std::thread> helpers;
+    std::mutex chunkLock;
+    std::condition_variable chunkWake;
+    size_t chunkStart, chunkEnd; // chunk being rendered
+    unsigned chunkCount;         // chunks handed out
+    unsigned chunkDone;          // helpers done with the current chunk
+    bool helpersQuit;
+};
+
+// resumes a checkpointed render with unchanged parameters and compares it
+// with the continuous render; reports checkpoint size and frames saved
+std::string CheckCheckpoints(bool &passed);
+
@@ -0,0 +1,248 @@
+// RenderCache.cpp
+// Spring 2021
+
+#include "RenderCache.h"
+#include <cstdio>  // std::snprintf
+#include <fstream>
+
+using namespace std;
+
+const size_t RenderCache::DefaultBudget;
+
+// spill file header
+struct SpillHeader
+{
+    char tag[4];       // "MRC3"
+    unsigned rate;
+    unsigned long long frames;
+    unsigned channels;
+    unsigned reserved;
+    unsigned long long input, params; // key, a file of another key is never played
+};
+
+static size_t Bytes(const AudioData &data)
+{
+    return data.size() * sizeof(float);
+}
+
+RenderCache::RenderCache(size_t budget, const std::string &dir) :
+lru(), index(), bytes(0), budget(budget), dir(dir), lock(), spills(), spillWake(), spiller(), closing(false)
+{
+}
+
+RenderCache::~RenderCache()
+{
+    {
+        lock_guard<mutex> hold(lock);
+        closing = true;
+    }
+    spillWake.notify_all();
+    if (spiller.joinable())
+        spiller.join();
+}
+
+// hashes format and samples of input
+Hash64 RenderCache::HashInput(const AudioData &input)
+{
+    Hash64 h = HashValue(input.frames());
+    h = HashValue(input.rate(), h);
+    h = HashValue(input.channels(), h);
+    
+    if (input.size() > 0)
+        h = HashBytes(input.data(), Bytes(input), h);
+    
+    return h;
+}
+
+RenderCache::Key RenderCache::MakeKey(Hash64 input, Reverb &reverb, unsigned tail, unsigned mode)
+{
+    Hash64 h = HashValue(tail, reverb.GetParameterHash());
+    return Key{ input, HashValue(mode, h) };
+}
+
+// returns cached output, checks disk if not in memory; the file is read without
+// the lock, so the spiller and other callers never wait on the read
+std::shared_ptr<const AudioData> RenderCache::Find(Key key)
+{
+    unique_lock<mutex> hold(lock);
+    
+    auto it = index.find(key);
+    if (it != index.end()) {
+        // move to front (most recent)
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->data;
+    }
+    
+    // evicted but not written yet
+    std::shared_ptr<const AudioData> data;
+    for (const Entry &e : spills)
+        if (e.key == key)
+            data = e.data;
+    
+    if (!data && !dir.empty()) {
+        std::string from = dir;
+        hold.unlock();
+        data = Load(from, key);
+        hold.lock();
+        if (!data)
+            return nullptr;
+        
+        // inserted while the file was read
+        it = index.find(key);
+        if (it != index.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->data;
+        }
+    }
+    
+    if (data) {
+        lru.push_front(Entry{key, data});
+        index[key] = lru.begin();
+        bytes += Bytes(*data);
+        Evict();
+    }
+    
+    return data;
+}
+
+void RenderCache::Insert(Key key, std::shared_ptr<const AudioData> output)
+{
+    if (!output)
+        return;
+    
+    lock_guard<mutex> hold(lock);
+    
+    // replace existing entry
+    auto it = index.find(key);
+    if (it != index.end()) {
+        bytes -= Bytes(*it->second->data);
+        lru.erase(it->second);
+        index.erase(it);
+    }
+    
+    lru.push_front(Entry{key, output});
+    index[key] = lru.begin();
+    bytes += Bytes(*output);
+    Evict();
+}
+
+void RenderCache::Clear()
+{
+    lock_guard<mutex> hold(lock);
+    lru.clear();
+    index.clear();
+    bytes = 0;
+}
+
+void RenderCache::SetBudget(size_t new_budget)
+{
+    lock_guard<mutex> hold(lock);
+    budget = new_budget;
+    Evict();
+}
+
+void RenderCache::SetDirectory(const std::string &new_dir)
+{
+    lock_guard<mutex> hold(lock);
+    dir = new_dir;
+}
+
+size_t RenderCache::GetBytes()
+{
+    lock_guard<mutex> hold(lock);
+    return bytes;
+}
+
+// evicts least recently used entries, caller holds lock;
+// spills are written by the spiller thread, so callers never wait on the disk
+void RenderCache::Evict()
+{
+    while (bytes > budget && !lru.empty()) {
+        Entry &oldest = lru.back();
+        
+        if (!dir.empty()) {
+            spills.push_back(oldest);
+            if (!spiller.joinable())
+                spiller = std::thread(&RenderCache::Spiller, this);
+            spillWake.notify_all();
+        }
+        
+        bytes -= Bytes(*oldest.data);
+        index.erase(oldest.key);
+        lru.pop_back(); // playback may still hold the data
+    }
+}
+
+// an entry stays queued while it is written, so Find still sees it;
+// pending spills are finished before closing
+void RenderCache::Spiller()
+{
+    unique_lock<mutex> hold(lock);
+    while (true) {
+        spillWake.wait(hold, [this] { return closing || !spills.empty(); });
+        if (spills.empty())
+            return;
+        
+        Entry next = spills.front();
+        std::string to = dir;
+        hold.unlock();
+        if (!to.empty())
+            Spill(to, next.key, *next.data);
+        hold.lock();
+        spills.pop_front();
+    }
+}
+
+std::string RenderCache::Path(const std::string &dir, Key key)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "%016llx%016llx.mrc", key.input, key.params);
+    return dir + "/" + name;
+}
+
+// writes output as raw float samples
+bool RenderCache::Spill(const std::string &dir, Key key, const AudioData &data)
+{
+    std::string path = Path(dir, key);
+    std::string temp = path + ".tmp";
+    
+    fstream out(temp.c_str(), ios_base::binary | ios_base::out | ios_base::trunc);
+    if (!out.is_open())
+        return false;
+    
+    SpillHeader header = { {'M', 'R', 'C', '3'}, data.rate(), data.frames(), data.channels(), 0, key.input, key.params };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (data.size() > 0)
+        out.write(reinterpret_cast<const char*>(data.data()), Bytes(data));
+    out.close();
+    
+    // readers never see a partial file
+    if (!out || rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+std::shared_ptr<const AudioData> RenderCache::Load(const std::string &dir, Key key)
+{
+    fstream in(Path(dir, key).c_str(), ios_base::binary | ios_base::in);
+    if (!in)
+        return nullptr;
+    
+    SpillHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || header.tag[0] != 'M' || header.tag[1] != 'R' || header.tag[2] != 'C' || header.tag[3] != '3'
+        || header.input != key.input || header.params != key.params)
+        return nullptr;
+    
+    std::shared_ptr<AudioData> data(new AudioData(static_cast<size_t>(header.frames), header.rate, header.channels));
+    if (data->size() > 0)
+        in.read(reinterpret_cast<char*>(data->data()), Bytes(*data));
+    
+    if (!in)
+        return nullptr;
+    
+    return data;
+}
@@ -0,0 +1,77 @@
+// RenderCache.h
+// Spring 2021
+
+#pragma once
+#include <condition_variable> // std::condition_variable
+#include <deque>         // std::deque
+#include <list>          // std::list
+#include <memory>        // std::shared_ptr
+#include <mutex>         // std::mutex
+#include <string>        // std::string
+#include <thread>        // std::thread
+#include <unordered_map> // std::unordered_map
+#include "AudioData.h"   // audio buffer
+#include "Reverb.h"      // moorer reverb filter
+#include "Hash.h"        // Hash64
+
+// cache of rendered reverb outputs keyed by input and parameters
+// keeps recent outputs in memory up to a byte budget (least recently used
+// are evicted first) and, when a directory is set, spills evictions to disk
+// on a background thread; spill files carry their key and are checked on load
+class RenderCache
+{
+public:
+    // input and parameters hashed apart, a wrong hit needs both to collide
+    struct Key
+    {
+        Hash64 input;  // HashInput
+        Hash64 params; // reverb parameters, tail and render mode
+        
+        bool operator==(const Key &other) const { return input == other.input && params == other.params; }
+    };
+    
+    RenderCache(size_t budget = DefaultBudget, const std::string &dir = "");
+    ~RenderCache(); // finishes pending spills
+    
+    static Hash64 HashInput(const AudioData &input);            // input identity
+    static Key MakeKey(Hash64 input, Reverb &reverb, unsigned tail, unsigned mode = 0); // tail in ms, render mode
+    
+    std::shared_ptr<const AudioData> Find(Key key); // nullptr if not cached
+    void Insert(Key key, std::shared_ptr<const AudioData> output);
+    void Clear(); // memory only, disk entries are kept
+    
+    void SetBudget(size_t bytes);             // memory budget (bytes)
+    void SetDirectory(const std::string &dir); // disk spill directory, "" = none
+    size_t GetBytes();                        // bytes held in memory
+    
+    static const size_t DefaultBudget = 512u << 20; // 512 MB
+private:
+    struct Entry
+    {
+        Key key;
+        std::shared_ptr<const AudioData> data;
+    };
+    
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const { return static_cast<size_t>(HashValue(key.params, key.input)); }
+    };
+    
+    void Evict(); // drop entries until within budget, queueing spills
+    void Spiller(); // writes queued spills
+    static std::string Path(const std::string &dir, Key key);
+    static bool Spill(const std::string &dir, Key key, const AudioData &data);
+    static std::shared_ptr<const AudioData> Load(const std::string &dir, Key key);
+    
+    std::list<Entry> lru; // most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+    size_t bytes;  // bytes in memory
+    size_t budget; // memory budget
+    std::string dir;
+    std::mutex lock;
+    
+    std::deque<Entry> spills; // evicted, still readable until written
+    std::condition_variable spillWake;
+    std::thread spiller;      // started by the first spill
+    bool closing;
+};
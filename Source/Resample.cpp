@@ -0,0 +1,197 @@
+// Resample.cpp
+// Spring 2021
+
+#include "Resample.h"
+#include "Kernels.h"
+#include "Trace.h"
+#include <algorithm> // std::min
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+const unsigned Resampler::ZeroCrossings;
+const unsigned Resampler::MaxPhases;
+
+static unsigned Gcd(unsigned a, unsigned b)
+{
+    while (b) {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// zeroth order modified bessel function, for the kaiser window
+static double Bessel0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+double Kaiser(double w, double beta)
+{
+    return (std::abs(w) < 1.0) ? Bessel0(beta * std::sqrt(1.0 - w * w)) / Bessel0(beta) : 0.0;
+}
+
+// builds the filter table: kaiser windowed sinc, cutoff just below the lower nyquist
+Resampler::Resampler(unsigned from, unsigned to) :
+up(1), down(1), phases(1), taps(2), table(), history(), produced(0), consumed(0)
+{
+    if (from == 0 || to == 0)
+        throw std::invalid_argument("sampling rate must be positive");
+    
+    unsigned g = Gcd(from, to);
+    up = to / g;
+    down = from / g;
+    phases = (up < MaxPhases) ? up : MaxPhases;
+    
+    // downsampling widens the filter to cut below the output nyquist
+    const double pi = 3.14159265358979323846;
+    const double beta = 8.6; // ~90 dB stopband
+    double scale = (up < down) ? static_cast<double>(up) / down : 1.0;
+    double cutoff = 0.95 * scale;
+    unsigned half = static_cast<unsigned>(std::ceil(ZeroCrossings / scale));
+    taps = 2 * half;
+    
+    // fewer phases than up round some outputs up to frac 1, one input sample past phase 0
+    unsigned entries = (phases < up) ? phases + 1 : phases;
+    table.resize(static_cast<size_t>(entries) * taps);
+    
+    for (unsigned p = 0; p < entries; ++p) {
+        float *h = &table[static_cast<size_t>(p) * taps];
+        double frac = static_cast<double>(p) / phases;
+        double sum = 0.0;
+        
+        // tap j sits at input offset (j - half + 1) from the output's integer position
+        for (unsigned j = 0; j < taps; ++j) {
+            double d = frac + half - 1.0 - j;
+            double x = cutoff * d;
+            double sinc = (x == 0.0) ? 1.0 : std::sin(pi * x) / (pi * x);
+            double w = d / half;
+            h[j] = static_cast<float>(sinc * Kaiser(w, beta));
+            sum += h[j];
+        }
+        
+        // unity gain at dc for every phase
+        for (unsigned j = 0; j < taps; ++j)
+            h[j] = static_cast<float>(h[j] / sum);
+    }
+    
+    Reset();
+}
+
+void Resampler::Reset()
+{
+    history.assign(GetPadding(), 0.0f);
+    produced = 0;
+    consumed = 0;
+}
+
+const float * Resampler::Phase(unsigned long long k) const
+{
+    unsigned long long p = (k * down) % up;
+    if (phases != up)
+        p = (p * phases + up / 2) / up; // nearest
+
+    return &table[static_cast<size_t>(p) * taps];
+}
+
+size_t Resampler::MaxOutput(size_t n) const
+{
+    return static_cast<size_t>((static_cast<unsigned long long>(n) * up) / down) + 1;
+}
+
+unsigned long long Resampler::OutputFrames(unsigned long long n) const
+{
+    return (n * up + down - 1) / down;
+}
+
+size_t Resampler::Process(const float *in, size_t n, float *out)
+{
+    history.insert(history.end(), in, in + n);
+    const DspKernels &k = GetKernels();
+    size_t written = 0;
+    
+    // output k needs padded input [k * down / up, + taps)
+    for (;;) {
+        unsigned long long base = (produced * down) / up - consumed;
+        if (base + taps > history.size())
+            break;
+        out[written++] = k.Dot(Phase(produced), &history[static_cast<size_t>(base)], taps);
+        ++produced;
+    }
+    
+    // keep only what later outputs can reach
+    unsigned long long base = (produced * down) / up - consumed;
+    history.erase(history.begin(), history.begin() + static_cast<size_t>(base));
+    consumed += base;
+    
+    return written;
+}
+
+void Resampler::Render(const float *padded, unsigned long long first, size_t count, float *out) const
+{
+    const DspKernels &k = GetKernels();
+    for (size_t i = 0; i < count; ++i) {
+        unsigned long long n = first + i;
+        out[i] = k.Dot(Phase(n), padded + (n * down) / up, taps);
+    }
+}
+
+AudioData Resample(const AudioData &in, unsigned rate, std::function<bool(double)> progress)
+{
+    const Resampler resampler(in.rate(), rate);
+    unsigned nch = in.channels();
+    unsigned long long frames = resampler.OutputFrames(in.frames());
+    AudioData out(static_cast<size_t>(frames), rate, nch);
+    
+    unsigned threads = std::thread::hardware_concurrency();
+    threads = threads ? threads : 1;
+    const size_t segment = 1 << 14; // output frames per work item
+    size_t segments = static_cast<size_t>((frames + segment - 1) / segment);
+    
+    for (unsigned c = 0; c < nch; ++c) {
+        // zero padded copy of the channel
+        std::vector<float> padded(resampler.GetPadding() + in.frames() + resampler.GetTaps(), 0.0f);
+        for (size_t i = 0; i < in.frames(); ++i)
+            padded[resampler.GetPadding() + i] = in.sample(i, c);
+        
+        // threads take segments until none are left; the calling thread reports
+        // progress after each of its segments, and a cancel stops every thread
+        std::atomic<size_t> next(0), done(0);
+        std::atomic<bool> cancelled(false);
+        auto work = [&](bool reporting) {
+            MR_TRACE_SCOPE_ARG("resample", "channel", c);
+            std::vector<float> plane(segment);
+            for (size_t s = next++; s < segments && !cancelled; s = next++) {
+                unsigned long long first = static_cast<unsigned long long>(s) * segment;
+                size_t count = static_cast<size_t>(std::min<unsigned long long>(segment, frames - first));
+                resampler.Render(&padded[0], first, count, &plane[0]);
+                for (size_t i = 0; i < count; ++i)
+                    out.sample(static_cast<size_t>(first) + i, c) = plane[i];
+                
+                double fraction = (c + static_cast<double>(++done) / segments) / nch;
+                if (reporting && progress && !progress(fraction))
+                    cancelled = true;
+            }
+        };
+        
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t)
+            pool.push_back(std::thread(work, false));
+        work(true);
+        for (std::thread &t : pool)
+            t.join();
+        
+        if (cancelled || (progress && !progress(static_cast<double>(c + 1) / nch)))
+            throw std::runtime_error("resampling cancelled");
+    }
+    
+    return out;
+}
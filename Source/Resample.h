@@ -0,0 +1,53 @@
+// Resample.h
+// Spring 2021
+
+#pragma once
+#include <functional> // std::function
+#include <vector>     // std::vector
+#include "AudioData.h" // audio buffer
+
+// polyphase windowed-sinc sample rate converter for one channel
+// the rate ratio is reduced to to/from = up/down, output frame k sits at
+// input position k * down / up and is a dot product of one filter phase
+// with the input around it
+class Resampler
+{
+public:
+    Resampler(unsigned from, unsigned to);
+    
+    void Reset(); // clear streaming history
+    
+    // streaming: returns frames written to out, which must hold MaxOutput(n)
+    size_t Process(const float *in, size_t n, float *out);
+    size_t MaxOutput(size_t n) const;
+    
+    // offline: output frames for n input frames
+    unsigned long long OutputFrames(unsigned long long n) const;
+    // offline: writes output frames [first, first + count) from padded, the
+    // input with GetPadding() zeros before it and GetTaps() zeros after it
+    void Render(const float *padded, unsigned long long first, size_t count, float *out) const;
+    
+    unsigned GetPadding() const { return taps / 2 - 1; }
+    unsigned GetTaps() const    { return taps; }
+    
+    static const unsigned ZeroCrossings = 16; // filter half width in input periods at unity ratio
+    static const unsigned MaxPhases = 4096;   // odd ratios round to the nearest of MaxPhases phases
+private:
+    const float * Phase(unsigned long long k) const; // filter for output frame k
+    
+    unsigned up, down;           // reduced ratio
+    unsigned phases;             // filter phases in table
+    unsigned taps;               // coefficients per phase
+    std::vector<float> table;    // phases * taps
+    
+    std::vector<float> history;  // streaming input not yet consumed
+    unsigned long long produced; // streaming output frames
+    unsigned long long consumed; // input frames dropped from history
+};
+
+// kaiser window at w in (-1, 1), zero outside
+double Kaiser(double w, double beta);
+
+// converts every channel of in to rate, output segments are shared across threads
+// progress gets the fraction done [0,1] and returns false to cancel (throws)
+AudioData Resample(const AudioData &in, unsigned rate, std::function<bool(double)> progress = nullptr);
@@ -3,8 +3,9 @@
 
 
 #include <utility> // std::pair
-#include <cmath>   // std::round
+#include <cmath>   // std::round, std::log10
 #include "Reverb.h"
+#include "Kernels.h" // vectorized block kernels
 
 //==============================================================================
 // Moorer Default Values
@@ -50,27 +51,23 @@ float GetParamG(unsigned rate, unsigned index)
     return rate * ((G50[index] - G25[index]) / Diff);
 }
 
-// returns delay in samples
+// returns delay in samples, rounded
 // rate = sampling rate, time = time in ms
-unsigned GetNumSamples(unsigned rate, unsigned time)
+unsigned GetNumSamples(unsigned rate, double time)
 {
-    return rate * time / 1000;
-}
-
-// returns delay in ms
-unsigned GetDelayMS(unsigned rate, unsigned samples)
-{
-    unsigned delay = std::round(1000.0 * samples / rate);
-    return delay;
+    return static_cast<unsigned>(std::round(time > 0.0 ? rate * time / 1000.0 : 0.0));
 }
 
 //=============================================================================
 // Moorer Reverb Filter
-Reverb::Reverb() : fs(fs_def), dry(k_def), wet(1.0 - dry), combs(), ap(a_def, GetNumSamples(fs, m_def))
+const unsigned Reverb::BlockSize;
+
+Reverb::Reverb() : fs(fs_def), dry(k_def), wet(1.0 - dry), combs(), combMs(), ap(a_def, GetNumSamples(fs, m_def)), apMs(m_def), early(fs), earlyOn(false)
 {
     // initialize comb filters
-    for (int i = 0; i < NumCombs; ++i) {
+    for (unsigned i = 0; i < NumCombs; ++i) {
         combs.push_back(Comb(GetNumSamples(fs, Delays[i]), GetParamG(fs, i)));
+        combMs.push_back(Delays[i]);
     }
     
     Reset();
@@ -86,43 +83,143 @@ void Reverb::Reset()
     
     // reset allpass filter
     ap.Reset();
+    
+    early.Reset();
 }
 
-// set sampling rate
+// set sampling rate, delays stay the same in ms
 void Reverb::SetSamplingRate(unsigned rate)
 {
-    unsigned old = fs;
     fs = rate;
 
-    // reset comb params
-    for (Comb & c : combs) {
-        c.SetDelay(c.GetDelay() * fs / old);
-    }
+    for (unsigned i = 0; i < combs.size(); ++i)
+        combs[i].SetDelay(GetNumSamples(fs, combMs[i]));
+    ap.SetDelay(GetNumSamples(fs, apMs));
+    early.SetSamplingRate(fs);
 }
 
 // set dry percentage K
 void Reverb::SetDryPercetage(unsigned new_K)
 {
-    dry = new_K / 100.0;
+    SetDry(new_K / 100.0);
+}
+
+// set dry fraction, need not be a whole percentage
+void Reverb::SetDry(double new_dry)
+{
+    dry = new_dry;
     wet = 1.0 - dry;
 }
 
 // returns sampling rate
-unsigned Reverb::GetSamplingRate()
+unsigned Reverb::GetSamplingRate() const
 {
     return fs;
 }
 
 // returns dry percentage K
-unsigned Reverb::GetDryPercentage()
+unsigned Reverb::GetDryPercentage() const
 {
     return dry * 100;
 }
 
+double Reverb::GetDry() const
+{
+    return dry;
+}
+
+double Reverb::GetWet() const
+{
+    return wet;
+}
+
+// returns the impulse response's L1 norm bound, the largest output peak for a unit input peak:
+// dry + wet * comb bank norm * allpass norm; early reflections scale the comb
+// input and add their own output
+double Reverb::GetMaxGain()
+{
+    double late = GetCombGain() * AllPassGain(ap.GetCoefficient());
+    if (earlyOn)
+        return dry + wet * early.GetGainSum() * (1.0 + late);
+    return dry + wet * late;
+}
+
+// comb response z^-L / (1 - R z^-L / (1 - g z^-1)) has no negative terms for g, R >= 0,
+// so its L1 norm is the dc gain (1 - g) / (1 - g - R)
+double Reverb::GetCombGain()
+{
+    double sum = 0.0;
+    for (Comb & c : combs) {
+        double g = c.GetLowPassG();
+        double loop = 1.0 - g - c.GetGainConstant();
+        sum += (loop > 0.0) ? (1.0 - g) / loop : 1.0e6; // unstable comb
+    }
+    return sum;
+}
+
+// allpass response -a, then (1 - a^2) a^(k-1) every m samples: L1 norm 1 + 2|a|
+double Reverb::AllPassGain(double a)
+{
+    return 1.0 + 2.0 * std::abs(a);
+}
+
+// returns the slowest comb's decay plus the allpass decay
+// a comb loses its loop gain R / (1 - g) every L samples, the allpass a every M samples
+double Reverb::GetDecayTime(double dB)
+{
+    const double ratio = -dB / 20.0; // log10 of the amplitude ratio
+    double slowest = 0.0;
+    for (Comb & c : combs) {
+        double loop = c.GetZeroFreqGain();
+        double seconds = static_cast<double>(c.GetDelay()) / fs;
+        if (loop >= 1.0)
+            return 1.0e6; // unstable comb
+        if (loop > 0.0)
+            seconds *= ratio / std::log10(loop);
+        slowest = seconds > slowest ? seconds : slowest;
+    }
+    
+    double a = std::abs(ap.GetCoefficient());
+    double allpass = static_cast<double>(ap.GetDelay()) / fs;
+    if (a > 0.0 && a < 1.0)
+        allpass *= ratio / std::log10(a);
+    
+    return slowest + allpass + (earlyOn ? early.GetLength() : 0.0);
+}
+
+// returns hash of sampling rate, dry percentage and all filter parameters
+// delays are hashed in samples so rate changes are seen exactly
+Hash64 Reverb::GetParameterHash(Hash64 seed)
+{
+    Hash64 h = HashValue(fs, seed);
+    h = HashValue(dry, h);
+    h = HashValue(ap.GetCoefficient(), h);
+    h = HashValue(ap.GetDelay(), h);
+    
+    for (Comb & c : combs) {
+        h = HashValue(c.GetDelay(), h);
+        h = HashValue(c.GetLowPassG(), h);
+        h = HashValue(c.GetGainConstant(), h);
+        h = HashValue(c.GetZeroFreqGain(), h);
+    }
+    
+    // unchanged when off, so earlier renders stay cached
+    if (earlyOn)
+        h = early.GetParameterHash(HashValue(earlyOn, h));
+    
+    return h;
+}
+
 // sets allpass delay
 void Reverb::SetAllPassDelay(unsigned delay)
 {
-    ap.SetDelay(GetNumSamples(fs, delay));
+    SetAllPassDelayMs(delay);
+}
+
+void Reverb::SetAllPassDelayMs(double ms)
+{
+    apMs = ms > 0.0 ? ms : 0.0;
+    ap.SetDelay(GetNumSamples(fs, apMs));
 }
 
 // sets allpass coefficient a
@@ -134,7 +231,7 @@ void Reverb::SetAllPassCoeff(double a)
 // returns allpass delay
 float Reverb::GetAllPassDelay()
 {
-    return GetDelayMS(fs, ap.GetDelay());
+    return static_cast<float>(apMs);
 }
 
 // returns allpass coefficient a
@@ -143,10 +240,21 @@ float Reverb::GetAllPassCoeff()
     return ap.GetCoefficient();
 }
 
+double Reverb::GetAllPassDelayMs() const
+{
+    return apMs;
+}
+
 // sets comb delay
 void Reverb::SetCombDelay(unsigned delay, unsigned i)
 {
-    combs[i].SetDelay(GetNumSamples(fs, delay));
+    SetCombDelayMs(delay, i);
+}
+
+void Reverb::SetCombDelayMs(double ms, unsigned i)
+{
+    combMs[i] = ms > 0.0 ? ms : 0.0;
+    combs[i].SetDelay(GetNumSamples(fs, combMs[i]));
 }
 
 // sets comb lowpass param g
@@ -205,7 +313,17 @@ void Reverb::SetCombZeroFreqGain(double zf, unsigned i)
 // returns comb delay
 unsigned Reverb::GetCombDelay(unsigned i)
 {
-    return GetDelayMS(fs, combs[i].GetDelay());
+    return static_cast<unsigned>(std::round(combMs[i]));
+}
+
+double Reverb::GetCombDelayMs(unsigned i) const
+{
+    return combMs[i];
+}
+
+unsigned Reverb::GetNumCombs() const
+{
+    return static_cast<unsigned>(combs.size());
 }
 
 // returns comb lowpass g
@@ -225,16 +343,165 @@ double Reverb::GetCombZeroFreqGain(unsigned i)
     return combs[i].GetZeroFreqGain();
 }
 
+// turns early reflections on/off
+void Reverb::SetEarlyReflections(bool on)
+{
+    earlyOn = on;
+}
+
+// sets early reflection tap table
+void Reverb::SetEarlyTaps(const std::vector<EarlyReflections::Tap> &taps)
+{
+    early.SetTaps(taps);
+}
+
+bool Reverb::GetEarlyReflections() const
+{
+    return earlyOn;
+}
+
+const std::vector<EarlyReflections::Tap> & Reverb::GetEarlyTaps() const
+{
+    return early.GetTaps();
+}
+
+// layout: shared comb input, comb outputs, allpass x and y, early reflections
+Reverb::State Reverb::GetState()
+{
+    State state;
+    unsigned longest = 0, shared = 0;
+    for (unsigned i = 0; i < combs.size(); ++i)
+        if (combs[i].GetStateLength() > longest) {
+            longest = combs[i].GetStateLength();
+            shared = i;
+        }
+    
+    state.lengths.push_back(longest);
+    size_t total = longest;
+    for (Comb &c : combs) {
+        state.lengths.push_back(c.GetStateLength());
+        total += c.GetStateLength();
+    }
+    state.lengths.push_back(ap.GetStateLength());
+    state.lengths.push_back(earlyOn ? early.GetStateLength() : 0);
+    total += 2 * ap.GetStateLength() + state.lengths.back();
+    
+    state.values.resize(total);
+    std::vector<float> x(longest);
+    float *v = state.values.data() + longest;
+    for (unsigned i = 0; i < combs.size(); ++i) {
+        combs[i].GetState(i == shared ? state.values.data() : x.data(), v);
+        v += combs[i].GetStateLength();
+    }
+    ap.GetState(v, v + ap.GetStateLength());
+    v += 2 * ap.GetStateLength();
+    if (earlyOn)
+        early.GetState(v);
+    
+    return state;
+}
+
+// a state from another layout resets the filter
+void Reverb::SetState(const State &state)
+{
+    Reset();
+    if (state.lengths.size() != combs.size() + 3)
+        return;
+    
+    const unsigned longest = state.lengths[0];
+    const float *v = state.values.data() + longest;
+    for (unsigned i = 0; i < combs.size(); ++i) {
+        unsigned n = state.lengths[i + 1];
+        combs[i].SetState(state.values.data() + longest - n, v, n);
+        v += n;
+    }
+    
+    unsigned n = state.lengths[combs.size() + 1];
+    ap.SetState(v, v + n, n);
+    v += 2 * n;
+    early.SetState(v, state.lengths[combs.size() + 2]);
+}
+
+// the combs share their input, taken from from's longest comb
+void Reverb::SetState(const Reverb &from)
+{
+    unsigned shared = 0;
+    for (unsigned i = 1; i < from.combs.size(); ++i)
+        if (from.combs[i].GetStateLength() > from.combs[shared].GetStateLength())
+            shared = i;
+    
+    for (unsigned i = 0; i < combs.size() && i < from.combs.size(); ++i)
+        combs[i].SetState(from.combs[shared], from.combs[i]);
+    
+    ap.SetState(from.ap);
+    if (from.earlyOn)
+        early.SetState(from.early);
+    else
+        early.SetState(nullptr, 0);
+}
+
 // returns filtered signal value
 float Reverb::operator()(float x)
 {
+    double in = x, reflections = 0.0;
+    if (earlyOn) {
+        early.Process(&in, &reflections, 1);
+        in = reflections;
+    }
+    
     // send signal through parallel comb filters
     double temp = 0.0f;
     for (Comb & c : combs) {
-        temp += c(x);
+        temp += c(in);
     }
     
     // send parallel comb output through allpass filter
     temp = ap(temp);
-    return temp * wet + x * dry;
+    return (temp + reflections) * wet + x * dry;
+}
+
+// sends a block through the parallel comb filters and sums their outputs
+void Reverb::ProcessCombs(const double *x, double *sum, double *reflections, unsigned n)
+{
+    const DspKernels &k = GetKernels();
+    double y[BlockSize];
+    
+    for (unsigned i = 0; i < n; ++i)
+        sum[i] = 0.0;
+    
+    if (earlyOn) {
+        early.Process(x, reflections, n);
+        x = reflections;
+    }
+    
+    for (Comb & c : combs) {
+        c.Process(x, y, n);
+        k.Accumulate(y, sum, n);
+    }
+}
+
+// filters a block of signal values
+void Reverb::Process(const float *in, float *out, unsigned n)
+{
+    const DspKernels &k = GetKernels();
+    double x[BlockSize], sum[BlockSize], y[BlockSize], reflections[BlockSize];
+    
+    while (n > 0) {
+        unsigned count = n < BlockSize ? n : BlockSize;
+        
+        for (unsigned i = 0; i < count; ++i)
+            x[i] = in[i];
+        
+        ProcessCombs(x, sum, reflections, count);
+        
+        // send parallel comb output through allpass filter
+        ap.Process(sum, y, count);
+        if (earlyOn)
+            k.Accumulate(reflections, y, count);
+        k.Mix(y, in, wet, dry, out, count);
+        
+        in += count;
+        out += count;
+        n -= count;
+    }
 }
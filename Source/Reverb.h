@@ -6,6 +6,8 @@
 #include <vector>
 #include "Comb.h"    // comb filter
 #include "AllPass.h" // allpass filter
+#include "EarlyReflections.h" // early reflection taps
+#include "Hash.h"    // parameter hash
 
 // Moorer Reverb Filter
 class Reverb
@@ -16,16 +18,25 @@ public:
     void Reset();
     
     // General Parameters
-    void SetSamplingRate(unsigned rate); // set sampling rate (Hz)
+    void SetSamplingRate(unsigned rate); // set sampling rate (Hz), delays keep their ms
     void SetDryPercetage(unsigned K);    // set dry percentage K
-    unsigned GetSamplingRate();
-    unsigned GetDryPercentage();
+    void SetDry(double dry);             // set dry fraction [0, 1], wet is the rest
+    unsigned GetSamplingRate() const;
+    unsigned GetDryPercentage() const;
+    double GetDry() const; // dry fraction
+    double GetWet() const; // wet fraction
+    double GetMaxGain(); // upper bound on output peak / input peak (impulse response L1 norm)
+    double GetDecayTime(double dB = 60.0); // seconds for the impulse response to fall by dB
+    Hash64 GetParameterHash(Hash64 seed = HashSeed); // hash of every filter parameter
     
     // AllPass Parameters
     void SetAllPassDelay(unsigned delay); // allpass delay (ms)
     void SetAllPassCoeff(double a);       // allpass coefficient a
+    void SetAllPassDelayMs(double ms);    // fractional ms, rounded to samples
     float GetAllPassDelay();
     float GetAllPassCoeff();
+    double GetAllPassDelayMs() const;
+    static double AllPassGain(double a);  // allpass L1 norm
 
     // Comb Parameters
     // i = comb #
@@ -33,17 +44,59 @@ public:
     void SetCombLowPassCoeff(double g, unsigned i); // lowpass coefficient g
     void SetCombGainConstant(double R, unsigned i); // gain constant R
     void SetCombZeroFreqGain(double gain, unsigned i);
+    void SetCombDelayMs(double ms, unsigned i);     // fractional ms, rounded to samples
     unsigned GetCombDelay(unsigned i);
+    double GetCombDelayMs(unsigned i) const;
+    unsigned GetNumCombs() const;
     double GetCombLowPassCoeff(unsigned i);
     double GetCombGainConstant(unsigned i);
     double GetCombZeroFreqGain(unsigned i);
     
+    // Early Reflections
+    // when on, the taps run ahead of the combs, which are fed their output
+    void SetEarlyReflections(bool on);
+    void SetEarlyTaps(const std::vector<EarlyReflections::Tap> &taps);
+    bool GetEarlyReflections() const;
+    const std::vector<EarlyReflections::Tap> & GetEarlyTaps() const;
+    
+    // filter state snapshot, every delay line as float, oldest first; the combs
+    // share their input, so it is stored once at the longest comb's length
+    struct State
+    {
+        std::vector<unsigned> lengths; // shared input, each comb, allpass, early reflections (0 when off)
+        std::vector<float> values;
+        size_t Bytes() const { return values.size() * sizeof(float); }
+    };
+    State GetState();
+    void SetState(const State &state); // lines now of another length keep their newest values
+    void SetState(const Reverb &from); // the same from another filter's lines, without allocating (lines as of the last Reset)
+    
     float operator()(float x); // filter signal value x
+    void Process(const float *in, float *out, unsigned n); // filter block (in may equal out)
+    
+    // filters, for engines built on this one's comb bank (stereo, multirate, fdn)
+    // and in-place coefficient changes; delays go through the setters above
+    Comb & GetComb(unsigned i) { return combs[i]; }
+    const Comb & GetComb(unsigned i) const { return combs[i]; }
+    AllPass & GetAllPass() { return ap; }
+    const AllPass & GetAllPass() const { return ap; }
+    const EarlyReflections & GetEarly() const { return early; }
+    
+    // comb bank sum, n <= BlockSize; with early reflections on they are written to
+    // early and feed the combs, the caller adds them after the allpass
+    void ProcessCombs(const double *x, double *sum, double *early, unsigned n);
+    double GetCombGain(); // comb bank L1 norm
+    
+    static const unsigned BlockSize = 256; // internal block size (samples)
 private:
     unsigned fs; // sampling rate (Hz)
     double dry;   // dry percentage
     double wet; // wet percentage
     
     std::vector<Comb> combs; // lowpass comb filters
+    std::vector<double> combMs; // comb delays (ms), samples follow the rate
     AllPass ap; // allpass filter
+    double apMs; // allpass delay (ms)
+    EarlyReflections early; // early reflection taps
+    bool earlyOn;
 };
@@ -0,0 +1,60 @@
+// RingBuffer.cpp
+// Spring 2021
+
+#include "RingBuffer.h"
+#include <cstring> // std::memcpy
+
+static size_t PowerOfTwo(size_t n)
+{
+    size_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+RingBuffer::RingBuffer(size_t capacity) : buffer(PowerOfTwo(capacity), 0.0f), mask(buffer.size() - 1), head(0), tail(0)
+{
+}
+
+size_t RingBuffer::Write(const float *in, size_t n)
+{
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    size_t space = buffer.size() - (h - t);
+    n = n < space ? n : space;
+    
+    // copy in up to two runs around the end of the buffer
+    size_t start = h & mask;
+    size_t first = (buffer.size() - start < n) ? buffer.size() - start : n;
+    std::memcpy(&buffer[start], in, first * sizeof(float));
+    std::memcpy(&buffer[0], in + first, (n - first) * sizeof(float));
+    
+    head.store(h + n, std::memory_order_release);
+    return n;
+}
+
+size_t RingBuffer::Read(float *out, size_t n)
+{
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    size_t ready = h - t;
+    n = n < ready ? n : ready;
+    
+    size_t start = t & mask;
+    size_t first = (buffer.size() - start < n) ? buffer.size() - start : n;
+    std::memcpy(out, &buffer[start], first * sizeof(float));
+    std::memcpy(out + first, &buffer[0], (n - first) * sizeof(float));
+    
+    tail.store(t + n, std::memory_order_release);
+    return n;
+}
+
+size_t RingBuffer::ReadAvailable() const
+{
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+size_t RingBuffer::WriteAvailable() const
+{
+    return buffer.size() - ReadAvailable();
+}
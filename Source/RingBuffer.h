@@ -0,0 +1,26 @@
+// RingBuffer.h
+// Spring 2021
+
+#pragma once
+#include <atomic>  // std::atomic
+#include <cstddef> // size_t
+#include <vector>  // std::vector
+
+// lock-free sample fifo for one producer thread and one consumer thread
+class RingBuffer
+{
+public:
+    RingBuffer(size_t capacity); // samples, rounded up to a power of two
+    
+    size_t Write(const float *in, size_t n); // producer, returns samples written
+    size_t Read(float *out, size_t n);       // consumer, returns samples read
+    
+    size_t ReadAvailable() const;  // samples waiting
+    size_t WriteAvailable() const; // free space
+    size_t GetCapacity() const { return buffer.size(); }
+private:
+    std::vector<float> buffer;
+    size_t mask;
+    std::atomic<size_t> head; // samples written (producer owned)
+    std::atomic<size_t> tail; // samples read (consumer owned)
+};
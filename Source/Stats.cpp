@@ -0,0 +1,138 @@
+// Stats.cpp
+// Spring 2021
+
+#include "Stats.h"
+#include <sstream>
+
+using namespace std;
+
+const unsigned DspStats::Bins;
+
+DspStats::DspStats() : rate(44100.0), budget(512 / 44100.0), load(0.0), maxLoad(0.0),
+blocks(0), samples(0), overruns(0), late(0), start(), lastStart(), lastPeriod(0.0)
+{
+    Reset();
+}
+
+void DspStats::Prepare(double sampleRate, unsigned blockSize)
+{
+    rate = sampleRate > 0.0 ? sampleRate : 44100.0;
+    budget = blockSize / rate;
+    Reset();
+}
+
+void DspStats::Reset()
+{
+    load = 0.0;
+    maxLoad = 0.0;
+    blocks = 0;
+    samples = 0;
+    overruns = 0;
+    late = 0;
+    for (auto &bin : histogram)
+        bin = 0;
+    lastPeriod = 0.0;
+}
+
+void DspStats::Begin()
+{
+    start = Clock::now();
+    
+    // a callback more than a period after it was due means the device starved
+    if (lastPeriod > 0.0) {
+        double gap = chrono::duration<double>(start - lastStart).count();
+        if (gap > 2.0 * lastPeriod)
+            late.fetch_add(1, memory_order_relaxed);
+    }
+    lastStart = start;
+}
+
+void DspStats::End(unsigned frames)
+{
+    double elapsed = chrono::duration<double>(Clock::now() - start).count();
+    double period = frames / rate.load(memory_order_relaxed);
+    double fraction = period > 0.0 ? elapsed / period : 0.0;
+    lastPeriod = period;
+    
+    // smooths over roughly a hundred blocks
+    double ema = load.load(memory_order_relaxed);
+    load.store(ema + (fraction - ema) * 0.01, memory_order_relaxed);
+    if (fraction > maxLoad.load(memory_order_relaxed))
+        maxLoad.store(fraction, memory_order_relaxed);
+    
+    unsigned bin = static_cast<unsigned>(fraction * (Bins / 2));
+    histogram[bin < Bins ? bin : Bins - 1].fetch_add(1, memory_order_relaxed);
+    
+    if (fraction > 1.0)
+        overruns.fetch_add(1, memory_order_relaxed);
+    samples.fetch_add(frames, memory_order_relaxed);
+    blocks.fetch_add(1, memory_order_release);
+}
+
+void DspStats::Idle()
+{
+    lastPeriod = 0.0;
+}
+
+DspStats::Snapshot DspStats::GetSnapshot() const
+{
+    Snapshot s;
+    s.blocks = blocks.load(memory_order_acquire);
+    s.budget = budget;
+    s.load = load;
+    s.maxLoad = maxLoad;
+    s.samples = samples;
+    s.overruns = overruns;
+    s.late = late;
+    
+    unsigned long long total = 0;
+    for (unsigned i = 0; i < Bins; ++i) {
+        s.histogram[i] = histogram[i].load(memory_order_relaxed);
+        total += s.histogram[i];
+    }
+    
+    // percentile is the upper edge of the bin that reaches it
+    double *targets[3] = { &s.p50, &s.p99, &s.p999 };
+    const double fractions[3] = { 0.5, 0.99, 0.999 };
+    for (int t = 0; t < 3; ++t) {
+        unsigned long long count = 0;
+        *targets[t] = 0.0;
+        for (unsigned i = 0; i < Bins && total; ++i) {
+            count += s.histogram[i];
+            if (count >= fractions[t] * total) {
+                *targets[t] = (i + 1.0) / (Bins / 2);
+                break;
+            }
+        }
+    }
+    
+    return s;
+}
+
+string DspStats::Format(const Snapshot &s, int deviceXruns)
+{
+    ostringstream out;
+    out.precision(3);
+    out << "budget ms    " << s.budget * 1000.0 << "\n"
+        << "load avg     " << s.load * 100.0 << "%\n"
+        << "load max     " << s.maxLoad * 100.0 << "%\n"
+        << "load p50     " << s.p50 * 100.0 << "%\n"
+        << "load p99     " << s.p99 * 100.0 << "%\n"
+        << "load p99.9   " << s.p999 * 100.0 << "%\n"
+        << "blocks       " << s.blocks << "\n"
+        << "samples      " << s.samples << "\n"
+        << "overruns     " << s.overruns << "\n"
+        << "late         " << s.late << "\n";
+    if (deviceXruns >= 0)
+        out << "device xruns " << deviceXruns << "\n";
+    
+    out << "histogram (load %: blocks)\n";
+    for (unsigned i = 0; i < Bins; ++i) {
+        if (s.histogram[i] == 0)
+            continue;
+        out << "  " << i * 100 / (Bins / 2) << (i + 1 < Bins ? "-" + to_string((i + 1) * 100 / (Bins / 2)) : "+")
+            << ": " << s.histogram[i] << "\n";
+    }
+    
+    return out.str();
+}
@@ -0,0 +1,68 @@
+// Stats.h
+// Spring 2021
+
+#pragma once
+#include <atomic>  // std::atomic
+#include <chrono>  // std::chrono::steady_clock
+#include <string>  // std::string
+
+// real-time load statistics for an audio callback or dsp worker
+// one thread records blocks (lock and allocation free), any thread reads
+class DspStats
+{
+public:
+    static const unsigned Bins = 64; // histogram bins, 1/32 of the budget each, last is open
+    
+    struct Snapshot
+    {
+        double budget;             // seconds per block at the expected size
+        double load;               // time / budget, moving average
+        double maxLoad;            // worst block
+        double p50, p99, p999;     // load percentiles (bin upper edges)
+        unsigned long long blocks;
+        unsigned long long samples;
+        unsigned long long overruns; // blocks that took longer than their budget
+        unsigned long long late;     // callbacks that started a period or more late
+        unsigned long long histogram[Bins];
+    };
+    
+    DspStats();
+    
+    void Prepare(double sampleRate, unsigned blockSize); // sets budget and resets
+    void Reset();
+    
+    // recording thread: brackets one block of frames
+    void Begin();
+    void End(unsigned frames);
+    void Idle(); // a deliberate wait, the next block isn't late
+    
+    // times its scope as one block
+    class Scope
+    {
+    public:
+        Scope(DspStats &stats, unsigned frames) : stats(stats), frames(frames) { stats.Begin(); }
+        ~Scope() { stats.End(frames); }
+    private:
+        DspStats &stats;
+        unsigned frames;
+    };
+    
+    Snapshot GetSnapshot() const;
+    
+    // text report, deviceXruns < 0 when the driver doesn't count them
+    static std::string Format(const Snapshot &s, int deviceXruns = -1);
+private:
+    typedef std::chrono::steady_clock Clock;
+    
+    std::atomic<double> rate;   // sampling rate
+    std::atomic<double> budget; // seconds per expected block
+    std::atomic<double> load;
+    std::atomic<double> maxLoad;
+    std::atomic<unsigned long long> blocks, samples, overruns, late;
+    std::atomic<unsigned long long> histogram[Bins];
+    
+    // recording thread only
+    Clock::time_point start;
+    Clock::time_point lastStart;
+    double lastPeriod; // seconds covered by the previous block
+};
@@ -0,0 +1,134 @@
+// StereoReverb.cpp
+// Spring 2021
+
+#include "StereoReverb.h"
+#include "Bench.h"   // noise, timing for benchmark
+#include "Kernels.h" // vectorized block kernels
+#include <cmath>     // std::sqrt
+#include <sstream>   // benchmark report
+#include <vector>    // std::vector
+
+const unsigned StereoReverb::BlockSize;
+
+const double RightDelayRatio = 1.31;  // right network allpass delay / left
+const double SpreadA = 0.5;           // decorrelating allpass coefficient
+const double SpreadMs[2] = {3.1, 4.3}; // decorrelating allpass delays, left and right
+
+// delay in samples for a time in ms
+static unsigned SpreadDelay(unsigned rate, double ms)
+{
+    return static_cast<unsigned>(rate * ms / 1000.0 + 0.5);
+}
+
+StereoReverb::StereoReverb(const Reverb &reverb) :
+bank(reverb),
+right(bank.GetAllPass().GetCoefficient(), static_cast<unsigned>(bank.GetAllPass().GetDelay() * RightDelayRatio + 0.5)),
+spreadL(SpreadA, SpreadDelay(bank.GetSamplingRate(), SpreadMs[0])),
+spreadR(SpreadA, SpreadDelay(bank.GetSamplingRate(), SpreadMs[1]))
+{
+    Reset();
+}
+
+void StereoReverb::Reset()
+{
+    bank.Reset();
+    right.Reset();
+    spreadL.Reset();
+    spreadR.Reset();
+}
+
+// the mid peak is at most the input peak; the network and spread allpasses are in series,
+// the right allpass has the left one's coefficient
+double StereoReverb::GetMaxGain()
+{
+    double late = bank.GetCombGain() * Reverb::AllPassGain(bank.GetAllPass().GetCoefficient()) * Reverb::AllPassGain(SpreadA);
+    if (bank.GetEarlyReflections())
+        return bank.GetDry() + bank.GetWet() * bank.GetEarly().GetGainSum() * (1.0 + late);
+    return bank.GetDry() + bank.GetWet() * late;
+}
+
+// mid signal through the combs once, then each channel's allpasses and dry/wet mix
+void StereoReverb::Process(const float *inL, const float *inR, float *outL, float *outR, unsigned n)
+{
+    const DspKernels &k = GetKernels();
+    double mid[BlockSize], sum[BlockSize], y[BlockSize], z[BlockSize], reflections[BlockSize];
+    const double dry = bank.GetDry(), wet = bank.GetWet();
+    const bool earlyOn = bank.GetEarlyReflections();
+    AllPass &ap = bank.GetAllPass();
+    
+    while (n > 0) {
+        unsigned count = n < BlockSize ? n : BlockSize;
+        
+        for (unsigned i = 0; i < count; ++i)
+            mid[i] = 0.5 * (static_cast<double>(inL[i]) + inR[i]);
+        
+        bank.ProcessCombs(mid, sum, reflections, count);
+        
+        ap.Process(sum, y, count);
+        spreadL.Process(y, z, count);
+        if (earlyOn)
+            k.Accumulate(reflections, z, count);
+        k.Mix(z, inL, wet, dry, outL, count);
+        
+        right.Process(sum, y, count);
+        spreadR.Process(y, z, count);
+        if (earlyOn)
+            k.Accumulate(reflections, z, count);
+        k.Mix(z, inR, wet, dry, outR, count);
+        
+        inL += count;
+        inR += count;
+        outL += count;
+        outR += count;
+        n -= count;
+    }
+}
+
+//==============================================================================
+// Benchmark
+
+// normalized correlation of left and right
+static double Correlation(const std::vector<float> &a, const std::vector<float> &b)
+{
+    double ab = 0.0, aa = 0.0, bb = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        ab += static_cast<double>(a[i]) * b[i];
+        aa += static_cast<double>(a[i]) * a[i];
+        bb += static_cast<double>(b[i]) * b[i];
+    }
+    return (aa > 0.0 && bb > 0.0) ? ab / std::sqrt(aa * bb) : 1.0;
+}
+
+std::string BenchmarkStereo()
+{
+    Reverb reverb;
+    reverb.SetDryPercetage(0); // wet only, so the correlation is the reverb's
+    
+    // 10 s of mono noise
+    std::vector<float> signal = Noise(10 * reverb.GetSamplingRate());
+    std::vector<float> outL(signal.size()), outR(signal.size());
+    
+    std::ostringstream report;
+    report << "mode           ns/frame  L/R correlation\n";
+    
+    Reverb mono = reverb;
+    double t = TimeBlocks([&](size_t i, unsigned n) {
+        mono.Process(&signal[i], &outL[i], n);
+    }, signal.size(), StereoReverb::BlockSize);
+    report << "mono           " << t << "\n";
+    
+    Reverb revL = reverb, revR = reverb;
+    t = TimeBlocks([&](size_t i, unsigned n) {
+        revL.Process(&signal[i], &outL[i], n);
+        revR.Process(&signal[i], &outR[i], n);
+    }, signal.size(), StereoReverb::BlockSize);
+    report << "per channel    " << t << "  " << Correlation(outL, outR) << "\n";
+    
+    StereoReverb stereo(reverb);
+    t = TimeBlocks([&](size_t i, unsigned n) {
+        stereo.Process(&signal[i], &signal[i], &outL[i], &outR[i], n);
+    }, signal.size(), StereoReverb::BlockSize);
+    report << "shared stereo  " << t << "  " << Correlation(outL, outR) << "\n";
+    
+    return report.str();
+}
@@ -0,0 +1,35 @@
+// StereoReverb.h
+// Spring 2021
+
+#pragma once
+#include <string>    // std::string
+#include "Reverb.h"  // moorer reverb filter
+#include "AllPass.h" // allpass filter
+
+// true stereo moorer reverb
+// left and right are summed into one comb bank, the bank's output goes through
+// a different allpass pair per channel, so the two outputs are decorrelated
+// for about half the cost of a reverb per channel
+class StereoReverb
+{
+public:
+    explicit StereoReverb(const Reverb &reverb); // comb, allpass and dry/wet parameters
+    
+    void Reset();
+    
+    // filter a stereo block (in may equal out)
+    void Process(const float *inL, const float *inR, float *outL, float *outR, unsigned n);
+    
+    double GetMaxGain(); // upper bound on output peak / input peak, either channel
+    
+    static const unsigned BlockSize = Reverb::BlockSize; // internal block size (samples)
+private:
+    Reverb bank;     // shared comb bank, its allpass feeds the left channel
+    AllPass right;   // network allpass with a longer delay for the right channel
+    AllPass spreadL; // short decorrelating allpasses
+    AllPass spreadR;
+};
+
+// times mono, per channel and shared stereo reverbs, and the correlation of
+// their left and right outputs for a mono input
+std::string BenchmarkStereo();
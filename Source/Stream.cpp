@@ -0,0 +1,169 @@
+// Stream.cpp
+// Spring 2021
+
+#include "Stream.h"
+#include "Kernels.h"
+#include <chrono> // std::chrono::milliseconds
+#include <cmath>  // std::pow
+#include <cstring> // std::memset
+
+const unsigned StreamSource::BlockFrames;
+
+// opens the file and sizes the ring for ahead seconds of audio
+StreamSource::StreamSource(const std::string &filename, unsigned rate, const Reverb *reverb, unsigned tail, float dB, float ahead) :
+reader(filename.c_str()),
+rate(rate ? rate : reader.GetFormat().rate),
+resamplers(),
+revs(),
+tailFrames(0),
+gain(1.0f),
+ring(static_cast<size_t>(this->rate * ahead + 2 * BlockFrames) * reader.GetFormat().channels),
+scratch(BlockFrames * reader.GetFormat().channels),
+stop(false),
+eof(false),
+underruns(0),
+stats(),
+worker()
+{
+    stats.Prepare(this->rate, BlockFrames);
+
+    unsigned fileRate = reader.GetFormat().rate;
+    if (this->rate != fileRate) {
+        resamplers.assign(GetChannels(), Resampler(fileRate, this->rate));
+        tailFrames = resamplers[0].GetTaps(); // flushes the last input frames
+    }
+    
+    if (reverb) {
+        revs.assign(GetChannels(), *reverb);
+        tailFrames += static_cast<size_t>(fileRate) * tail / 1000;
+        
+        // the input peak isn't known without reading the whole file,
+        // so assume full scale: the output can't exceed the reverb's max gain
+        gain = std::pow(10.0f, dB / 20.0f) / static_cast<float>(revs[0].GetMaxGain());
+    }
+}
+
+StreamSource::~StreamSource()
+{
+    Stop();
+}
+
+void StreamSource::Start()
+{
+    worker = std::thread(&StreamSource::Run, this);
+}
+
+void StreamSource::Stop()
+{
+    stop = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+void StreamSource::Run()
+{
+    unsigned nch = GetChannels();
+    size_t maxOut = resamplers.empty() ? BlockFrames : resamplers[0].MaxOutput(BlockFrames);
+    std::vector<float> block(BlockFrames * nch);
+    std::vector<float> plane(BlockFrames);
+    std::vector<float> converted(maxOut);
+    std::vector<float> output(maxOut * nch);
+    size_t tailLeft = tailFrames;
+    
+    while (!stop) {
+        if (ring.WriteAvailable() < output.size()) {
+            stats.Idle();
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        
+        stats.Begin();
+        size_t n = reader.Read(&block[0], BlockFrames);
+        
+        // after the file ends, feed the reverb silence for its tail
+        if (n < BlockFrames && tailLeft > 0) {
+            size_t pad = BlockFrames - n < tailLeft ? BlockFrames - n : tailLeft;
+            std::memset(&block[n * nch], 0, pad * nch * sizeof(float));
+            n += pad;
+            tailLeft -= pad;
+        }
+        
+        if (n == 0)
+            break;
+        
+        // convert to the playback rate, then reverb at that rate
+        size_t m = n;
+        for (unsigned c = 0; c < nch; ++c) {
+            for (size_t i = 0; i < n; ++i)
+                plane[i] = block[i * nch + c];
+            
+            float *x = &plane[0];
+            if (!resamplers.empty()) {
+                m = resamplers[c].Process(&plane[0], n, &converted[0]);
+                x = &converted[0];
+            }
+            
+            if (!revs.empty())
+                revs[c].Process(x, x, static_cast<unsigned>(m));
+            
+            for (size_t i = 0; i < m; ++i)
+                output[i * nch + c] = x[i];
+        }
+        
+        if (!revs.empty())
+            GetKernels().Scale(&output[0], m * nch, gain);
+        
+        ring.Write(&output[0], m * nch); // fits, space was checked
+        stats.End(static_cast<unsigned>(m));
+    }
+    
+    eof.store(true, std::memory_order_release);
+}
+
+size_t StreamSource::Read(float *const *outputs, unsigned numOutputs, size_t frames)
+{
+    unsigned nch = GetChannels();
+    size_t done = 0;
+    
+    while (done < frames) {
+        size_t ready = ring.ReadAvailable() / nch;
+        size_t n = frames - done;
+        n = n < ready ? n : ready;
+        n = n < BlockFrames ? n : BlockFrames;
+        if (n == 0)
+            break;
+        
+        ring.Read(&scratch[0], n * nch);
+        
+        for (unsigned j = 0; j < numOutputs; ++j) {
+            float *out = outputs[j] + done;
+            if (nch == 1 || j < nch) {
+                unsigned c = (nch == 1) ? 0 : j;
+                for (size_t i = 0; i < n; ++i)
+                    out[i] = scratch[i * nch + c];
+            }
+            else
+                std::memset(out, 0, n * sizeof(float));
+        }
+        done += n;
+    }
+    
+    if (done < frames) {
+        for (unsigned j = 0; j < numOutputs; ++j)
+            std::memset(outputs[j] + done, 0, (frames - done) * sizeof(float));
+        if (!eof.load(std::memory_order_acquire))
+            ++underruns;
+    }
+    
+    return done;
+}
+
+bool StreamSource::Finished() const
+{
+    return eof.load(std::memory_order_acquire) && ring.ReadAvailable() == 0;
+}
+
+unsigned StreamSource::Underruns() const
+{
+    return underruns.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,64 @@
+// Stream.h
+// Spring 2021
+
+#pragma once
+#include <atomic> // std::atomic
+#include <string> // std::string
+#include <thread> // std::thread
+#include <vector> // std::vector
+#include "WaveStream.h" // wave file reader
+#include "RingBuffer.h" // prefetch fifo
+#include "Reverb.h"     // moorer reverb filter
+#include "Resample.h"   // sample rate conversion
+#include "Stats.h"      // prefetch load
+
+// plays a wave file straight from disk
+// a prefetch thread reads (and reverbs) ahead into a ring buffer,
+// the audio thread only copies out of it, so memory use and startup
+// time don't depend on file length
+class StreamSource
+{
+public:
+    // rate = playback rate (0 plays at the file's rate), files at other rates are converted
+    // reverb may be null for dry playback, tail in ms, ahead = prefetch seconds
+    // throws on invalid files
+    StreamSource(const std::string &filename, unsigned rate = 0, const Reverb *reverb = nullptr,
+                 unsigned tail = 0, float dB = -1.5f, float ahead = 0.3f);
+    ~StreamSource(); // stops prefetch
+    
+    void Start(); // start prefetch thread
+    void Stop();  // stop prefetch and wait for it
+    
+    // audio thread, wait-free: fills frames of each output channel and
+    // returns the frames that came from the stream (the rest are zeroed)
+    // mono streams go to every output, extra outputs are silent
+    size_t Read(float *const *outputs, unsigned numOutputs, size_t frames);
+    
+    bool Finished() const;       // every frame has been read
+    unsigned Underruns() const;  // reads the prefetch couldn't keep up with
+    const DspStats & GetStats() const { return stats; } // prefetch time per block against real time
+    
+    unsigned GetRate() const     { return rate; }
+    unsigned GetChannels() const { return reader.GetFormat().channels; }
+    
+    static const unsigned BlockFrames = 1024; // frames prefetched at a time
+private:
+    void Run(); // prefetch thread
+    
+    WaveReader reader;
+    unsigned rate;              // playback rate
+    std::vector<Resampler> resamplers; // per channel, empty at the file's rate
+    std::vector<Reverb> revs;   // reverb state per channel, empty when dry
+    size_t tailFrames;          // silence fed to the reverb after the file ends (file rate)
+    float gain;                 // conservative playback gain
+    
+    RingBuffer ring;            // interleaved samples
+    std::vector<float> scratch; // audio thread deinterleave buffer
+    
+    std::atomic<bool> stop;
+    std::atomic<bool> eof;      // prefetch wrote its last block
+    std::atomic<unsigned> underruns;
+    DspStats stats;
+    
+    std::thread worker;
+};
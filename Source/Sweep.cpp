@@ -0,0 +1,142 @@
+// Sweep.cpp
+// Spring 2021
+
+#include "Sweep.h"
+#include "WorkPool.h" // work-stealing pool
+#include "Trace.h"
+#include <algorithm>  // std::min
+#include <chrono>     // render timing
+#include <fstream>
+#include <sstream>    // line parsing, names, report
+#include <stdexcept>
+
+std::vector<SweepAxis> LoadSweep(const std::string &fname)
+{
+    std::ifstream file(fname);
+    if (!file)
+        throw std::runtime_error("unable to read sweep " + fname);
+
+    std::vector<SweepAxis> axes;
+    std::string line;
+    for (unsigned number = 1; std::getline(file, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string id;
+        if (!(fields >> id))
+            continue; // blank or comment
+
+        SweepAxis axis;
+        double value;
+        while (fields >> value)
+            axis.values.push_back(value);
+        if (!fields.eof() || axis.values.empty() || !Automation::ParseId(id, axis.parameter, axis.comb))
+            throw std::runtime_error(fname + ":" + std::to_string(number) + ": expected parameter id, values");
+        axes.push_back(axis);
+    }
+    return axes;
+}
+
+std::vector<SweepVariant> SweepVariants(const Reverb &base, const std::vector<SweepAxis> &axes)
+{
+    size_t count = 1;
+    for (const SweepAxis &a : axes)
+        count *= a.values.size();
+
+    std::vector<SweepVariant> variants;
+    variants.reserve(count);
+    for (size_t v = 0; v < count; ++v) {
+        SweepVariant variant = { base, "" };
+        std::ostringstream name;
+
+        // v in mixed radix, one digit per axis
+        size_t rest = v;
+        std::vector<size_t> digits(axes.size());
+        for (size_t a = axes.size(); a-- > 0;) {
+            digits[a] = rest % axes[a].values.size();
+            rest /= axes[a].values.size();
+        }
+        for (size_t a = 0; a < axes.size(); ++a) {
+            double value = axes[a].values[digits[a]];
+            AutomatedReverb::Apply(variant.reverb, axes[a].parameter, axes[a].comb, value);
+            name << (a ? " " : "") << Automation::Id(axes[a].parameter, axes[a].comb) << "=" << value;
+        }
+        variant.name = name.str();
+        variants.push_back(variant);
+    }
+    return variants;
+}
+
+std::string SweepStats::Report() const
+{
+    std::ostringstream report;
+    report << variants << " variants on " << threads << " threads, " << steals << " stolen\n";
+    report << "wall " << seconds << " s, busy " << busy << " s (" << (seconds > 0.0 ? busy / seconds : 0.0)
+           << " threads' worth)\n";
+    report << "throughput " << (seconds > 0.0 ? frames / seconds / 1e6 : 0.0) << " M samples/s, "
+           << (seconds > 0.0 ? audioSeconds / seconds : 0.0) << "x real time\n";
+    return report.str();
+}
+
+// one variant: each channel through its own copy of the reverb, then the
+// usual normalize and write
+static void RenderVariant(const AudioData &input, Reverb reverb, unsigned tail, float dB, const std::string &out)
+{
+    const unsigned nch = input.channels();
+    const size_t tailFrames = static_cast<size_t>(static_cast<unsigned long long>(input.rate()) * tail / 1000);
+    AudioData output(input.frames() + tailFrames, input.rate(), nch);
+
+    reverb.SetSamplingRate(input.rate());
+    float plane[Reverb::BlockSize];
+    for (unsigned c = 0; c < nch; ++c) {
+        MR_TRACE_SCOPE_ARG("sweep", "channel", c);
+        Reverb r = reverb;
+        r.Reset();
+        for (size_t pos = 0; pos < output.frames(); pos += Reverb::BlockSize) {
+            unsigned n = static_cast<unsigned>(std::min<size_t>(Reverb::BlockSize, output.frames() - pos));
+            for (unsigned i = 0; i < n; ++i)
+                plane[i] = pos + i < input.frames() ? input.sample(pos + i, c) : 0.0f;
+            r.Process(plane, plane, n);
+            for (unsigned i = 0; i < n; ++i)
+                output.sample(pos + i, c) = plane[i];
+        }
+    }
+
+    normalize(output, dB);
+    if (!waveWrite(out.c_str(), output))
+        throw std::runtime_error("unable to write " + out);
+}
+
+SweepStats RenderSweep(const AudioData &input, const std::vector<SweepVariant> &variants,
+                       const std::vector<std::string> &outputs, unsigned tail, float dB, unsigned threads)
+{
+    if (outputs.size() != variants.size())
+        throw std::runtime_error("sweep needs one output per variant");
+
+    WorkPool pool(threads);
+    std::vector<double> busy(pool.GetThreads(), 0.0); // per thread, summed after
+    std::vector<WorkPool::Task> tasks;
+    for (size_t v = 0; v < variants.size(); ++v)
+        tasks.push_back([&, v](unsigned thread) {
+            auto start = std::chrono::steady_clock::now();
+            RenderVariant(input, variants[v].reverb, tail, dB, outputs[v]);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            busy[thread] += elapsed.count();
+        });
+
+    auto start = std::chrono::steady_clock::now();
+    pool.Run(std::move(tasks));
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    SweepStats stats;
+    stats.variants = variants.size();
+    stats.threads = pool.GetThreads();
+    stats.steals = pool.GetSteals();
+    stats.seconds = elapsed.count();
+    stats.busy = 0.0;
+    for (double b : busy)
+        stats.busy += b;
+    const unsigned long long frames = input.frames() + static_cast<unsigned long long>(input.rate()) * tail / 1000;
+    stats.frames = frames * input.channels() * variants.size();
+    stats.audioSeconds = input.rate() ? static_cast<double>(frames) / input.rate() * variants.size() : 0.0;
+    return stats;
+}
@@ -0,0 +1,55 @@
+// Sweep.h
+// Spring 2021
+
+#pragma once
+#include <string>       // std::string
+#include <vector>       // std::vector
+#include "AudioData.h"  // audio buffer
+#include "Automation.h" // parameter ids
+#include "Reverb.h"     // moorer reverb filter
+
+// parameter sweep: one decoded input rendered with many reverb settings at
+// once, every variant reading the same shared input
+
+// values to try for one parameter
+struct SweepAxis
+{
+    Automation::Parameter parameter;
+    unsigned comb;
+    std::vector<double> values;
+};
+
+// one parameter set of a sweep, named by the values it was given
+struct SweepVariant
+{
+    Reverb reverb;
+    std::string name; // e.g. "comb1_g=0.3 dry=20"
+};
+
+// sweep file: one parameter per line, its id (as in automation lanes) then
+// the values to try, '#' comments; throws on unreadable lines or unknown ids
+std::vector<SweepAxis> LoadSweep(const std::string &fname);
+
+// every combination of the axes' values applied to base, the last axis varying
+// fastest; base should already be at the input's sampling rate
+std::vector<SweepVariant> SweepVariants(const Reverb &base, const std::vector<SweepAxis> &axes);
+
+struct SweepStats
+{
+    size_t variants;
+    unsigned threads;
+    size_t steals;             // variants run by a thread they weren't dealt to
+    double seconds;            // wall clock
+    double busy;               // summed per variant render and write time
+    unsigned long long frames; // output frames over all variants and channels
+    double audioSeconds;       // output audio over all variants
+
+    std::string Report() const; // aggregate throughput
+};
+
+// renders each variant of input (tail ms, normalized to dB) to outputs[i] with
+// the 16 bit wave writer, on a work-stealing pool of threads (0 = one per core);
+// throws on a write error, after the running renders finish
+SweepStats RenderSweep(const AudioData &input, const std::vector<SweepVariant> &variants,
+                       const std::vector<std::string> &outputs, unsigned tail, float dB = -1.5f,
+                       unsigned threads = 0);
@@ -0,0 +1,136 @@
+// Trace.cpp
+// Spring 2021
+
+#include "Trace.h"
+#include <cstdlib> // std::getenv
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    typedef chrono::steady_clock Clock;
+    
+    struct TraceEvent
+    {
+        const char *name;
+        const char *arg;
+        long long value;
+        long long ts;  // microseconds since the trace started
+        long long dur; // microseconds
+    };
+    
+    // events of one thread, only that thread appends
+    struct ThreadEvents
+    {
+        unsigned tid;
+        mutex lock; // taken by the owner per event (uncontended) and by Flush
+        vector<TraceEvent> events;
+    };
+    
+    // every thread's events, written at exit
+    class Tracer
+    {
+    public:
+        Tracer() : file(), epoch(Clock::now()), threads()
+        {
+            if (const char *env = getenv("MOORER_TRACE"))
+                file = env;
+        }
+        
+        ~Tracer() { Flush(); }
+        
+        bool Enabled() const { return !file.empty(); }
+        
+        ThreadEvents & Local()
+        {
+            // buffers belong to the tracer so they outlive their threads
+            thread_local ThreadEvents *local = nullptr;
+            if (!local) {
+                lock_guard<mutex> guard(lock);
+                threads.push_back(unique_ptr<ThreadEvents>(new ThreadEvents));
+                local = threads.back().get();
+                local->tid = static_cast<unsigned>(threads.size());
+                local->events.reserve(1024);
+            }
+            return *local;
+        }
+        
+        long long Micros(Clock::time_point t) const
+        {
+            return chrono::duration_cast<chrono::microseconds>(t - epoch).count();
+        }
+        
+        bool Flush()
+        {
+            if (!Enabled())
+                return true;
+            
+            lock_guard<mutex> guard(lock);
+            ofstream out(file);
+            out << "{\"traceEvents\":[\n";
+            bool first = true;
+            
+            for (auto &thread : threads) {
+                lock_guard<mutex> threadGuard(thread->lock);
+                for (const TraceEvent &e : thread->events) {
+                    out << (first ? "" : ",\n")
+                        << "{\"name\":\"" << e.name << "\",\"cat\":\"render\",\"ph\":\"X\",\"ts\":" << e.ts
+                        << ",\"dur\":" << e.dur << ",\"pid\":1,\"tid\":" << thread->tid;
+                    if (e.arg)
+                        out << ",\"args\":{\"" << e.arg << "\":" << e.value << "}";
+                    out << "}";
+                    first = false;
+                }
+            }
+            
+            out << "\n]}\n";
+            return static_cast<bool>(out);
+        }
+    private:
+        string file;
+        Clock::time_point epoch;
+        mutex lock;
+        vector<unique_ptr<ThreadEvents>> threads;
+    };
+    
+    Tracer & GetTracer()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+}
+
+TraceScope::TraceScope(const char *name, const char *arg, long long value) :
+name(name), arg(arg), value(value), start(Enabled() ? Clock::now() : Clock::time_point())
+{
+}
+
+TraceScope::~TraceScope()
+{
+    if (!Enabled())
+        return;
+    
+    Tracer &tracer = GetTracer();
+    Clock::time_point end = Clock::now();
+    long long ts = tracer.Micros(start);
+    TraceEvent e = { name, arg, value, ts, tracer.Micros(end) - ts };
+    
+    ThreadEvents &local = tracer.Local();
+    lock_guard<mutex> guard(local.lock);
+    local.events.push_back(e);
+}
+
+bool TraceScope::Enabled()
+{
+    return GetTracer().Enabled();
+}
+
+bool TraceScope::Flush()
+{
+    return GetTracer().Flush();
+}
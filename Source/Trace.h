@@ -0,0 +1,41 @@
+// Trace.h
+// Spring 2021
+
+#pragma once
+#include <chrono> // std::chrono::steady_clock
+
+// scoped trace markers written as Chrome/Perfetto trace event json
+//
+// markers are built into every configuration and cost a flag test until
+// MOORER_TRACE names an output file; then events are recorded and written
+// there at exit. Define MOORER_TRACING=0 to compile them out.
+// names must be string literals (or otherwise outlive the program).
+
+#ifndef MOORER_TRACING
+#define MOORER_TRACING 1
+#endif
+
+class TraceScope
+{
+public:
+    TraceScope(const char *name, const char *arg = nullptr, long long value = 0);
+    ~TraceScope();
+    
+    static bool Enabled(); // MOORER_TRACE is set
+    static bool Flush();   // writes everything recorded so far, returns false on error
+private:
+    const char *name;
+    const char *arg;  // optional integer argument
+    long long value;
+    std::chrono::steady_clock::time_point start;
+};
+
+#if MOORER_TRACING
+#define MR_TRACE_JOIN2(a, b) a##b
+#define MR_TRACE_JOIN(a, b) MR_TRACE_JOIN2(a, b)
+#define MR_TRACE_SCOPE(name) TraceScope MR_TRACE_JOIN(traceScope, __LINE__)(name)
+#define MR_TRACE_SCOPE_ARG(name, arg, value) TraceScope MR_TRACE_JOIN(traceScope, __LINE__)(name, arg, value)
+#else
+#define MR_TRACE_SCOPE(name)
+#define MR_TRACE_SCOPE_ARG(name, arg, value)
+#endif
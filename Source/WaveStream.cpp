@@ -0,0 +1,80 @@
+// WaveStream.cpp
+// Spring 2021
+
+#include "WaveStream.h"
+#include <stdexcept>
+
+using namespace std;
+
+WaveReader::WaveReader(const char *fname) : in(fname, ios_base::binary | ios_base::in), format(), start(0), position(0), pcm()
+{
+    if (!in)
+        throw runtime_error("unable to open file");
+    
+    format = waveReadHeader(in);
+    start = in.tellg();
+}
+
+size_t WaveReader::Read(float *out, size_t frames)
+{
+    unsigned long long left = format.frames - position;
+    size_t n = (left < frames) ? static_cast<size_t>(left) : frames;
+    size_t samples = n * format.channels;
+    
+    if (n == 0)
+        return 0;
+    
+    // shorts hold either resolution
+    if (pcm.size() < samples)
+        pcm.resize(samples);
+    
+    in.read(reinterpret_cast<char*>(&pcm[0]), samples * (format.bits / 8));
+    
+    // file shorter than its header says
+    if (!in) {
+        n = static_cast<size_t>(in.gcount()) / (format.channels * (format.bits / 8));
+        samples = n * format.channels;
+        format.frames = position + n;
+        in.clear();
+    }
+    
+    pcmToFloat(&pcm[0], out, samples, format.bits);
+    position += n;
+    return n;
+}
+
+void WaveReader::Seek(unsigned long long frame)
+{
+    position = frame < format.frames ? frame : format.frames;
+    in.clear();
+    in.seekg(start + static_cast<streamoff>(position * format.channels * (format.bits / 8)));
+}
+
+WaveWriter::WaveWriter(const char *fname, const WaveFormat &format) : out(fname, ios_base::binary | ios_base::out | ios_base::trunc), format(format), written(0), pcm()
+{
+    if (!out.is_open())
+        throw runtime_error("unable to create file");
+    
+    waveWriteHeader(out, format);
+}
+
+void WaveWriter::Write(const float *in, size_t frames)
+{
+    size_t samples = frames * format.channels;
+    if (pcm.size() < samples)
+        pcm.resize(samples);
+    
+    floatToPcm(in, &pcm[0], samples, format.bits);
+    out.write(reinterpret_cast<char*>(&pcm[0]), samples * (format.bits / 8));
+    written += frames;
+}
+
+bool WaveWriter::Close()
+{
+    // chunks are padded to an even size
+    if ((written * format.channels * (format.bits / 8)) % 2)
+        out.put(0);
+    
+    out.close();
+    return static_cast<bool>(out) && written == format.frames;
+}
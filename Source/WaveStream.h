@@ -0,0 +1,41 @@
+// WaveStream.h
+// Spring 2021
+
+#pragma once
+#include <fstream> // std::fstream
+#include <vector>  // std::vector
+#include "AudioData.h" // WaveFormat, pcm conversion
+
+// reads the sample data of a wave file a block at a time
+class WaveReader
+{
+public:
+    WaveReader(const char *fname); // throws on invalid files, like AudioData
+    
+    const WaveFormat & GetFormat() const { return format; }
+    
+    size_t Read(float *out, size_t frames); // interleaved, returns frames read (0 at end)
+    void Seek(unsigned long long frame);
+    unsigned long long GetPosition() const { return position; }
+private:
+    std::fstream in;
+    WaveFormat format;
+    std::streamoff start;        // first byte of sample data
+    unsigned long long position; // next frame
+    std::vector<short> pcm;      // read buffer
+};
+
+// writes a wave file a block at a time, format.frames must be known up front
+class WaveWriter
+{
+public:
+    WaveWriter(const char *fname, const WaveFormat &format); // throws if the file can't be opened
+    
+    void Write(const float *in, size_t frames); // interleaved
+    bool Close(); // pads the data chunk, returns true if every write succeeded
+private:
+    std::fstream out;
+    WaveFormat format;
+    unsigned long long written; // frames
+    std::vector<short> pcm;     // write buffer
+};
@@ -0,0 +1,83 @@
+// WorkPool.cpp
+// Spring 2021
+
+#include "WorkPool.h"
+#include <exception> // std::exception_ptr
+#include <thread>    // std::thread
+
+WorkPool::WorkPool(unsigned threads) : threads(threads), queues(), steals(0), failed(false)
+{
+    if (this->threads == 0)
+        this->threads = std::thread::hardware_concurrency();
+    if (this->threads == 0)
+        this->threads = 1;
+    queues = std::vector<Queue>(this->threads);
+}
+
+bool WorkPool::Take(unsigned thread, Task &task)
+{
+    {
+        Queue &own = queues[thread];
+        std::lock_guard<std::mutex> hold(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // tasks are only added before the workers start, so one empty pass means done
+    for (unsigned i = 1; i < threads; ++i) {
+        Queue &victim = queues[(thread + i) % threads];
+        std::lock_guard<std::mutex> hold(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            ++steals;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkPool::Work(unsigned thread)
+{
+    Task task;
+    while (!failed && Take(thread, task))
+        task(thread);
+}
+
+void WorkPool::Run(std::vector<Task> tasks)
+{
+    steals = 0;
+    failed = false;
+    for (size_t i = 0; i < tasks.size(); ++i)
+        queues[i % threads].tasks.push_back(std::move(tasks[i]));
+
+    // the rest of the batch is dropped after a failure
+    std::exception_ptr error;
+    std::mutex errorLock;
+    auto work = [&](unsigned thread) {
+        try {
+            Work(thread);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> hold(errorLock);
+            if (!error)
+                error = std::current_exception();
+            failed = true;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.push_back(std::thread(work, t));
+    work(0);
+    for (std::thread &t : pool)
+        t.join();
+
+    for (Queue &q : queues)
+        q.tasks.clear();
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,41 @@
+// WorkPool.h
+// Spring 2021
+
+#pragma once
+#include <atomic>     // std::atomic
+#include <deque>      // std::deque
+#include <functional> // std::function
+#include <mutex>      // std::mutex
+#include <vector>     // std::vector
+
+// work-stealing pool for batches of independent tasks of uneven cost
+// tasks are dealt round-robin onto one deque per thread; a thread takes its
+// own newest task and, when out, steals the oldest from another thread
+class WorkPool
+{
+public:
+    typedef std::function<void(unsigned thread)> Task;
+
+    explicit WorkPool(unsigned threads = 0); // 0 = one per core
+
+    // runs every task on the calling thread plus threads - 1 workers, returns
+    // when all are done; the first exception thrown by a task is rethrown
+    void Run(std::vector<Task> tasks);
+
+    unsigned GetThreads() const { return threads; }
+    size_t GetSteals() const { return steals; } // tasks run by another thread than dealt to, last Run
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    bool Take(unsigned thread, Task &task); // own newest, else steal oldest
+    void Work(unsigned thread);
+
+    unsigned threads;
+    std::vector<Queue> queues;
+    std::atomic<size_t> steals;
+    std::atomic<bool> failed;
+};